@@ -1,2 +1,16 @@
 CXXFLAGS += -std=c++17
 COMPONENT_SRCDIRS = src src/httpd src/firebase
+
+# Bundles the web UI in ESPCXX_WEB_ASSETS_DIR (see Makefile.projbuild) into
+# esp_cxx::kWebAssets.
+ifdef ESPCXX_WEB_ASSETS_DIR
+ESPCXX_WEB_ASSETS_FILES := $(shell find $(ESPCXX_WEB_ASSETS_DIR) -type f)
+CXXFLAGS += -DESPCXX_HAVE_WEB_ASSETS=1 -I$(COMPONENT_BUILD_DIR)
+COMPONENT_EXTRA_CLEAN := esp_cxx_web_assets.h
+
+src/httpd/web_assets.o: esp_cxx_web_assets.h
+
+esp_cxx_web_assets.h: $(ESPCXX_WEB_ASSETS_FILES) $(COMPONENT_PATH)/script/bundle-web-assets
+	$(summary) BUNDLE $(ESPCXX_WEB_ASSETS_DIR)
+	$(PYTHON) $(COMPONENT_PATH)/script/bundle-web-assets $(ESPCXX_WEB_ASSETS_FLAGS) $(ESPCXX_WEB_ASSETS_DIR) $@
+endif
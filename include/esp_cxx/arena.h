@@ -0,0 +1,119 @@
+#ifndef ESPCXX_ARENA_H_
+#define ESPCXX_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace esp_cxx {
+
+// Bump allocator for short-lived, request-scoped data. Memory is taken from
+// the heap in blocks and handed out sequentially. Individual allocations
+// are never freed; everything goes at once in Reset() or the destructor.
+// Many small, differently sized allocations that would otherwise fragment
+// the heap become a few same-sized blocks.
+//
+// Not thread-safe, apart from Owns().
+class Arena {
+ public:
+  // Allocations larger than a quarter of |block_size| get their own block
+  // so they do not waste the tail of the current one.
+  explicit Arena(size_t block_size = 1024);
+  ~Arena();
+
+  void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+  // Returns true if |ptr| was handed out by this arena.
+  bool Contains(const void* ptr) const;
+
+  // Returns true if |ptr| was handed out by any live arena. Callable from
+  // any task.
+  static bool Owns(const void* ptr);
+
+  // Releases everything but the first block, which is kept for reuse.
+  void Reset();
+
+  // Bytes handed out since construction or the last Reset().
+  size_t bytes_used() const { return bytes_used_; }
+
+  // The arena made current by the innermost Scope on this thread, or
+  // nullptr. HttpServer makes a connection's arena current while calling
+  // an endpoint that asked for one with set_use_arena().
+  static Arena* Current();
+
+  // Makes |arena| current on this thread for the lifetime of the Scope.
+  // While it is, cJSON allocates out of |arena|; cJSON objects and
+  // printed strings created in the Scope should be freed (or abandoned)
+  // before it ends. Freeing them later is harmless but only returns the
+  // memory at the next Reset(). A null |arena| leaves the current one
+  // unchanged.
+  class Scope {
+   public:
+    explicit Scope(Arena* arena);
+    ~Scope();
+
+   private:
+    Arena* previous_;
+    bool active_;
+
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+  };
+
+ private:
+  struct Block {
+    Block* next;
+    size_t size;
+    // Data follows.
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+  };
+
+  Block* NewBlock(size_t size);
+  void FreeBlocks(Block* first);
+
+  const size_t block_size_;
+  Block* blocks_ = nullptr;  // Current block first.
+  Arena* next_arena_ = nullptr;  // In the list of live arenas.
+  size_t used_in_block_ = 0;
+  size_t bytes_used_ = 0;
+
+  Arena(const Arena&) = delete;
+  void operator=(const Arena&) = delete;
+};
+
+// STL allocator over an Arena, eg for request-scoped strings:
+//   std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>
+//       path(ArenaAllocator<char>(arena));
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  Arena* arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena_ == other.arena();
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena_ != other.arena();
+  }
+
+ private:
+  Arena* arena_;
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_ARENA_H_
@@ -1,18 +1,66 @@
 #ifndef BACKOFF_H_
 #define BACKOFF_H_
 
-#include <random>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#include "esp_cxx/mutex.h"
 
 namespace esp_cxx {
 
+// Returns a seed from the hardware RNG (esp_random()) or, on FAKE_ESP_IDF,
+// std::random_device. Slow-ish. Call once per generator.
+uint32_t RandomSeed();
+
+// xorshift32. 4 bytes of state instead of the ~5kB of std::mt19937, which
+// is plenty for spreading out retries.
+class XorShift32 {
+ public:
+  XorShift32() : XorShift32(RandomSeed()) {}
+  explicit XorShift32(uint32_t seed) : state_(seed ? seed : 0x9e3779b9) {}
+
+  uint32_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+
+  // Uniform in [low, high]. The modulo bias is irrelevant at these ranges.
+  uint32_t Uniform(uint32_t low, uint32_t high) {
+    return low + Next() % (high - low + 1);
+  }
+
+ private:
+  uint32_t state_;
+};
+
+// All policies below share an interface:
+//   int MsToNextTry();  // Delay before the next attempt.
+//   void Reset();       // Call on success.
+// and never return more than kMaxBackoffMs (plus kJitterMs where noted).
+
+// Doubles from |kBaseMs| up to |kMaxBackoffMs| and adds a uniform
+// [0, kJitterMs] jitter. Per
+// https://cloud.google.com/iot/docs/how-tos/exponential-backoff, the
+// default is 1000ms of jitter.
+//
 // 14 steps of backoff on a 100ms delay is near 30-mins. Seems solid default
 // for low power usage and low chance of prolongued disconnect.
-template <int kBaseMs = 100, int kMaxBackoffMs = 30*60*1000>
-class BackoffCalculator {
+template <int kBaseMs = 100, int kMaxBackoffMs = 30*60*1000, int kJitterMs = 1000>
+class CappedExponentialBackoff {
  public:
-  // TODO(awong): static_assert that there's not overflow in bounds.
+  static_assert(kBaseMs > 0, "kBaseMs must be positive");
+  static_assert(kMaxBackoffMs >= kBaseMs, "kMaxBackoffMs must be >= kBaseMs");
+  static_assert(kJitterMs >= 0, "kJitterMs must not be negative");
+  // The doubling stops at the first value >= kMaxBackoffMs which is at
+  // most 2 * kMaxBackoffMs - 1.
+  static_assert(kMaxBackoffMs <= INT_MAX / 2, "Doubling could overflow");
+  static_assert(kMaxBackoffMs <= INT_MAX - kJitterMs, "Jitter could overflow");
+
   int MsToNextTry() {
-    int backoff_ms = kBaseMs * (1 << backoff_attempt_);
+    int backoff_ms = kBaseMs << backoff_attempt_;
 
     if (backoff_ms >= kMaxBackoffMs) {
       backoff_ms = kMaxBackoffMs;
@@ -20,17 +68,106 @@ class BackoffCalculator {
       backoff_attempt_++;
     }
 
-    return backoff_ms + jitter_dist_(e_);
+    return backoff_ms + rng_.Uniform(0, kJitterMs);
+  }
+
+  void Reset() { backoff_attempt_ = 0; }
+
+ private:
+  int backoff_attempt_ = 0;
+  XorShift32 rng_;
+};
+
+// Compatibility name for the original policy.
+template <int kBaseMs = 100, int kMaxBackoffMs = 30*60*1000>
+using BackoffCalculator = CappedExponentialBackoff<kBaseMs, kMaxBackoffMs>;
+
+// "Full jitter": uniform in [0, min(kMaxBackoffMs, kBaseMs * 2^attempt)].
+// Spreads a synchronized herd (eg, a fleet reboot) over the whole window.
+template <int kBaseMs = 100, int kMaxBackoffMs = 30*60*1000>
+class FullJitterBackoff {
+ public:
+  static_assert(kBaseMs > 0, "kBaseMs must be positive");
+  static_assert(kMaxBackoffMs >= kBaseMs, "kMaxBackoffMs must be >= kBaseMs");
+  static_assert(kMaxBackoffMs <= INT_MAX / 2, "Doubling could overflow");
+
+  int MsToNextTry() {
+    int ceiling_ms = kBaseMs << backoff_attempt_;
+    if (ceiling_ms >= kMaxBackoffMs) {
+      ceiling_ms = kMaxBackoffMs;
+    } else {
+      backoff_attempt_++;
+    }
+    return rng_.Uniform(0, ceiling_ms);
   }
 
   void Reset() { backoff_attempt_ = 0; }
 
  private:
   int backoff_attempt_ = 0;
-  std::random_device rd_;
-  std::mt19937 e_{rd_()};
-  // Per https://cloud.google.com/iot/docs/how-tos/exponential-backoff, use 1000ms of jitter.
-  std::uniform_int_distribution<int> jitter_dist_{0, 1000};
+  XorShift32 rng_;
+};
+
+// "Decorrelated jitter": next = min(kMaxBackoffMs, uniform(kBaseMs, 3 * prev)).
+// Grows about as fast as doubling but each delay depends on the last one
+// rather than the attempt count so peers drift apart over time.
+template <int kBaseMs = 100, int kMaxBackoffMs = 30*60*1000>
+class DecorrelatedJitterBackoff {
+ public:
+  static_assert(kBaseMs > 0, "kBaseMs must be positive");
+  static_assert(kMaxBackoffMs >= kBaseMs, "kMaxBackoffMs must be >= kBaseMs");
+  static_assert(kMaxBackoffMs <= INT_MAX / 3, "Tripling could overflow");
+
+  int MsToNextTry() {
+    int next_ms = rng_.Uniform(kBaseMs, prev_ms_ * 3);
+    if (next_ms > kMaxBackoffMs) {
+      next_ms = kMaxBackoffMs;
+    }
+    prev_ms_ = next_ms;
+    return next_ms;
+  }
+
+  void Reset() { prev_ms_ = kBaseMs; }
+
+ private:
+  int prev_ms_ = kBaseMs;
+  XorShift32 rng_;
+};
+
+// Token bucket shared by all retry loops in the process so that several
+// failing subsystems (eg, Wifi and FirebaseDatabase after the AP goes
+// away) cannot together retry faster than the budget allows. Up to
+// |max_tokens| retries may happen back to back, then one every
+// |refill_interval_ms|.
+//
+// Thread-safe.
+class RetryBudget {
+ public:
+  RetryBudget(int max_tokens, int refill_interval_ms);
+
+  // Reserves a retry no earlier than |delay_ms| from now and returns the
+  // delay to actually wait, which is larger than |delay_ms| if the budget
+  // is exhausted.
+  int Reserve(int delay_ms);
+
+  // Process-wide budget used by the library's own reconnect loops. None
+  // by default. |budget| must outlive all users.
+  static void SetShared(RetryBudget* budget);
+
+  // Returns |delay_ms| adjusted by the shared budget, if one is set.
+  static int ReserveShared(int delay_ms);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  Mutex lock_;
+  const int max_tokens_;
+  const Clock::duration refill_interval_;
+
+  // Time at which the bucket is full again. Each reservation pushes this
+  // out by one refill interval. Tracking one time point instead of a token
+  // count keeps the refill exact without a timer.
+  Clock::time_point full_at_;
 };
 
 }  // namespace esp_cxx
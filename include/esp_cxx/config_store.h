@@ -1,6 +1,8 @@
 #ifndef CONFIG_STORE_H_
 #define CONFIG_STORE_H_
 
+#include <functional>
+
 #include "esp_cxx/cpointer.h"
 #include "esp_cxx/cxx17hack.h"
 #include "esp_cxx/nvs_handle.h"
@@ -13,6 +15,11 @@ class ConfigStore {
   std::optional<std::string> GetValue(std::string_view prefix, std::string_view key);
   unique_cJSON_ptr GetAllValues();
 
+  // Calls |on_value| with each stored "prefix:key" and its value without
+  // collecting them all first.
+  void ForEachValue(
+      const std::function<void(const char* full_key, std::string_view value)>& on_value);
+
  private:
   static const char kNvsNamespace[];
   NvsHandle nvs_handle_{kNvsNamespace, NvsHandle::Mode::kReadWrite};
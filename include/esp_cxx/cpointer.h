@@ -29,6 +29,16 @@ using unique_cJSON_ptr=std::unique_ptr<cJSON, cJSON_deleter>;
 static_assert(sizeof(cJSON *)==
               sizeof(unique_cJSON_ptr),""); // ensure no overhead
 
+// For strings from cJSON_Print*(). These come from cJSON's allocator which
+// may be an Arena (see arena.h) rather than malloc().
+struct cJSON_free_deleter{
+  void operator()(char *str) const {
+    cJSON_free(str);
+  }
+};
+
+using unique_cJSON_str=std::unique_ptr<char, cJSON_free_deleter>;
+
 }  // namespace esp_cxx
 
 #endif  // ESPCXX_CPOINTER_H_
@@ -0,0 +1,35 @@
+#ifndef ESPCXX_DEFLATE_H_
+#define ESPCXX_DEFLATE_H_
+
+#include <cstddef>
+#include <string>
+
+#include "esp_cxx/cxx17hack.h"
+
+namespace esp_cxx {
+
+// Raw DEFLATE (RFC 1951) streams, without zlib or gzip framing, sized for
+// whole messages that are already in memory such as websocket payloads.
+// Neither direction keeps state between calls so there is no sliding
+// window to hold per connection; back references only reach into the same
+// message.
+
+// Largest window DEFLATE allows.
+constexpr int kMaxDeflateWindowBits = 15;
+
+// Appends |input| compressed to |out|. Matches reach back at most
+// 1 << |window_bits| bytes (8 to 15). The stream uses the fixed Huffman
+// codes, which keeps the encoder small and cheap at some cost in ratio,
+// and ends with a sync flush (an empty stored block, 00 00 ff ff) rather
+// than a final block.
+void Deflate(std::string_view input, int window_bits, std::string* out);
+
+// Appends the decompression of |input| to |out|. |input| may end with a
+// final block or at the end of any block, as after a sync flush. Returns
+// false if |input| is malformed or truncated, or would decompress to more
+// than |max_output| bytes; |out| then holds a partial result.
+bool Inflate(std::string_view input, size_t max_output, std::string* out);
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_DEFLATE_H_
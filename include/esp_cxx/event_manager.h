@@ -22,17 +22,20 @@ class EventManager {
   using Duration = std::chrono::steady_clock::duration;
   using TimePoint = std::chrono::steady_clock::time_point;
 
-  // Will run |closure| as soon as possible.
-  void Run(std::function<void(void)> closure);
+  // Will run |closure| as soon as possible. Returns false if the closure
+  // was dropped because too many closures are already scheduled.
+  bool Run(std::function<void(void)> closure);
 
-  // Will run |closure| at least milliseconds after this is called.
-  void RunDelayed(std::function<void(void)> closure, int milliseconds);
+  // Will run |closure| at least milliseconds after this is called. Returns
+  // false if the closure was dropped, as with Run().
+  bool RunDelayed(std::function<void(void)> closure, int milliseconds);
 
   // Will run |closure| on or after |run_after|.  If |run_after| is in the past,
   // closure will execute as soon as the event loop is free. It is possible
   // to starve a task if callers keeps passing |run_after| at earlier time
-  // points. Don't do that.
-  void RunAfter(std::function<void(void)> closure, TimePoint run_after);
+  // points. Don't do that. Returns false, without running |closure| ever,
+  // if there is no room left to schedule it.
+  bool RunAfter(std::function<void(void)> closure, TimePoint run_after);
 
   // Continually polls for next I/O event or task.
   void Loop();
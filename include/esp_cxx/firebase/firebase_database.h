@@ -2,6 +2,7 @@
 #define ESPCXX_FIREBASE_FIREBASE_DATABASE_H_
 
 #include <functional>
+#include <set>
 #include <string>
 
 #include "esp_cxx/backoff.h"
@@ -29,6 +30,13 @@ class FirebaseDatabase {
                    const std::string& device_id,
                    const std::string& password);
 
+  // Offers permessage-deflate when connecting. Takes effect on the next
+  // Connect().
+  void set_websocket_deflate(bool enabled) {
+    websocket_deflate_ = enabled;
+    websocket_.set_deflate(enabled);
+  }
+
   // Connects to the DB and processes updates.
   void Connect();
 
@@ -41,12 +49,18 @@ class FirebaseDatabase {
   // Calls |on_auth| when an authentication attempt returns.
   void SetAuthHandler(std::function<void(bool, cJSON*)> on_auth);
 
-  // Sends an update the firebase database.
+  // Sends an update the firebase database. An update that cannot be sent,
+  // because the database is disconnected or the link is backed up, marks
+  // |path| dirty. Dirty paths are sent again, with their latest values,
+  // once the connection is authenticated or has drained.
   void Publish(const std::string& path, unique_cJSON_ptr new_value);
 
   // Retrieves a fragment of the JSON tree.
   cJSON* Get(const std::string& path);
 
+  // Smoothed websocket ping round trip, or -1 if not yet measured.
+  int rtt_ms() const { return websocket_.smoothed_rtt_ms(); }
+
  private:
   FRIEND_TEST(Firebase, PathUpdate);
   FRIEND_TEST(Firebase, MergeUpdate);
@@ -94,7 +108,15 @@ class FirebaseDatabase {
   bool RemoveEmptyNodes(cJSON* node);
 
   // Sends |text| over the |websocket_| if connected.
-  bool Send(std::string_view text, bool should_log = true);
+  bool Send(std::string_view text, bool should_log = true,
+            WebsocketChannel::SentCallback on_sent = {});
+
+  // Sends a put of |value| at |path|, marking |path| dirty if it does not
+  // get out. A null |value| deletes |path|.
+  void SendPut(const std::string& path, cJSON* value);
+
+  // Resends the current values of all dirty paths.
+  void SendDirtyPaths();
 
   // Send Keepalive if connected. |generation| is use to break the resend
   // loop if disconnected.
@@ -131,6 +153,7 @@ class FirebaseDatabase {
   // Network objects.
   MongooseEventManager* event_manager_ = nullptr;
   WebsocketChannel websocket_;
+  bool websocket_deflate_ = false;
 
   // Firebase protocol state information.
   int connect_state_ = 0;
@@ -141,8 +164,9 @@ class FirebaseDatabase {
   std::string session_id_;
   size_t request_num_ = 0;
   unique_cJSON_ptr update_template_;
+  std::set<std::string> dirty_paths_;
   std::string firebase_id_token_url_;
-  BackoffCalculator<500> backoff_;
+  DecorrelatedJitterBackoff<500> backoff_;
 
   // actual data.
   unique_cJSON_ptr root_;
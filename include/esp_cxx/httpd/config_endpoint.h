@@ -9,6 +9,8 @@ namespace esp_cxx {
 
 class ConfigEndpoint : public HttpServer::Endpoint {
  public:
+  ConfigEndpoint();
+
   void OnHttp(HttpRequest request, HttpResponse response) override;
 
  private:
@@ -1,7 +1,10 @@
 #ifndef ESPCXX_HTTPD_CONNECTION_H_
 #define ESPCXX_HTTPD_CONNECTION_H_
 
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
 
 #include "esp_cxx/cxx17hack.h"
@@ -12,8 +15,30 @@ namespace esp_cxx {
 
 class MongooseEventManager;
 
+// A UDP socket with datagram semantics in both directions.
+//
+// Each received datagram is handed to |on_packet| on its own. When mongoose
+// reports one, the rest already waiting on the socket are read in the same
+// pass (recvmmsg() on host builds) into buffers owned by the Connection, so
+// receiving allocates nothing and |on_packet| sees the bytes where they
+// landed. The view is only valid for the duration of the call.
+//
+// Send() queues datagrams and sends them together: with sendmmsg() on host
+// builds and back to back from one place on LWIP, which has no sendmmsg().
+// Queued datagrams go out when the batch fills, at the end of the event
+// callback that queued them, on the next poll, or on Flush().
 class Connection {
  public:
+  // Largest datagram received without truncation: an Ethernet MTU less the
+  // IP and UDP headers. Truncated datagrams are dropped.
+  static constexpr size_t kMaxDatagramSize = 1472;
+
+  // Datagrams read from the socket per receive event.
+  static constexpr size_t kRecvBatchSize = 8;
+
+  // Datagrams queued for one send.
+  static constexpr size_t kSendBatchSize = 16;
+
   Connection() = default;
   explicit Connection(MongooseEventManager *event_manager,
                      std::function<void(std::string_view)> on_packet);
@@ -24,8 +49,17 @@ class Connection {
   //   udp://1234  # port 1234 of localhost
   //   udp://123.4.5.1:1234  # port 1234 of 123.4.5.1
   bool Connect(const std::string& udp_url);
+
+  // Queues |data| as one datagram. Must be called on the event loop task.
   void Send(std::string_view data);
 
+  // Sends the queued datagrams now. Call after a burst of Send()s made
+  // outside of this connection's callbacks to avoid waiting for the poll.
+  void Flush();
+
+  // Datagrams lost to truncation, a full send queue or a full socket.
+  uint32_t dropped_datagrams() const { return dropped_datagrams_; }
+
  private:
   static void OnEventThunk(struct mg_connection *nc,
                            int event,
@@ -34,16 +68,32 @@ class Connection {
 
   void OnEvent(struct mg_connection *nc, int event, void *event_data);
 
+  // Hands the datagram mongoose read to |on_packet_|, then reads and hands
+  // over any others already queued on the socket.
+  void OnRecv(struct mg_connection *nc, int size);
+  void ReadMore(struct mg_connection *nc);
+
   mg_connection* connection_ = nullptr;
+  bool connected_ = false;
 
   // Event manager used to initiate connections.
   MongooseEventManager* event_manager_ = nullptr;
 
   // Callback that is executed when data is received.
   std::function<void(std::string_view)> on_packet_;
+
+  // Receive buffers, kMaxDatagramSize each. Allocated on first use; LWIP
+  // builds read one datagram at a time and need only one.
+  std::unique_ptr<char[]> recv_pool_;
+
+  // Queued datagrams, back to back. Keeps its capacity between sends.
+  std::string send_buffer_;
+  std::array<size_t, kSendBatchSize> send_sizes_;
+  size_t send_count_ = 0;
+
+  uint32_t dropped_datagrams_ = 0;
 };
 
 }  // namespace esp_cxx
 
 #endif  // ESPCXX_HTTPD_CONNECTION_H_
-
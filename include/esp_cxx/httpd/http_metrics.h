@@ -0,0 +1,97 @@
+#ifndef ESPCXX_HTTPD_HTTP_METRICS_H_
+#define ESPCXX_HTTPD_HTTP_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#include "esp_cxx/cxx17hack.h"
+
+namespace esp_cxx {
+
+class JsonWriter;
+
+// Per-route request counters and latency histograms for an HttpServer.
+//
+// The table has a fixed number of slots assigned at registration time so
+// nothing is allocated per request. Slot 0 collects requests that matched
+// no route (404s, 405s) and routes registered after the table filled up.
+// All counters are relaxed atomics so they may be read from any task
+// while the event pump updates them.
+//
+// Latencies are tracked in three phases:
+//   kParse   - first byte of the request received until it is routed.
+//   kHandler - time spent in the endpoint's OnHttp() (or callback).
+//   kFlush   - handler return until the response left the send buffer.
+class HttpMetrics {
+ public:
+  enum Phase {
+    kParse,
+    kHandler,
+    kFlush,
+    kNumPhases,
+  };
+
+  static constexpr int kMaxRoutes = 16;
+  static constexpr size_t kMaxRouteName = 24;
+
+  // Bucket i counts samples <= (kFirstBucketUs << i). One more bucket
+  // catches everything slower. 125us up to ~1s.
+  static constexpr int kNumBuckets = 14;
+  static constexpr uint32_t kFirstBucketUs = 125;
+
+  HttpMetrics();
+
+  // Returns the slot for |pattern|, reusing an existing one for the same
+  // pattern. Returns 0 if the table is full.
+  int AddRoute(std::string_view pattern);
+
+  // Counts a finished request on |route| with the given response status.
+  void RecordRequest(int route, int status, uint32_t bytes_in);
+  void RecordBytesOut(int route, uint32_t bytes);
+  void RecordLatency(int route, Phase phase, uint32_t latency_us);
+
+  // Writes an array with one object per used slot.
+  void WriteJson(JsonWriter* json) const;
+
+  // Writes Prometheus text exposition format (version 0.0.4) to |sink|.
+  void WritePrometheus(const std::function<void(std::string_view)>& sink) const;
+
+  // Monotonic clock for latency measurement.
+  static int64_t NowUs();
+
+ private:
+  using Counter = std::atomic<uint32_t>;
+
+  // Sums are in microseconds and wrap after ~71 minutes of total latency.
+  // Prometheus treats the wrap as a counter reset.
+  struct Histogram {
+    std::array<Counter, kNumBuckets + 1> buckets;
+    Counter sum_us;
+  };
+
+  struct Route {
+    char name[kMaxRouteName];
+    Counter requests;
+    std::array<Counter, 5> status_classes;  // 1xx through 5xx.
+    Counter bytes_in;
+    Counter bytes_out;
+    std::array<Histogram, kNumPhases> latency;
+  };
+
+  static uint32_t Load(const Counter& counter) {
+    return counter.load(std::memory_order_relaxed);
+  }
+
+  static void Add(Counter* counter, uint32_t value) {
+    counter->fetch_add(value, std::memory_order_relaxed);
+  }
+
+  int num_routes_ = 1;
+  std::array<Route, kMaxRoutes> routes_;
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_HTTPD_HTTP_METRICS_H_
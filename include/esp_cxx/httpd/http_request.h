@@ -1,7 +1,11 @@
 #ifndef ESPCXX_HTTPD_HTTP_REQUEST_H_
 #define ESPCXX_HTTPD_HTTP_REQUEST_H_
 
+#include <array>
+#include <cstdint>
+
 #include "esp_cxx/cxx17hack.h"
+#include "esp_cxx/httpd/query_params.h"
 #include "esp_cxx/httpd/util.h"
 
 #include "mongoose.h"
@@ -20,9 +24,31 @@ enum class HttpMethod {
   kTrace,
 };
 
+// Headers that esp_cxx itself looks at, and a few common ones handlers
+// want. These can be looked up without a scan. See HttpRequest::GetHeader().
+enum class HttpHeader : uint8_t {
+  kAcceptEncoding,
+  kAuthorization,
+  kConnection,
+  kContentLength,
+  kContentType,
+  kHost,
+  kIfNoneMatch,
+  kOrigin,
+  kSecWebsocketExtensions,
+  kSecWebsocketKey,
+  kTransferEncoding,
+  kUpgrade,
+  kNumHeaders,
+};
+
+// Returns the HttpHeader |name| is (case-insensitive), or kNumHeaders if it
+// is not one of them.
+HttpHeader ClassifyHttpHeader(std::string_view name);
+
 class HttpRequest {
  public:
-  HttpRequest() = default;
+  HttpRequest() { header_index_.fill(kNotPresent); }
   explicit HttpRequest(http_message* raw_message);
 
   std::string_view body() const { return ToStringView(raw_message_->body); }
@@ -32,14 +58,44 @@ class HttpRequest {
   std::string_view query_string() const { return ToStringView(raw_message_->query_string); }
   int status() const { return raw_message_->resp_code; }
 
+  // Parameters from the query string, or from an
+  // application/x-www-form-urlencoded body. Neither copies anything.
+  QueryParams query_params() const { return QueryParams(query_string()); }
+  QueryParams form_params() const { return QueryParams(body()); }
+
   std::string_view header_name(int n) const;
   std::string_view header_value(int n) const;
 
+  // Returns the value of the first header called |name| (case-insensitive)
+  // or an empty string_view if there is none.
+  std::string_view GetHeader(const char* name) const;
+
+  // Like above for a well-known header. All headers are indexed in one pass
+  // on construction, so this is a table lookup. Copies share the index;
+  // HttpServer builds one HttpRequest per request and hands that to the
+  // endpoint.
+  std::string_view GetHeader(HttpHeader header) const;
+
   const http_message* raw_message() const { return raw_message_; }
 
  private:
+  friend class HttpServer;
+
+  static constexpr uint8_t kNotPresent = 0xff;
+
+  void IndexHeaders();
+
+  // Points at |raw_message|, which must be a reparse of the same request.
+  // Mongoose hands each event its own http_message, but the headers stay
+  // at the same positions, so the index is kept.
+  void Rebind(http_message* raw_message) { raw_message_ = raw_message; }
+
   HttpMethod method_ = HttpMethod::kUnknown;
   http_message *raw_message_ = nullptr;
+
+  // Position in |raw_message_|'s header arrays of each HttpHeader, or
+  // kNotPresent.
+  std::array<uint8_t, static_cast<size_t>(HttpHeader::kNumHeaders)> header_index_;
 };
 
 }  // namespace esp_cxx
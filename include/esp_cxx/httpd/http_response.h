@@ -1,6 +1,8 @@
 #ifndef ESPCXX_HTTPD_HTTP_RESPONSE_H_
 #define ESPCXX_HTTPD_HTTP_RESPONSE_H_
 
+#include <functional>
+
 #include "esp_cxx/cxx17hack.h"
 
 struct mg_connection;
@@ -18,6 +20,22 @@ class HttpResponse {
   static constexpr char kContentTypeJson[] = "Content-Type: application/json";
   static constexpr char kContentTypeJs[] = "Content-Type: application/javascript";
 
+  // Bytes allowed to queue in the connection's send buffer before a
+  // streaming body is paused. About two TCP segments keeps the socket busy
+  // without a large buffer.
+  static constexpr size_t kSendHighWater = 2048;
+
+  // See OnWritable(). Writes more of the body with SendMore() and returns
+  // true if there is more to come, or false once the body is complete.
+  using WritableCallback = std::function<bool(HttpResponse response)>;
+
+  // See SendFrom(). Writes up to |size| bytes into |buffer| and returns
+  // how many, 0 if nothing is ready yet, or kEndOfBody. Any other negative
+  // value is an error; the connection is closed so the client sees a
+  // truncated body rather than a complete one.
+  using BodyReader = std::function<int(char* buffer, size_t size)>;
+  static constexpr int kEndOfBody = -1;
+
   // Returns true if Send() or SendError() has been called.
   bool HasSentHeaders();
 
@@ -29,7 +47,39 @@ class HttpResponse {
             const char* extra_headers, std::string_view body);
 
   // Sends more bytes back down the channel. Should be called after Send().
-  void SendMore(std::string_view data);
+  // |data| is always queued. Returns false if the send buffer is now over
+  // kSendHighWater, in which case large bodies should stop and continue
+  // from OnWritable() instead.
+  bool SendMore(std::string_view data);
+
+  // True if the send buffer is under kSendHighWater.
+  bool IsWritable();
+
+  // Streams the rest of the body under flow control. |on_writable| is
+  // called right away and then each time the send buffer drains below
+  // kSendHighWater, until it returns false. A producer with nothing ready
+  // may return true without sending and is polled again on the next event
+  // loop iteration. The request is only finished once it is done, so a
+  // response of any size needs at most kSendHighWater of buffer. Must be
+  // the last thing sent for the response. On connections not owned by an
+  // HttpServer the whole body is produced immediately, and a producer with
+  // nothing ready ends it by closing the connection.
+  void OnWritable(WritableCallback on_writable);
+
+  // Pull-based form of OnWritable(): |reader| is asked for a bufferful at a
+  // time until it returns kEndOfBody.
+  void SendFrom(BodyReader reader);
+
+  // Like SendMore() but |data| is not copied into the socket buffer all at
+  // once. It is copied in under flow control as with OnWritable() so a
+  // large asset never needs a matching heap allocation. |data| must stay
+  // valid until the connection is done with it, so this is meant for
+  // rodata. Must be the last data sent for the response.
+  void SendStatic(std::string_view data);
+
+  // Ends a chunked response. Otherwise does nothing. Called by HttpServer
+  // once the endpoint returns so endpoints need not call it.
+  void Finish();
 
   // Sends an HTTP error code back. This and Send() are mutually exclusive.
   // If |text| is nullptr, then a default error message for the status code
@@ -1,11 +1,17 @@
 #ifndef ESPCXX_HTTPD_HTTP_SERVER_H_
 #define ESPCXX_HTTPD_HTTP_SERVER_H_
 
+#include <memory>
+#include <vector>
+
 #include "mongoose.h"
 
+#include "esp_cxx/arena.h"
+#include "esp_cxx/httpd/http_metrics.h"
 #include "esp_cxx/httpd/http_request.h"
 #include "esp_cxx/httpd/http_response.h"
 #include "esp_cxx/httpd/http_multipart.h"
+#include "esp_cxx/httpd/route_table.h"
 #include "esp_cxx/httpd/websocket.h"
 #include "esp_cxx/task.h"
 
@@ -23,10 +29,19 @@ class HttpServer {
    public:
     virtual ~Endpoint() = default;
 
-    // A plain HTTP request has arrived.
+    // A plain HTTP request has arrived. If the body was streamed to
+    // OnHttpChunk(), request.body() only holds what was not consumed.
     virtual void OnHttp(HttpRequest request, HttpResponse response) {}
 
-    // TODO(awong): Support chunked http.
+    // A piece of a chunked ("Transfer-Encoding: chunked") request body has
+    // arrived, before OnHttp() is called for the whole request. Return true
+    // if |chunk| was consumed, in which case it is discarded instead of
+    // buffered. Lets endpoints take bodies larger than RAM. |response|
+    // may be used to fail early, after which no more chunks arrive.
+    virtual bool OnHttpChunk(HttpRequest request, std::string_view chunk,
+                             HttpResponse response) {
+      return false;
+    }
 
     // Multipart lifecycle events.
     // OnMultipartStart - client has requested a multipart upload.
@@ -43,39 +58,232 @@ class HttpServer {
     //                    OnWebsocketHandshakeComplete() and OnWebsocketClosed().
     // OnWebsocketClosed - websocket connection closed. Always called once
     //                     after OnWebsocketHandshake().
+    // OnWebsocketWritable - bytes queued on the websocket have been written
+    //                       to the socket, making room for more.
     virtual void OnWebsocketHandshake(HttpRequest request, HttpResponse response) {}
     virtual void OnWebsocketHandshakeComplete(WebsocketSender sender) {}
     virtual void OnWebsocketFrame(WebsocketFrame frame, WebsocketSender sender) {}
     virtual void OnWebsocketClosed(WebsocketSender sender) {}
+    virtual void OnWebsocketWritable(WebsocketSender sender) {}
+
+    // Dispatches |event| to |user_data|'s handlers. |request| is the
+    // current request, for events that carry one.
+    static void OnHttpEventThunk(mg_connection *nc, int event, void *ev_data,
+                                 const HttpRequest& request, void *user_data);
+
+    // Caps how many connections may be using this endpoint at once. A
+    // connection uses the endpoint from the start of its request until the
+    // response is done, or until close for websockets. Requests beyond the
+    // cap get a 503 without reaching the endpoint. 0 means no cap.
+    void set_max_connections(int max_connections) {
+      max_connections_ = max_connections;
+    }
+
+    // Requests with a body larger than |max_body_size| bytes get a 413.
+    // Checked against Content-Length as soon as the headers arrive, and
+    // against the running total for chunked bodies. 0 means no limit
+    // beyond mongoose's own MG_MAX_HTTP_REQUEST_SIZE buffering limit.
+    void set_max_body_size(size_t max_body_size) {
+      max_body_size_ = max_body_size;
+    }
+
+    // Runs this endpoint's handlers with the connection's Arena current
+    // (see Arena::Current()) so cJSON and ArenaAllocator allocations made
+    // while handling a request come out of it instead of the shared heap.
+    // The arena is reset after each request and freed when the connection
+    // closes, so nothing allocated from it may outlive the request.
+    // Websocket events do not use it.
+    void set_use_arena(bool use_arena) { use_arena_ = use_arena; }
+
+    // Accepts permessage-deflate from websocket clients of this endpoint
+    // that offer it. WebsocketSender::SendFrame() then compresses, and
+    // compressed frames are inflated before OnWebsocketFrame().
+    void set_websocket_deflate(bool enabled) { websocket_deflate_ = enabled; }
 
-    static void OnHttpEventThunk(mg_connection *nc, int event,
-                                 void *ev_data, void *user_data);
+   private:
+    friend class HttpServer;
+
+    bool use_arena_ = false;
+    bool websocket_deflate_ = false;
+    size_t max_body_size_ = 0;
+    int max_connections_ = 0;
+    int num_connections_ = 0;  // Only touched on the event pump task.
   };
 
+  // Admission control. At most |max_connections| are accepted in total and
+  // |max_per_ip| from any one client address. Connections over a limit get
+  // a canned 503 as soon as they are accepted and are never parsed. Call
+  // before Listen().
+  void SetConnectionLimits(int max_connections, int max_per_ip);
+
+  // Connections are kept open between requests from HTTP/1.1 clients that
+  // do not ask for "Connection: close". A connection is closed once it has
+  // been idle for |idle_timeout_s| or after |max_requests| requests.
+  // Responses are sent in order so pipelined requests are also handled.
+  // Call before Listen().
+  void SetKeepAlive(int idle_timeout_s, int max_requests);
+
   // Binds the port and starts listening.
   void Listen(const char* port);
 
   // Enables WebSocket events.
   void EnableWebsockets();
 
-  // Adds an Endpoint handler for the given path_pattern.
-  void RegisterEndpoint(const char* path_pattern, Endpoint* endpoint);
+  // Adds an Endpoint handler for the given path_pattern. See RouteTable for
+  // the pattern syntax. Requests for the path with a method outside of
+  // |methods| get a 405.
+  void RegisterEndpoint(const char* path_pattern, Endpoint* endpoint,
+                        HttpMethodMask methods = kAnyHttpMethod);
 
-  // Conveience wrapper for adding simple http endpoint handler using a bare function.
+  // Adds a plain http handler function. Only receives OnHttp() style
+  // requests; multipart and websocket requests to its path are rejected.
   typedef void (*HttpCallback)(HttpRequest request, HttpResponse response);
+  void RegisterEndpoint(const char* path_pattern, HttpCallback handler,
+                        HttpMethodMask methods = kAnyHttpMethod);
+
   template <HttpCallback handler>
-  void RegisterEndpoint(const char* path_pattern) {
-    static struct : Endpoint {
-      void OnHttp(HttpRequest request, HttpResponse response) {
-        // TODO(awong): rename handler to be consistent with multipart_cb here and elsewhere.
-        return handler(request, response);
-      }
-    } endpoint;
-    // TODO(awong): Creating a whole Endpoint for just 1 function is heavyweight. Thin it down.
-    RegisterEndpoint(path_pattern, &endpoint);
+  void RegisterEndpoint(const char* path_pattern,
+                        HttpMethodMask methods = kAnyHttpMethod) {
+    RegisterEndpoint(path_pattern, handler, methods);
   }
 
+  // Backs HttpResponse::OnWritable(). Takes |on_writable| and runs it
+  // whenever |nc|'s send buffer has room. Returns false, leaving
+  // |on_writable| alone, if |nc| is not an HttpServer connection or
+  // already has a streaming body.
+  static bool SetWritableCallback(mg_connection* nc,
+                                  HttpResponse::WritableCallback* on_writable);
+
+  // Called by HttpResponse as status lines are sent so the request can be
+  // counted under the right status class.
+  static void NoteResponseStatus(mg_connection* nc, int status);
+
+  // Per-route request counts and latencies. Slots are assigned as
+  // endpoints are registered.
+  const HttpMetrics* metrics() const { return &metrics_; }
+
+  MongooseEventManager* event_manager() { return event_manager_; }
+
  private:
+  struct RouteTarget {
+    Endpoint* endpoint = nullptr;
+    HttpCallback callback = nullptr;
+    int metrics_route = 0;  // Slot in |metrics_|.
+  };
+
+  // Stored in mg_connection::user_data of each accepted connection from
+  // MG_EV_ACCEPT to MG_EV_CLOSE. Remembers which route the connection's
+  // request was dispatched to for the events that follow it (multipart
+  // parts, websocket frames, close).
+  struct ConnectionState {
+    HttpServer* server;
+    RouteTarget target;
+    HttpRequest request;  // Current request. Headers indexed when routed.
+    int num_requests = 0;
+    bool keep_alive = false;  // For the current request.
+    bool rejected = false;  // Over a connection limit. Input is discarded.
+
+    // Set once the current request has been routed. Chunked requests are
+    // routed on their first chunk, before MG_EV_HTTP_REQUEST.
+    bool in_request = false;
+    bool headers_checked = false;  // Content-Length has been vetted.
+    size_t body_bytes = 0;  // Streamed so far.
+
+    // Producer of a flow controlled response body. The request is only
+    // finished once it is done.
+    HttpResponse::WritableCallback on_writable;
+
+    // Created on the first request to an endpoint with use_arena_ set.
+    std::unique_ptr<Arena> arena;
+    bool finish_deferred = false;
+
+    // Metrics for the current request.
+    int metrics_route = 0;
+    int status = 0;
+    uint32_t bytes_in = 0;
+    int64_t request_start_us = 0;  // First byte received.
+    bool response_recorded = false;
+
+    // The last response, until it leaves the send buffer. Set after
+    // |metrics_route| has moved on to the next request when pipelining.
+    int flush_route = -1;
+    int64_t flush_start_us = 0;
+
+    // permessage-deflate window bits once negotiated, otherwise 0.
+    int deflate_window_bits = 0;
+  };
+
+  struct IpCount {
+    uint32_t ip;
+    int count;
+  };
+
+  // Applies the connection limits to a newly accepted |nc|. Returns false
+  // if it was rejected.
+  bool AdmitConnection(mg_connection* nc);
+  void ReleaseConnection(mg_connection* nc);
+
+  // Points |state| at |target|, releasing its previous endpoint. Returns
+  // false if |target|'s endpoint is at its connection cap.
+  static bool SetTarget(ConnectionState* state, RouteTarget target);
+
+  // Routes an event carrying a new request. Returns false if the request
+  // was answered with an error instead.
+  bool RouteRequest(mg_connection* nc, ConnectionState* state,
+                    http_message* message);
+
+  // Rejects a request whose declared Content-Length is over its endpoint's
+  // limit as soon as its headers are buffered, before the body is.
+  void CheckRequestHeaders(mg_connection* nc, ConnectionState* state);
+
+  // Passes a chunk of a chunked request body to the endpoint.
+  void OnHttpChunk(mg_connection* nc, ConnectionState* state,
+                   http_message* message);
+
+  // Runs |state|'s body producer until the send buffer reaches the high
+  // water mark or the body is complete.
+  static void PumpResponseBody(mg_connection* nc, ConnectionState* state);
+
+  // Returns the arena calls into |state|'s endpoint should run with, or
+  // nullptr if it does not use one.
+  static Arena* ArenaFor(ConnectionState* state);
+
+  // Returns the body size limit for |target|, or 0 if there is none.
+  static size_t MaxBodySize(const RouteTarget& target);
+
+  static bool WantsKeepAlive(const HttpRequest& request);
+
+  // A WebsocketSender for |nc| that knows whether it negotiated
+  // permessage-deflate.
+  static WebsocketSender SenderFor(mg_connection* nc);
+
+  // Answers a websocket upgrade accepting permessage-deflate, if the
+  // endpoint allows it and the client offered it.
+  static void NegotiateWebsocketDeflate(mg_connection* nc, ConnectionState* state);
+
+  // Replaces a compressed frame with its inflated form in |storage|.
+  // Returns false, having failed the connection, if that is not possible.
+  static bool InflateFrame(mg_connection* nc, ConnectionState* state,
+                           websocket_message* message, std::string* storage);
+
+  // Completes the current request once its endpoint has responded, then
+  // either closes the connection or readies it for the next request.
+  void FinishRequest(mg_connection* nc, ConnectionState* state);
+
+  // Sends the 404 for unrouted requests.
+  void SendNotFound(mg_connection* nc);
+
+  // Answers the current request with a canned mongoose error page instead
+  // of routing it to an endpoint.
+  void RejectRequest(mg_connection* nc, ConnectionState* state, int status);
+
+  // Counts the current request's response in |metrics_| and starts timing
+  // how long it takes to flush. Only the first call per request counts.
+  void RecordResponse(mg_connection* nc, ConnectionState* state);
+
+  // Finishes flush timing once the last response has left the send buffer.
+  void CheckResponseFlushed(mg_connection* nc, ConnectionState* state);
+
   // Pumps events for the http server.
   void EventPumpRunLoop();
 
@@ -89,6 +297,22 @@ class HttpServer {
   // Document to return on a 404.
   std::string_view resp404_html_;
 
+  RouteTable<RouteTarget> routes_;
+  HttpMetrics metrics_;
+
+  int idle_timeout_s_ = 5;
+  int max_requests_per_connection_ = 100;
+
+  // LWIP defaults to 10 sockets for everything on the device. Leave some
+  // for the listener and outbound connections. A browser opens up to 6.
+  int max_connections_ = 8;
+  int max_connections_per_ip_ = 6;
+  int num_connections_ = 0;
+
+  // Open connections per client. Never has more than |num_connections_|
+  // entries so a linear scan is fine.
+  std::vector<IpCount> ip_counts_;
+
   // Event manager for all connections on this HTTP server.
   MongooseEventManager* event_manager_ = nullptr;
 
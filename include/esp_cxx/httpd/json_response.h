@@ -0,0 +1,36 @@
+#ifndef ESPCXX_HTTPD_JSON_RESPONSE_H_
+#define ESPCXX_HTTPD_JSON_RESPONSE_H_
+
+#include <string>
+
+#include "esp_cxx/httpd/http_request.h"
+#include "esp_cxx/httpd/http_response.h"
+#include "esp_cxx/json_writer.h"
+
+namespace esp_cxx {
+
+// JsonWriter that streams into |response| as a chunked application/json
+// body. Headers are sent on construction and each buffer flush becomes one
+// chunk in the connection's send buffer, so the document is never held in
+// memory as a whole. HttpServer ends the chunked body after the endpoint
+// returns.
+//
+// HTTP/1.0 clients cannot take a chunked body. For those the document is
+// buffered and sent with a Content-Length when the JsonResponse is
+// destroyed.
+class JsonResponse : public JsonWriter {
+ public:
+  JsonResponse(const HttpRequest& request, HttpResponse response,
+               int status_code = 200);
+  ~JsonResponse();
+
+ private:
+  HttpResponse response_;
+  int status_code_;
+  bool buffered_;
+  std::string body_;  // Only used when |buffered_|.
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_HTTPD_JSON_RESPONSE_H_
@@ -1,32 +1,90 @@
 #ifndef ESPCXX_HTTPD_LOG_STREAM_ENDPOINT_H_
 #define ESPCXX_HTTPD_LOG_STREAM_ENDPOINT_H_
 
-#include "esp_cxx/httpd/http_server.h"
-
 #include <atomic>
+#include <cstdint>
+
+#include "esp_cxx/event_manager.h"
+#include "esp_cxx/httpd/http_server.h"
+#include "esp_cxx/httpd/websocket_broadcaster.h"
+#include "esp_cxx/mutex.h"
 
 namespace esp_cxx {
 
+// Streams log lines to websocket readers on /api/logz. Lines are batched
+// into text frames of up to kMaxBatchBytes, each sent at most
+// kMaxBatchDelayMs after its first line, and compressed for readers that
+// negotiate permessage-deflate. A reader that cannot keep up is
+// handled per |policy|; with the drop policies it is sent a notice line
+// with the number of log lines it missed.
 class LogStreamEndpoint : public HttpServer::Endpoint {
  public:
-  virtual void OnWebsocketHandshake(HttpRequest request, HttpResponse response);
-  virtual void OnWebsocketHandshakeComplete(WebsocketSender sender);
-  virtual void OnWebsocketFrame(WebsocketFrame frame, WebsocketSender sender);
-  virtual void OnWebsocketClosed(WebsocketSender sender);
+  using OverflowPolicy = WebsocketBroadcaster::OverflowPolicy;
+
+  static constexpr size_t kMaxBatchBytes = 1024;
+  static constexpr int kMaxBatchDelayMs = 50;
+
+  explicit LogStreamEndpoint(OverflowPolicy policy = OverflowPolicy::kDropOldest);
+
+  void set_overflow_policy(OverflowPolicy policy) {
+    broadcaster_.set_overflow_policy(policy);
+  }
+
+  // Enables batching. The delayed flush of a partial batch runs on
+  // |event_manager|, which must be the one serving the websockets. Without
+  // it every line is sent as its own frame.
+  void set_event_manager(EventManager* event_manager) {
+    event_manager_ = event_manager;
+  }
+
+  // Lowers the batching bounds. A |max_bytes| of 0 disables batching.
+  void set_batching(size_t max_bytes, int max_delay_ms);
+
+  int num_listeners() const { return broadcaster_.num_subscribers(); }
+  WebsocketBroadcaster::Stats stats() const { return broadcaster_.stats(); }
+
+  void OnWebsocketHandshakeComplete(WebsocketSender sender) override;
+  void OnWebsocketFrame(WebsocketFrame frame, WebsocketSender sender) override;
+  void OnWebsocketClosed(WebsocketSender sender) override;
+  void OnWebsocketWritable(WebsocketSender sender) override;
 
+  // Callable from one task at a time, normally the log task behind
+  // SetLogFilter().
   void PublishLog(std::string_view log);
 
  private:
-  // Only set if there is some active websocket connection.
-  std::atomic<mg_mgr*> event_manager_{nullptr};
-
-  // Simple avoidance of DoS.
+  // Simple avoidance of DoS. Enforced by HttpServer.
   static constexpr int kMaxListeners = 5;
-  size_t num_listeners_ = 0;
+
+  static int64_t NowMs();
+
+  // Publishes the pending batch. Returns false, having done nothing, if
+  // another flush is running and |wait| is false.
+  bool FlushBatch(bool wait);
+
+  // Runs on the event pump |max_batch_delay_ms_| after a batch starts.
+  void OnBatchTimer();
+
+  WebsocketBroadcaster broadcaster_;
+  EventManager* event_manager_ = nullptr;
+  size_t max_batch_bytes_ = kMaxBatchBytes;
+  int max_batch_delay_ms_ = kMaxBatchDelayMs;
+
+  // Lines waiting to be sent. Guarded by |batch_lock_|, which is a
+  // critical section, so nothing may allocate or publish while holding it.
+  Mutex batch_lock_;
+  char batch_[kMaxBatchBytes];
+  size_t batch_len_ = 0;
+  int64_t batch_start_ms_ = 0;
+
+  // Held by whichever task is publishing a batch out of |flush_buffer_|.
+  // Serializing flushes keeps batches in order.
+  std::atomic<bool> flushing_{false};
+  char flush_buffer_[kMaxBatchBytes];
+
+  std::atomic<bool> timer_pending_{false};
 };
 
 }  // namespace esp_cxx
 
 #endif  // ESPCXX_HTTPD_LOG_STREAM_ENDPOINT_H_
-
-
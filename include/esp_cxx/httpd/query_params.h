@@ -0,0 +1,99 @@
+#ifndef ESPCXX_HTTPD_QUERY_PARAMS_H_
+#define ESPCXX_HTTPD_QUERY_PARAMS_H_
+
+#include <cstddef>
+#include <iterator>
+
+#include "esp_cxx/cxx17hack.h"
+
+namespace esp_cxx {
+
+// Zero-copy view over URL-encoded parameters, as found in a query string
+// ("a=1&b=x%20y") or an application/x-www-form-urlencoded body. Nothing is
+// copied or decoded up front. Iteration yields the raw, still encoded
+// pieces; Get() only decodes when the value actually contains an escape,
+// and then into a buffer the caller provides.
+//
+//   char buf[32];
+//   auto id = request.query_params().Get("id", buf);
+//   if (!id) { ... missing or longer than |buf| ... }
+class QueryParams {
+ public:
+  struct Param {
+    std::string_view key;  // Still encoded.
+    std::string_view value;  // Still encoded. Empty if there was no '='.
+  };
+
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Param;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Param*;
+    using reference = const Param&;
+
+    Iterator() = default;
+
+    const Param& operator*() const { return param_; }
+    const Param* operator->() const { return &param_; }
+    Iterator& operator++() {
+      Advance();
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator old = *this;
+      Advance();
+      return old;
+    }
+    bool operator==(const Iterator& other) const {
+      return rest_.data() == other.rest_.data() && done_ == other.done_;
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class QueryParams;
+    explicit Iterator(std::string_view encoded);
+
+    void Advance();
+
+    std::string_view rest_;  // Unparsed input after |param_|.
+    Param param_;
+    bool done_ = true;
+  };
+
+  QueryParams() = default;
+  explicit QueryParams(std::string_view encoded) : encoded_(encoded) {}
+
+  Iterator begin() const { return Iterator(encoded_); }
+  Iterator end() const { return Iterator(); }
+
+  // Returns the still encoded value of the first parameter whose decoded
+  // key is |key|.
+  std::optional<std::string_view> Find(std::string_view key) const;
+
+  // Returns the decoded value of the first parameter called |key|. Points
+  // into the original input if no decoding was needed, otherwise into
+  // |buffer|. Empty if the key is missing or the value does not fit.
+  std::optional<std::string_view> Get(std::string_view key,
+                                      char* buffer, size_t size) const;
+  template <size_t N>
+  std::optional<std::string_view> Get(std::string_view key, char (&buffer)[N]) const {
+    return Get(key, &buffer[0], N);
+  }
+
+  // Decodes '+' and %XX escapes in |encoded| into |buffer|. Returns the
+  // decoded string, or nothing if it does not fit. Malformed escapes are
+  // kept as is.
+  static std::optional<std::string_view> Decode(std::string_view encoded,
+                                                char* buffer, size_t size);
+
+  // True if |encoded| has anything Decode() would change.
+  static bool NeedsDecoding(std::string_view encoded);
+
+ private:
+  std::string_view encoded_;
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_HTTPD_QUERY_PARAMS_H_
@@ -0,0 +1,122 @@
+#ifndef ESPCXX_HTTPD_ROUTE_TABLE_H_
+#define ESPCXX_HTTPD_ROUTE_TABLE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "esp_cxx/cxx17hack.h"
+#include "esp_cxx/httpd/http_request.h"
+
+namespace esp_cxx {
+
+// Bitmask of HttpMethods that a route accepts.
+using HttpMethodMask = uint16_t;
+constexpr HttpMethodMask kAnyHttpMethod = 0xffff;
+constexpr HttpMethodMask ToMask(HttpMethod method) {
+  return 1 << static_cast<int>(method);
+}
+
+// Writes an Allow header value (eg, "GET, POST") for |methods| into |buf|.
+void FormatAllowedMethods(HttpMethodMask methods, char* buf, size_t size);
+
+// Maps request paths to a |Target|. Built once at registration time and
+// then only read, so lookups avoid mongoose's per-endpoint pattern matching.
+//
+// Patterns are literal paths. A pattern ending in "$" only matches that
+// exact path. Otherwise it matches any path it is a prefix of, and the
+// longest such prefix wins. This is the subset of mongoose's
+// mg_match_prefix() syntax that esp_cxx uses; wildcards are not supported.
+//
+// Exact paths are kept sorted for binary search. Prefixes are few in
+// practice and are scanned longest first.
+template <typename Target>
+class RouteTable {
+ public:
+  enum class Match {
+    kNone,
+    kFound,
+    kWrongMethod,  // The path matched but no route allowed the method.
+  };
+
+  struct Result {
+    Match match = Match::kNone;
+    Target target = {};
+    HttpMethodMask allowed = 0;  // Methods the matched path accepts.
+  };
+
+  void Add(std::string_view pattern, HttpMethodMask methods, Target target) {
+    bool is_exact = !pattern.empty() && pattern.back() == '$';
+    if (is_exact) {
+      pattern.remove_suffix(1);
+    }
+
+    Route route{std::string(pattern), methods, std::move(target)};
+    std::vector<Route>* routes = is_exact ? &exact_ : &prefixes_;
+    auto pos = std::upper_bound(routes->begin(), routes->end(), route,
+                                is_exact ? &PathLess : &LongerFirst);
+    routes->insert(pos, std::move(route));
+  }
+
+  Result Find(std::string_view path, HttpMethod method) const {
+    Result result;
+
+    auto exact = std::lower_bound(
+        exact_.begin(), exact_.end(), path,
+        [](const Route& route, std::string_view path) { return route.path < path; });
+    if (exact != exact_.end() && exact->path == path) {
+      return Select(exact, exact_.end(), method);
+    }
+
+    for (auto it = prefixes_.begin(); it != prefixes_.end(); ++it) {
+      if (path.compare(0, it->path.size(), it->path) == 0) {
+        return Select(it, prefixes_.end(), method);
+      }
+    }
+
+    return result;
+  }
+
+ private:
+  struct Route {
+    std::string path;
+    HttpMethodMask methods;
+    Target target;
+  };
+
+  static bool PathLess(const Route& a, const Route& b) {
+    return a.path < b.path;
+  }
+
+  static bool LongerFirst(const Route& a, const Route& b) {
+    if (a.path.size() != b.path.size()) {
+      return a.path.size() > b.path.size();
+    }
+    return a.path < b.path;
+  }
+
+  // Picks the route for |method| from the run of routes sharing |first|'s
+  // path. Routes with the same path are adjacent in both vectors.
+  template <typename Iterator>
+  static Result Select(Iterator first, Iterator last, HttpMethod method) {
+    Result result;
+    result.match = Match::kWrongMethod;
+    for (auto it = first; it != last && it->path == first->path; ++it) {
+      result.allowed |= it->methods;
+      if (it->methods & ToMask(method)) {
+        result.match = Match::kFound;
+        result.target = it->target;
+        break;
+      }
+    }
+    return result;
+  }
+
+  std::vector<Route> exact_;
+  std::vector<Route> prefixes_;
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_HTTPD_ROUTE_TABLE_H_
@@ -1,24 +1,31 @@
 #ifndef ESPCXX_HTTPD_STANDARD_ENDPOINTS_H_
 #define ESPCXX_HTTPD_STANDARD_ENDPOINTS_H_
 
+#include <memory>
+
 #include "esp_cxx/httpd/config_endpoint.h"
 #include "esp_cxx/httpd/ota_endpoint.h"
 #include "esp_cxx/httpd/log_stream_endpoint.h"
+#include "esp_cxx/httpd/static_asset.h"
 
 namespace esp_cxx {
+// Serves one blob of static |data| (eg, from objcopy-wrapper) with ETag
+// revalidation. The ETag is hashed once at construction.
 template <const char content_type[]>
 class StaticEndpoint : public HttpServer::Endpoint {
  public:
   explicit StaticEndpoint(std::string_view data)
-    : data_(data) {
+    : asset_{{}, content_type, data, {}, {}, data.size()},
+      etag_(ComputeEtag(data)) {
   }
 
   void OnHttp(HttpRequest request, HttpResponse response) override {
-    response.Send(200, data_.size(), content_type, data_.data());
+    ServeStaticAsset(asset_, etag_, request, response);
   }
 
  private:
-  std::string_view data_;
+  StaticAsset asset_;
+  std::string etag_;
 };
 
 using HtmlEndpoint = StaticEndpoint<HttpResponse::kContentTypeHtml>;
@@ -26,28 +33,68 @@ using JsonEndpoint = StaticEndpoint<HttpResponse::kContentTypeJson>;
 using JsEndpoint = StaticEndpoint<HttpResponse::kContentTypeJs>;
 using PlainEndpoint = StaticEndpoint<HttpResponse::kContentTypePlain>;
 
+// Device health as JSON: heap, uptime, logging counters and, once set, the
+// log stream's delivery counters and the per-route table from
+// HttpServer::metrics().
+class StatsEndpoint : public HttpServer::Endpoint {
+ public:
+  void set_metrics(const HttpMetrics* metrics) { metrics_ = metrics; }
+  void set_log_stream(const LogStreamEndpoint* log_stream) {
+    log_stream_ = log_stream;
+  }
+
+  void OnHttp(HttpRequest request, HttpResponse response) override;
+
+ private:
+  const HttpMetrics* metrics_ = nullptr;
+  const LogStreamEndpoint* log_stream_ = nullptr;
+};
+
+// Serves an HttpMetrics table in Prometheus text format.
+class MetricsEndpoint : public HttpServer::Endpoint {
+ public:
+  void set_metrics(const HttpMetrics* metrics) { metrics_ = metrics; }
+
+  void OnHttp(HttpRequest request, HttpResponse response) override;
+
+ private:
+  const HttpMetrics* metrics_ = nullptr;
+};
+
 class StandardEndpoints {
  public:
   explicit StandardEndpoints(std::string_view index_html)
     : index_endpoint_(index_html) {
   }
 
+  // Serves a multi-file web UI, such as kWebAssets from web_assets.h, under
+  // "/" instead of a single index page. |assets| must outlive this.
+  StandardEndpoints(const StaticAsset* assets, size_t num_assets)
+    : index_endpoint_({}),
+      asset_endpoint_(std::make_unique<StaticAssetEndpoint>(assets, num_assets)) {
+  }
+
   void RegisterEndpoints(HttpServer* server);
 
   ConfigEndpoint* config_endpoint() { return &config_endpoint_; }
   OtaEndpoint* ota_endpoint() { return &ota_endpoint_; }
   LogStreamEndpoint* log_stream_endpoint() { return &log_stream_endpoint_; }
   HtmlEndpoint* index_endpoint() { return &index_endpoint_; }
+  StatsEndpoint* stats_endpoint() { return &stats_endpoint_; }
+  MetricsEndpoint* metrics_endpoint() { return &metrics_endpoint_; }
 
   // Stateless endpoints.
-  static void StatsEndpoint(HttpRequest request, HttpResponse response);
   static void ResetEndpoint(HttpRequest request, HttpResponse response);
+  static void PreviousBootLogEndpoint(HttpRequest request, HttpResponse response);
 
  private:
   ConfigEndpoint config_endpoint_;
   OtaEndpoint ota_endpoint_;
   LogStreamEndpoint log_stream_endpoint_;
   HtmlEndpoint index_endpoint_;
+  StatsEndpoint stats_endpoint_;
+  MetricsEndpoint metrics_endpoint_;
+  std::unique_ptr<StaticAssetEndpoint> asset_endpoint_;
 };
 }  // namespace esp_cxx
 
@@ -0,0 +1,64 @@
+#ifndef ESPCXX_HTTPD_STATIC_ASSET_H_
+#define ESPCXX_HTTPD_STATIC_ASSET_H_
+
+#include <string>
+#include <vector>
+
+#include "esp_cxx/cxx17hack.h"
+#include "esp_cxx/httpd/http_server.h"
+
+namespace esp_cxx {
+
+// A file embedded in the firmware image. All data must be static (eg,
+// rodata) since it is streamed to the socket after the handler returns.
+// Being an aggregate of views, a table of these can be constexpr.
+struct StaticAsset {
+  std::string_view path;  // Request path. eg, "/index.html".
+  const char* content_type;  // A full header such as HttpResponse::kContentTypeHtml.
+  std::string_view data;  // Uncompressed bytes. May be empty if |gzip_data| is set.
+  std::string_view gzip_data;  // gzip encoded bytes. Optional.
+  std::string_view etag;  // Quoted entity tag. Computed from the bytes if empty.
+  size_t size;  // Uncompressed size in bytes, even if |data| is empty.
+};
+
+// Returns a quoted strong entity tag for |data|.
+std::string ComputeEtag(std::string_view data);
+
+// Responds to |request| with |asset|:
+//   * The gzip variant, if there is one and Accept-Encoding allows it. It
+//     is tagged |etag| with a "-gz" suffix so caches keep the two apart,
+//     and every response for an asset with a gzip variant has
+//     "Vary: Accept-Encoding".
+//   * 304 if If-None-Match matches the chosen variant's ETag.
+//   * 406 if there is only a gzip variant and the client does not take it.
+//   * Headers only for HEAD.
+// Bodies are sent with HttpResponse::SendStatic() so they are never copied
+// whole into the heap.
+void ServeStaticAsset(const StaticAsset& asset, std::string_view etag,
+                      HttpRequest request, HttpResponse response);
+
+// Serves a fixed set of assets by request path. "/" is served as
+// "/index.html". Register it under a path prefix that covers the assets.
+class StaticAssetEndpoint : public HttpServer::Endpoint {
+ public:
+  // |assets| must outlive the endpoint.
+  StaticAssetEndpoint(const StaticAsset* assets, size_t num_assets);
+
+  template <size_t kNumAssets>
+  explicit StaticAssetEndpoint(const StaticAsset (&assets)[kNumAssets])
+    : StaticAssetEndpoint(&assets[0], kNumAssets) {
+  }
+
+  void OnHttp(HttpRequest request, HttpResponse response) override;
+
+ private:
+  const StaticAsset* assets_;
+  size_t num_assets_;
+
+  // ETags of |assets_|, by index. Only filled for assets without one.
+  std::vector<std::string> computed_etags_;
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_HTTPD_STATIC_ASSET_H_
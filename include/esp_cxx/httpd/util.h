@@ -8,7 +8,7 @@
 namespace esp_cxx {
 
 constexpr decltype(((mg_connection*)0)->flags) kHeaderSentFlag = MG_F_USER_6;
-constexpr decltype(((mg_connection*)0)->flags) kLogStreamFlag = MG_F_USER_5;
+constexpr decltype(((mg_connection*)0)->flags) kChunkedFlag = MG_F_USER_4;
 
 static inline std::string_view ToStringView(mg_str s) { return {s.p, s.len}; }
 
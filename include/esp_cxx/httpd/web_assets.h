@@ -0,0 +1,16 @@
+#ifndef ESPCXX_HTTPD_WEB_ASSETS_H_
+#define ESPCXX_HTTPD_WEB_ASSETS_H_
+
+#include "esp_cxx/httpd/static_asset.h"
+
+namespace esp_cxx {
+
+// Web UI bundled at build time by script/bundle-web-assets from the
+// directory named by ESPCXX_WEB_ASSETS_DIR in the project Makefile. Lives
+// entirely in rodata. Only an empty entry if ESPCXX_WEB_ASSETS_DIR is unset.
+extern const StaticAsset* const kWebAssets;
+extern const size_t kNumWebAssets;
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_HTTPD_WEB_ASSETS_H_
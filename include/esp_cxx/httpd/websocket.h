@@ -1,9 +1,12 @@
 #ifndef ESPCXX_HTTPD_WEBSOCKET_H_
 #define ESPCXX_HTTPD_WEBSOCKET_H_
 
-#include <string>
+#include <deque>
 #include <functional>
+#include <initializer_list>
+#include <string>
 
+#include "esp_cxx/backoff.h"
 #include "esp_cxx/cxx17hack.h"
 #include "esp_cxx/httpd/util.h"
 #include "esp_cxx/task.h"
@@ -24,8 +27,63 @@ enum class WebsocketOpcode : uint8_t {
   kPong = 10,
 };
 
+// Most buffers a gathered send hands to mongoose as they are. Messages in
+// more pieces are joined first.
+constexpr size_t kMaxWebsocketFrameParts = 8;
+
+// Largest header EncodeWebsocketHeader() writes.
+constexpr size_t kMaxWebsocketHeaderSize = 10;
+
+// RSV1 in the first header byte. Marks a permessage-deflate message.
+constexpr uint8_t kWebsocketCompressedFlag = 0x40;
+
+// Writes the header of an unfragmented, unmasked (server to client) frame
+// carrying |payload_size| bytes into |out|. Returns the header length.
+// Unmasked frames are byte-for-byte the same for every recipient so they
+// can be encoded once and shared.
+size_t EncodeWebsocketHeader(WebsocketOpcode opcode, size_t payload_size,
+                             uint8_t* out, bool compressed = false);
+
+// permessage-deflate (RFC 7692). Only negotiated with no context takeover
+// in either direction, so each message is compressed on its own and no
+// connection keeps a 32 KB window. A negotiated connection is described by
+// its deflate window bits: the farthest back its compressed messages may
+// reach. 0 means the extension is off.
+//
+// The offer WebsocketChannel sends.
+constexpr char kWebsocketDeflateOffer[] =
+    "permessage-deflate; server_no_context_takeover; client_no_context_takeover";
+
+// Messages shorter than this are sent uncompressed.
+constexpr size_t kMinWebsocketDeflateSize = 64;
+
+// Larger compressed messages are refused rather than inflated.
+constexpr size_t kMaxInflatedWebsocketMessage = 16 * 1024;
+
+// Picks an acceptable permessage-deflate offer out of a client's
+// Sec-WebSocket-Extensions header. Returns the window bits the server may
+// compress with and writes the header value to respond with into
+// |response|, or returns 0 if nothing could be accepted.
+int AcceptWebsocketDeflateOffer(std::string_view extensions,
+                                char* response, size_t response_size);
+
+// Checks a server's Sec-WebSocket-Extensions response to
+// kWebsocketDeflateOffer. Returns false if the response is not one the
+// offer allows, in which case the connection must be failed. Otherwise
+// sets |accepted|.
+bool CheckWebsocketDeflateResponse(std::string_view extensions, bool* accepted);
+
+// Compresses |data| for a message with RSV1 set, appending to |out|.
+// Returns false, leaving |out| as it was, if that would not make it smaller.
+bool DeflateWebsocketMessage(std::string_view data, int window_bits,
+                             std::string* out);
+
+// Decompresses the payload of a message that had RSV1 set into |out|.
+bool InflateWebsocketMessage(std::string_view data, std::string* out);
+
 class WebsocketFrame {
  public:
+  // Frames arrive here already inflated if they were compressed.
   explicit WebsocketFrame(websocket_message* frame)
     : WebsocketFrame(
         {reinterpret_cast<char*>(frame->data), frame->size},
@@ -47,23 +105,58 @@ class WebsocketFrame {
 
 class WebsocketSender {
  public:
-  explicit WebsocketSender(mg_connection *connection)
-    : connection_(connection) {
+  explicit WebsocketSender(mg_connection *connection, int deflate_window_bits = 0)
+    : connection_(connection),
+      deflate_window_bits_(deflate_window_bits) {
   }
 
-  void SendFrame(WebsocketOpcode opcode, std::string_view data = {}) {
-    mg_send_websocket_frame(connection_, static_cast<int>(opcode), data.data(),
-                            data.size());
+  // Text and binary messages are compressed if the connection negotiated
+  // permessage-deflate and it is worth it.
+  void SendFrame(WebsocketOpcode opcode, std::string_view data = {});
+
+  // Sends one frame whose payload is |parts| in order. Each part is copied
+  // straight into the send buffer, so a header and payload held apart need
+  // not be joined by the caller.
+  void SendFrameV(WebsocketOpcode opcode, const std::string_view* parts,
+                  size_t num_parts);
+  void SendFrameV(WebsocketOpcode opcode, std::initializer_list<std::string_view> parts) {
+    SendFrameV(opcode, parts.begin(), parts.size());
   }
 
   mg_connection* connection() { return connection_; }
+  int deflate_window_bits() const { return deflate_window_bits_; }
 
  private:
   mg_connection* connection_;
+  int deflate_window_bits_;
 };
 
+// A client websocket connection.
+//
+// Outgoing messages go straight to the connection's send buffer while it
+// is open and the buffer is below kSendHighWater. Otherwise they wait in a
+// bounded queue, which is kept across Disconnect() and Connect() and is
+// flushed in order once the next connection completes its handshake.
+//
+// The connection is watched with the event loop's per-connection timer. It
+// is closed, and |on_disconnect_cb| run, if the handshake does not finish
+// in time or a ping goes unanswered past its deadline, so a half-open TCP
+// connection is noticed in seconds.
 class WebsocketChannel {
  public:
+  static constexpr size_t kSendHighWater = 2048;
+  static constexpr int kDefaultHandshakeTimeoutMs = 10000;
+  static constexpr int kDefaultPingIntervalMs = 15000;
+  static constexpr int kDefaultPongTimeoutMs = 5000;
+  static constexpr size_t kDefaultMaxQueuedMessages = 32;
+  static constexpr size_t kDefaultMaxQueuedBytes = 16 * 1024;
+
+  // What to do with a new message when the send queue is full.
+  enum class OverflowPolicy {
+    kDropOldest,  // Make room by dropping the oldest queued messages.
+    kDropNewest,  // Drop the new message.
+  };
+
   WebsocketChannel() = default;
   WebsocketChannel(MongooseEventManager* event_manager,
                    const std::string& ws_url,
@@ -71,6 +164,42 @@ class WebsocketChannel {
                    std::function<void(void)> on_disconnect_cb);
   ~WebsocketChannel();
 
+  // Offers permessage-deflate on the next Connect(). Off by default.
+  void set_deflate(bool enabled) { deflate_offered_ = enabled; }
+
+  // Fails a connection whose handshake takes longer than |timeout_ms|.
+  void set_handshake_timeout(int timeout_ms) { handshake_timeout_ms_ = timeout_ms; }
+
+  // Pings the server every |interval_ms| once open and fails the connection
+  // if no pong arrives within |pong_timeout_ms|. An |interval_ms| of 0 turns
+  // pings off. Takes effect on the next Connect().
+  void set_keepalive(int interval_ms, int pong_timeout_ms) {
+    ping_interval_ms_ = interval_ms;
+    pong_timeout_ms_ = pong_timeout_ms;
+  }
+
+  // Round trip time of the last ping, and a smoothed estimate weighing in
+  // each sample by 1/8 as TCP does. -1 until a pong has arrived.
+  int last_rtt_ms() const { return last_rtt_ms_; }
+  int smoothed_rtt_ms() const { return smoothed_rtt_ms_; }
+
+  // Bounds the send queue. A message larger than |max_bytes| is always
+  // dropped.
+  void set_send_queue_limits(size_t max_messages, size_t max_bytes,
+                             OverflowPolicy policy) {
+    max_queued_messages_ = max_messages;
+    max_queued_bytes_ = max_bytes;
+    overflow_policy_ = policy;
+  }
+
+  // Calls |on_high_water|(true) when the bytes waiting to go out, queued
+  // or in the send buffer, rise above |bytes|, then |on_high_water|(false)
+  // once they are back down to half of it.
+  void set_high_water(size_t bytes, std::function<void(bool above)> on_high_water) {
+    high_water_ = bytes;
+    on_high_water_ = std::move(on_high_water);
+  }
+
   // Starts the websocket connection. Frames delivered to the |on_frame_cb|.
   bool Connect();
 
@@ -78,11 +207,75 @@ class WebsocketChannel {
   // can be called again.
   void Disconnect();
 
-  // Sends a Websocket text message if connected. Silently drops if disconnected.
-  void SendText(std::string_view text);
+  // Run with true once all of a message's bytes have left the send buffer,
+  // or with false if the connection goes away first.
+  using SentCallback = std::function<void(bool sent)>;
+
+  // Sends a Websocket text message, or queues it if the channel is not open
+  // or is backed up. |on_sent| gets false if the queue overflow drops it.
+  void SendText(std::string_view text, SentCallback on_sent = {});
+
+  // Sends a binary message made of |parts| in order, like SendText(). When
+  // sent directly the parts are not joined into a temporary first.
+  void SendBinary(const std::string_view* parts, size_t num_parts,
+                  SentCallback on_sent = {});
+  void SendBinary(std::initializer_list<std::string_view> parts,
+                  SentCallback on_sent = {}) {
+    SendBinary(parts.begin(), parts.size(), std::move(on_sent));
+  }
+
+  // Drops all queued messages.
+  void ClearSendQueue();
+
+  size_t queued_messages() const { return send_queue_.size(); }
+  size_t queued_bytes() const { return send_queue_bytes_; }
+
+  // Messages dropped by the send queue.
+  uint32_t dropped_messages() const { return dropped_messages_; }
 
  private:
-  void OnWsEvent(mg_connection *new_connection, int event, websocket_message *ev_data);
+  struct QueuedMessage {
+    WebsocketOpcode opcode;
+    std::string data;
+    SentCallback on_sent;
+  };
+
+  struct PendingSend {
+    // Value of |bytes_sent_| once the message is out.
+    uint64_t end;
+    SentCallback on_sent;
+  };
+
+  void Send(WebsocketOpcode opcode, const std::string_view* parts,
+            size_t num_parts, SentCallback on_sent);
+
+  // Puts a message into the send buffer of the open connection.
+  void Write(WebsocketOpcode opcode, const std::string_view* parts,
+             size_t num_parts, SentCallback on_sent);
+
+  bool can_write() const {
+    return open_ && connection_->send_mbuf.len < kSendHighWater;
+  }
+
+  // Writes queued messages while can_write().
+  void FlushSendQueue();
+
+  // Runs |on_high_water_| if the waiting bytes crossed a mark.
+  void CheckHighWater();
+
+  // Runs the callbacks of messages fully written, or all of them with
+  // false when |connection_lost|.
+  void CompleteSends(bool connection_lost);
+
+  // Arms the connection's timer |delay_ms| from now.
+  void SetTimer(int delay_ms);
+
+  // Handles the timer: a missed handshake or pong deadline, or a ping due.
+  void OnTimer();
+  void OnPong(websocket_message* message);
+
+  void OnWsEvent(mg_connection *new_connection, int event, void *ev_data);
+  void OnHandshakeDone(http_message* response);
   static void OnWsEventThunk(mg_connection *new_connection, int event,
                              void *ev_data, void *user_data);
 
@@ -101,6 +294,46 @@ class WebsocketChannel {
   // Keeps track of the current connection. Allows for sending. If null, then
   // server should reconnect.
   mg_connection* connection_ = nullptr;
+
+  // Set once |connection_| has completed the handshake.
+  bool open_ = false;
+
+  bool deflate_offered_ = false;
+  int deflate_window_bits_ = 0;  // Negotiated on the current connection.
+
+  // Bytes written out on |connection_| since it was opened.
+  uint64_t bytes_sent_ = 0;
+
+  // SentCallbacks in send order.
+  std::deque<PendingSend> pending_sends_;
+
+  // Messages not yet handed to a connection.
+  std::deque<QueuedMessage> send_queue_;
+  size_t send_queue_bytes_ = 0;
+  size_t max_queued_messages_ = kDefaultMaxQueuedMessages;
+  size_t max_queued_bytes_ = kDefaultMaxQueuedBytes;
+  OverflowPolicy overflow_policy_ = OverflowPolicy::kDropOldest;
+  uint32_t dropped_messages_ = 0;
+
+  int handshake_timeout_ms_ = kDefaultHandshakeTimeoutMs;
+  int ping_interval_ms_ = kDefaultPingIntervalMs;
+  int pong_timeout_ms_ = kDefaultPongTimeoutMs;
+
+  // The outstanding ping, if |ping_sent_at_| is not 0. Pongs echo the
+  // sequence number so a stale one is not mistaken for the answer.
+  uint32_t ping_sequence_ = 0;
+  double ping_sent_at_ = 0;
+
+  int last_rtt_ms_ = -1;
+  int smoothed_rtt_ms_ = -1;
+
+  size_t high_water_ = 0;
+  std::function<void(bool above)> on_high_water_;
+  bool above_high_water_ = false;
+
+  // Client frames must be masked. The key only has to vary; masking keeps
+  // script-chosen bytes off the wire and this client runs no scripts.
+  XorShift32 mask_rng_;
 };
 
 }  // namespace esp_cxx
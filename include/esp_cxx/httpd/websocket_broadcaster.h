@@ -0,0 +1,183 @@
+#ifndef ESPCXX_HTTPD_WEBSOCKET_BROADCASTER_H_
+#define ESPCXX_HTTPD_WEBSOCKET_BROADCASTER_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "esp_cxx/httpd/websocket.h"
+#include "esp_cxx/mutex.h"
+#include "esp_cxx/task.h"
+
+namespace esp_cxx {
+
+// Fans websocket messages out to a set of server-side subscribers.
+//
+// Publish() encodes each message into a complete frame once. The frame is
+// shared by reference count between the per-subscriber queues and copied
+// into a subscriber's send buffer only when that buffer has drained below
+// kSendHighWater, so a published message costs one encode and one heap
+// block regardless of the number of subscribers, and a stalled subscriber
+// holds references rather than copies. If any subscriber negotiated
+// permessage-deflate, a compressed copy is also encoded once and shared by
+// those subscribers. What happens when a subscriber's
+// queue is full is set by its OverflowPolicy. A subscriber that lost
+// frames can be told how much it missed with a notice frame (see
+// set_gap_notice()).
+//
+// Publish() may be called from any task. Everything else must run on the
+// event pump task that owns the subscribers' connections, typically from
+// an HttpServer::Endpoint's websocket callbacks.
+class WebsocketBroadcaster {
+ public:
+  static constexpr size_t kQueueSize = 16;
+  static constexpr size_t kSendHighWater = 2048;
+
+  // What to do with a new frame for a subscriber whose queue is full.
+  enum class OverflowPolicy {
+    kDropOldest,  // Make room by dropping the oldest queued frame.
+    kDropNewest,  // Drop the new frame.
+    kDisconnect,  // Close the subscriber's connection.
+  };
+
+  struct Stats {
+    uint32_t published = 0;
+    uint32_t dropped = 0;  // Frame deliveries lost, summed over subscribers.
+    uint32_t disconnected = 0;  // Subscribers closed by kDisconnect.
+  };
+
+  // Writes the text of a notice telling a subscriber it missed |missed|
+  // into |buffer| and returns its length. |missed| is the summed weight
+  // of the lost frames (see Publish()), which is the frame count unless
+  // the publisher says otherwise.
+  using GapNotice = std::function<size_t(uint32_t missed, char* buffer, size_t size)>;
+
+  explicit WebsocketBroadcaster(OverflowPolicy policy = OverflowPolicy::kDropOldest);
+  ~WebsocketBroadcaster();
+
+  void set_overflow_policy(OverflowPolicy policy) { policy_ = policy; }
+
+  // Once set, a subscriber that lost frames gets a text frame from
+  // |gap_notice| ahead of the next frame it does receive.
+  void set_gap_notice(GapNotice gap_notice) { gap_notice_ = std::move(gap_notice); }
+
+  // Adds |sender|'s connection. Call from OnWebsocketHandshakeComplete().
+  void Subscribe(WebsocketSender sender);
+
+  // Removes |sender|'s connection, if subscribed. Call from
+  // OnWebsocketClosed().
+  void Unsubscribe(WebsocketSender sender);
+
+  // Call from OnWebsocketWritable() so queued frames keep flowing.
+  void OnWritable(WebsocketSender sender);
+
+  // Queues |data| as one frame for every current subscriber. Returns false
+  // if it was dropped because the hand-off to the event pump was full or
+  // there are no subscribers. On the event pump task the frame is handed
+  // to the subscribers directly; mg_broadcast() would deadlock there.
+  // |weight| is what losing the frame adds to a subscriber's gap notice,
+  // eg the number of lines in a frame that batches them.
+  bool Publish(WebsocketOpcode opcode, std::string_view data, uint32_t weight = 1);
+
+  int num_subscribers() const {
+    return num_subscribers_.load(std::memory_order_relaxed);
+  }
+
+  // Callable from any task.
+  Stats stats() const;
+
+ private:
+  // An encoded frame. Published frames are only touched on the event pump
+  // task so the count need not be atomic.
+  struct SharedFrame {
+    int refs;
+    size_t size;
+    // The compressed form of a plain frame, holding a reference, or null.
+    SharedFrame* deflated;
+    int window_bits;  // Of a compressed frame.
+    uint32_t weight;  // From Publish().
+    // Frame bytes follow.
+    const char* bytes() const { return reinterpret_cast<const char*>(this + 1); }
+    char* bytes() { return reinterpret_cast<char*>(this + 1); }
+  };
+
+  struct Subscriber {
+    mg_connection* connection;
+    int deflate_window_bits = 0;
+    std::array<SharedFrame*, kQueueSize> queue;
+    size_t head = 0;
+    size_t count = 0;
+    uint32_t missed = 0;  // Weight not yet reported with a gap notice.
+    bool closing = false;  // Disconnected for falling behind.
+  };
+
+  // Returns a frame with one reference, or null if out of memory.
+  static SharedFrame* NewFrame(WebsocketOpcode opcode, std::string_view payload,
+                               bool compressed, uint32_t weight);
+  static SharedFrame* Ref(SharedFrame* frame);
+  static void Unref(SharedFrame* frame);
+
+  // Recomputes |deflate_window_bits_| after the subscribers change.
+  void UpdateDeflateWindowBits();
+
+  Subscriber* Find(mg_connection* connection);
+
+  // Moves published frames into the subscriber queues.
+  void Drain();
+  void Enqueue(Subscriber* subscriber, SharedFrame* frame);
+  // Counts |frames| lost deliveries to |subscriber| of total |weight|.
+  void Drop(Subscriber* subscriber, uint32_t frames, uint32_t weight);
+  static void ClearQueue(Subscriber* subscriber);
+
+  // Copies whole frames into |subscriber|'s send buffer while it is under
+  // kSendHighWater. Frames are never split so that other frames (eg, pongs)
+  // sent on the connection cannot land in the middle of one.
+  void Pump(Subscriber* subscriber);
+
+  // mg_broadcast() handler. Runs on the event pump task once per
+  // connection in the manager; the first call does the work.
+  static void OnBroadcast(mg_connection* nc, int event, void* ev_data,
+                          void* user_data);
+
+  OverflowPolicy policy_;
+  GapNotice gap_notice_;
+
+  std::vector<Subscriber> subscribers_;
+
+  // Set from the first subscriber. Used to wake the event pump.
+  // |pump_task_| is written before |event_manager_| is published.
+  TaskRef pump_task_;
+  std::atomic<mg_mgr*> event_manager_{nullptr};
+  std::atomic<int> num_subscribers_{0};
+
+  // Smallest window of the subscribers using permessage-deflate, so one
+  // compressed frame suits them all. 0 if there are none.
+  std::atomic<int> deflate_window_bits_{0};
+
+  // Frames published from other tasks, waiting for the event pump. Fixed
+  // size so nothing is allocated under the lock.
+  Mutex inbox_lock_;
+  std::array<SharedFrame*, kQueueSize> inbox_;
+  size_t inbox_count_ = 0;
+
+  // Frames Publish() could not queue, and their summed weight. Every
+  // subscriber missed them.
+  std::atomic<uint32_t> inbox_dropped_{0};
+  std::atomic<uint32_t> inbox_dropped_weight_{0};
+  uint32_t inbox_dropped_seen_ = 0;  // Event pump task only.
+  uint32_t inbox_dropped_weight_seen_ = 0;  // Event pump task only.
+
+  std::atomic<uint32_t> published_{0};
+  std::atomic<uint32_t> dropped_{0};
+  std::atomic<uint32_t> disconnected_{0};
+
+  // Set while a wakeup is in flight so a burst of Publish() calls costs one
+  // mg_broadcast() round trip.
+  std::atomic<bool> wakeup_pending_{false};
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_HTTPD_WEBSOCKET_BROADCASTER_H_
@@ -0,0 +1,84 @@
+#ifndef ESPCXX_JSON_WRITER_H_
+#define ESPCXX_JSON_WRITER_H_
+
+#include <cstdint>
+#include <functional>
+
+#include "esp_cxx/cxx17hack.h"
+
+namespace esp_cxx {
+
+// Streaming JSON serializer. Writes into a small fixed buffer that is
+// handed to |sink| whenever it fills, so output of any size is produced
+// without building a cJSON tree or a string of the whole document.
+//
+// Commas and colons are inserted automatically. Calls must still be
+// well-formed (eg, Key() only inside an object); violations are caught by
+// assert() and not reported otherwise.
+//
+//   JsonWriter json(sink);
+//   json.BeginObject();
+//   json.Key("uptime_ms").Int(1234);
+//   json.Key("tags").BeginArray().String("a").String("b").EndArray();
+//   json.EndObject();
+//
+// The destructor flushes whatever is still buffered.
+class JsonWriter {
+ public:
+  using Sink = std::function<void(std::string_view data)>;
+
+  explicit JsonWriter(Sink sink);
+  ~JsonWriter();
+
+  JsonWriter& BeginObject();
+  JsonWriter& EndObject();
+  JsonWriter& BeginArray();
+  JsonWriter& EndArray();
+
+  // Emits an object key. Must be followed by exactly one value.
+  JsonWriter& Key(std::string_view key);
+
+  JsonWriter& String(std::string_view value);
+  JsonWriter& Int(int64_t value);
+  JsonWriter& Uint(uint64_t value);
+  JsonWriter& Double(double value);  // NaN and infinities become null.
+  JsonWriter& Bool(bool value);
+  JsonWriter& Null();
+
+  // Passes buffered output to the sink.
+  void Flush();
+
+  // Bytes passed to the sink so far plus those still buffered.
+  size_t bytes_written() const { return flushed_ + len_; }
+
+ private:
+  // Deep enough for anything esp_cxx serves. Nesting is tracked as one
+  // bit per level.
+  static constexpr int kMaxDepth = 32;
+
+  // Output is passed to the sink in pieces of at most this size. For an
+  // HttpResponse each flush is one chunk so this trades chunk framing
+  // overhead against stack.
+  static constexpr size_t kBufferSize = 256;
+
+  void BeginValue();
+  void Push(char open, bool is_object);
+  void Pop(char close, bool is_object);
+  void Write(std::string_view data);
+  void Put(char c);
+  void WriteEscaped(std::string_view value);
+
+  Sink sink_;
+  char buffer_[kBufferSize];
+  size_t len_ = 0;
+  size_t flushed_ = 0;
+
+  int depth_ = 0;
+  uint32_t object_bits_ = 0;  // Bit n set if level n is an object.
+  uint32_t has_items_bits_ = 0;  // Bit n set if level n needs a comma.
+  bool after_key_ = false;
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_JSON_WRITER_H_
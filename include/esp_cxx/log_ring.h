@@ -0,0 +1,133 @@
+#ifndef ESPCXX_LOG_RING_H_
+#define ESPCXX_LOG_RING_H_
+
+#include <array>
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+namespace esp_cxx {
+
+// A log line captured in binary form. Nothing is formatted on capture. The
+// format pointer is kept as is (esp-idf requires formats and tags to be
+// static) and the arguments are copied into |args| as tagged values. String
+// arguments are the only ones copied by content since their lifetime ends
+// with the log call.
+struct LogRecord {
+  static constexpr size_t kArgBytes = 112;
+
+  uint32_t timestamp = 0;  // Wall clock seconds at capture.
+  const char* format = nullptr;
+  const char* tag = nullptr;  // Only set for esp-idf formatted lines.
+  uint8_t level = 0;  // esp_log_level_t. 0 if it could not be determined.
+  uint8_t arg_bytes = 0;
+  uint8_t prefix_arg_bytes = 0;  // Bytes of |args| used by the esp-idf prefix.
+  bool truncated = false;  // Set if |args| ran out of space.
+  alignas(8) uint8_t args[kArgBytes];
+};
+
+// Fills |record| from a printf-style |format| and its |args|. Consumes |args|.
+void CaptureLogRecord(LogRecord* record, uint32_t timestamp,
+                      const char* format, va_list args);
+
+// Formats |record| into |buf| in the same way vsnprintf() would have at
+// capture time. Returns the number of characters written, excluding the
+// NUL terminator. Output is always NUL terminated if |size| > 0.
+size_t FormatLogRecord(const LogRecord& record, char* buf, size_t size);
+
+// Lock-free, bounded, multi-producer single-consumer ring of LogRecords.
+// Producers never block. If the ring is full, the record is dropped and
+// counted. Based on Dmitry Vyukov's bounded queue where each slot carries a
+// sequence number that says whose turn it is.
+template <size_t kNumRecords>
+class LogRing {
+ public:
+  static_assert((kNumRecords & (kNumRecords - 1)) == 0,
+                "kNumRecords must be a power of 2");
+
+  LogRing() {
+    for (size_t i = 0; i < kNumRecords; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Claims a slot and runs |fill| on it. Callable from any task. Returns
+  // false if the ring is full.
+  template <typename Fill>
+  bool Push(Fill&& fill) {
+    uint32_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+      slot = &slots_[pos % kNumRecords];
+      uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+      int32_t diff = static_cast<int32_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    fill(&slot->record);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Runs |consume| on the oldest record. Only one task may call this.
+  // Returns false if there was nothing to consume.
+  template <typename Consume>
+  bool Pop(Consume&& consume) {
+    Slot* slot = &slots_[dequeue_pos_ % kNumRecords];
+    uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+    if (static_cast<int32_t>(seq - (dequeue_pos_ + 1)) < 0) {
+      return false;
+    }
+
+    consume(slot->record);
+    slot->sequence.store(dequeue_pos_ + kNumRecords, std::memory_order_release);
+    dequeue_pos_++;
+    return true;
+  }
+
+  // Runs |visit| on each record pushed but not yet popped, oldest first,
+  // without consuming any. Best effort: only meant for when the consumer
+  // will never run again, such as on shutdown. A record the consumer is
+  // in the middle of may be visited as well.
+  template <typename Visit>
+  void PeekPending(Visit&& visit) const {
+    for (uint32_t pos = dequeue_pos_;; ++pos) {
+      const Slot& slot = slots_[pos % kNumRecords];
+      if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+        return;
+      }
+      visit(slot.record);
+    }
+  }
+
+  // Returns and resets the count of records dropped because the ring was full.
+  uint32_t TakeDropped() {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    LogRecord record;
+  };
+
+  std::array<Slot, kNumRecords> slots_;
+  std::atomic<uint32_t> enqueue_pos_{0};
+  std::atomic<uint32_t> dropped_{0};
+  uint32_t dequeue_pos_ = 0;  // Only touched by the consumer.
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_LOG_RING_H_
@@ -0,0 +1,94 @@
+#ifndef ESPCXX_LOG_THROTTLE_H_
+#define ESPCXX_LOG_THROTTLE_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#include "esp_cxx/cxx17hack.h"
+#include "esp_cxx/log_ring.h"
+
+#include "gtest/gtest_prod.h"
+
+namespace esp_cxx {
+
+// Sink stage that sits between the LogRing consumer and the log outputs.
+// Each call site (identified by its format pointer) gets a token bucket
+// and there is one more bucket for the whole pipeline so that a storm of
+// distinct lines is bounded too. A record identical to the previous one
+// (ignoring the esp-idf timestamp) is collapsed and later reported as a
+// single "last message repeated N times" line. Counts still pending when
+// the lines stop are reported by Flush().
+//
+// Not thread-safe. Meant to be run on the single log drain task.
+class LogThrottle {
+ public:
+  struct Stats {
+    uint32_t rate_limited = 0;
+    uint32_t deduplicated = 0;
+  };
+
+  // Each call site may burst |site_burst| lines and then |site_per_sec|
+  // lines per second. The pipeline as a whole is held to |total_per_sec|
+  // with a burst of 4x that.
+  LogThrottle(int site_burst = 10, int site_per_sec = 2, int total_per_sec = 20);
+
+  // Returns true if |record| should be emitted. Summary lines that must
+  // come before it are passed to |on_summary| first.
+  bool Admit(const LogRecord& record, uint32_t now_ms,
+             const std::function<void(std::string_view)>& on_summary);
+
+  // Reports pending repeat and suppression counts, at most once per
+  // kSummaryIntervalMs. Call periodically so a storm that stops does not
+  // leave its counts unreported.
+  void Flush(uint32_t now_ms, const std::function<void(std::string_view)>& on_summary);
+
+  const Stats& stats() const { return stats_; }
+
+  static constexpr uint32_t kSummaryIntervalMs = 2000;
+
+ private:
+  FRIEND_TEST(LogThrottle, CollidingSitesShareTokens);
+
+  // Token buckets hold tokens in thousandths so refill math can stay in
+  // integers at millisecond resolution.
+  struct Bucket {
+    const char* format = nullptr;
+    const char* tag = nullptr;
+    int32_t tokens_milli = 0;
+    uint32_t last_refill_ms = 0;
+    uint32_t suppressed = 0;
+  };
+
+  static constexpr size_t kNumBuckets = 16;
+
+  static size_t BucketIndex(const char* format);
+
+  // Refills |bucket| and tries to take one token.
+  static bool TakeToken(Bucket* bucket, uint32_t now_ms, int burst, int per_sec);
+
+  void EmitRepeatSummary(const std::function<void(std::string_view)>& on_summary);
+  static void EmitSuppressedSummary(Bucket* bucket,
+                                    const std::function<void(std::string_view)>& on_summary);
+  void EmitTotalSuppressedSummary(const std::function<void(std::string_view)>& on_summary);
+
+  int site_burst_;
+  int site_per_sec_;
+  int total_per_sec_;
+
+  std::array<Bucket, kNumBuckets> buckets_;
+  Bucket total_bucket_;
+
+  // Identity of the last emitted record for deduplication.
+  uint32_t last_hash_ = 0;
+  const char* last_format_ = nullptr;
+  uint32_t repeated_ = 0;
+
+  uint32_t last_flush_ms_ = 0;
+
+  Stats stats_;
+};
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_LOG_THROTTLE_H_
@@ -6,17 +6,6 @@
 
 #include <functional>
 
-namespace esp_cxx {
-constexpr char kEspCxxTag[] = "espcxx";
-
-static inline unique_C_ptr<char> PrintJson(cJSON* data) {
-  return unique_C_ptr<char>(cJSON_PrintUnformatted(data));
-}
-
-void SetLogFilter(std::function<void(std::string_view)> on_log, std::string_view device_id);
-
-}  // namespace espcxx
-
 #ifndef FAKE_ESP_IDF
 
 #include "esp_log.h"
@@ -27,12 +16,6 @@ void SetLogFilter(std::function<void(std::string_view)> on_log, std::string_view
 #include <cstdint>
 #include <time.h>
 
-#define ESP_LOGD(tag, fmt, args...) fprintf(stderr, "%s:%d D: %s: " fmt "\n", __FILE__, __LINE__, tag, ##args)
-#define ESP_LOGI(tag, fmt, args...) fprintf(stderr, "%s:%d I: %s: " fmt "\n", __FILE__, __LINE__, tag, ##args)
-#define ESP_LOGW(tag, fmt, args...) fprintf(stderr, "%s:%d W: %s: " fmt "\n", __FILE__, __LINE__, tag, ##args)
-#define ESP_LOGE(tag, fmt, args...) fprintf(stderr, "%s:%d E: %s: " fmt "\n", __FILE__, __LINE__, tag, ##args)
-#define ESP_LOG_BUFFER_HEX_LEVEL(tag, bytes, size, level)
-
 typedef enum {
     ESP_LOG_NONE,       /*!< No log output */
     ESP_LOG_ERROR,      /*!< Critical errors, software module can not recover on its own */
@@ -42,8 +25,113 @@ typedef enum {
     ESP_LOG_VERBOSE     /*!< Bigger chunks of debugging information, or frequent messages which can potentially flood the output. */
 } esp_log_level_t;
 
+#define ESP_LOG_FAKE_WRITE(level, letter, tag, fmt, args...) \
+  do { \
+    if (esp_cxx::IsLogEnabled(tag, level)) { \
+      fprintf(stderr, "%s:%d " letter ": %s: " fmt "\n", __FILE__, __LINE__, tag, ##args); \
+    } \
+  } while (0)
+
+#define ESP_LOGD(tag, fmt, args...) ESP_LOG_FAKE_WRITE(ESP_LOG_DEBUG, "D", tag, fmt, ##args)
+#define ESP_LOGI(tag, fmt, args...) ESP_LOG_FAKE_WRITE(ESP_LOG_INFO, "I", tag, fmt, ##args)
+#define ESP_LOGW(tag, fmt, args...) ESP_LOG_FAKE_WRITE(ESP_LOG_WARN, "W", tag, fmt, ##args)
+#define ESP_LOGE(tag, fmt, args...) ESP_LOG_FAKE_WRITE(ESP_LOG_ERROR, "E", tag, fmt, ##args)
+#define ESP_LOGV(tag, fmt, args...) ESP_LOG_FAKE_WRITE(ESP_LOG_VERBOSE, "V", tag, fmt, ##args)
+#define ESP_LOG_LEVEL(level, tag, fmt, args...) ESP_LOG_FAKE_WRITE(level, "L", tag, fmt, ##args)
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, bytes, size, level)
+
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+
 static inline uint32_t esp_log_timestamp() { return time(NULL); }
 
+#include <cstdarg>
+
+typedef int (*vprintf_like_t)(const char *, va_list);
+static inline vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+  static vprintf_like_t current = &vprintf;
+  vprintf_like_t old = current;
+  current = func;
+  return old;
+}
+
 #endif  // FAKE_ESP_IDF
 
+// Most verbose level compiled into ESPCXX_LOGx() call sites. Anything more
+// verbose is removed by the compiler, including evaluation of arguments.
+// Define before including this header to override per translation unit.
+#ifndef ESPCXX_LOG_LOCAL_LEVEL
+#define ESPCXX_LOG_LOCAL_LEVEL LOG_LOCAL_LEVEL
+#endif
+
+// Like ESP_LOGx() but checks the compile-time and per-tag runtime level
+// BEFORE evaluating any arguments. Use these on hot paths and whenever an
+// argument is expensive to produce (eg, PrintJson()).
+#define ESPCXX_LOG_LEVEL(level, tag, format, ...) \
+  do { \
+    if ((level) <= ESPCXX_LOG_LOCAL_LEVEL && esp_cxx::IsLogEnabled(tag, level)) { \
+      ESP_LOG_LEVEL(level, tag, format, ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#define ESPCXX_LOGE(tag, format, ...) ESPCXX_LOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESPCXX_LOGW(tag, format, ...) ESPCXX_LOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESPCXX_LOGI(tag, format, ...) ESPCXX_LOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESPCXX_LOGD(tag, format, ...) ESPCXX_LOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESPCXX_LOGV(tag, format, ...) ESPCXX_LOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+namespace esp_cxx {
+constexpr char kEspCxxTag[] = "espcxx";
+
+class ConfigStore;
+
+static inline unique_cJSON_str PrintJson(cJSON* data) {
+  return unique_cJSON_str(cJSON_PrintUnformatted(data));
+}
+
+// Installs a log hook that forwards each log line, prefixed in syslog
+// format, to |on_log|. The hook on the logging task only copies the format
+// pointer and raw arguments into a lock-free ring. Formatting, console
+// output, and |on_log| are all run later from a dedicated low priority
+// task. If the ring overflows, lines are dropped and a summary line is
+// emitted in their place.
+//
+// Before output, lines pass through a LogThrottle which rate limits each
+// call site and collapses repeats so a log storm cannot monopolize the
+// console, |on_log|, or the network behind it. Emitted lines are also
+// kept in the reboot-surviving ring from persistent_log.h.
+void SetLogFilter(std::function<void(std::string_view)> on_log, std::string_view device_id);
+
+// Counters for lines that never reached the outputs of SetLogFilter().
+struct LogStats {
+  uint32_t dropped = 0;  // Lost to a full ring.
+  uint32_t rate_limited = 0;
+  uint32_t deduplicated = 0;  // Collapsed into "repeated N times".
+};
+LogStats GetLogStats();
+
+// Runtime log level for |tag|. A |tag| of "*" sets the default for tags
+// without their own level. Tags are compared by content so they need not
+// be the same pointer used at the call site. Also forwarded to
+// esp_log_level_set() so plain ESP_LOGx() calls honor it. At most 16 tags
+// of up to 15 chars get their own level. Others are warned about and only
+// reach esp_log_level_set().
+void SetLogLevel(const char* tag, esp_log_level_t level);
+esp_log_level_t GetLogLevel(const char* tag);
+
+// Returns true if a |level| line for |tag| would be emitted. Cheap when
+// |level| is more verbose than every configured level.
+bool IsLogEnabled(const char* tag, esp_log_level_t level);
+
+// Parses "none", "error", "warn", "info", "debug", "verbose" or a digit.
+std::optional<esp_log_level_t> ParseLogLevel(std::string_view level);
+
+// Config prefix for per-tag levels. Setting "log:<tag>" in the ConfigStore
+// (eg, via ConfigEndpoint) to a level name changes that tag's level.
+constexpr char kLogLevelConfigPrefix[] = "log";
+
+// Applies all "log:<tag>" entries in |config_store|. Call at boot.
+void LoadLogLevels(ConfigStore* config_store);
+
+}  // namespace espcxx
+
 #endif  // ESPCXX_LOGGING_H_
@@ -5,6 +5,10 @@
 
 #include <string>
 
+#ifdef FAKE_ESP_IDF
+#include <functional>
+#endif
+
 #ifndef FAKE_ESP_IDF
 #include "nvs_flash.h"
 #endif
@@ -41,6 +45,13 @@ class NvsHandle {
   std::optional<uint8_t> GetByte(const char* key);
   void SetByte(const char* key, uint8_t value);
 
+#ifdef FAKE_ESP_IDF
+  // Host builds keep values in memory, per namespace, for the life of the
+  // process. There is no nvs_entry_find() so callers iterate with this.
+  void ForEachString(
+      const std::function<void(const char* key, std::string_view value)>& on_value);
+#endif
+
  private:
   nvs_handle handle_ = {};
 
@@ -0,0 +1,38 @@
+#ifndef ESPCXX_PERSISTENT_LOG_H_
+#define ESPCXX_PERSISTENT_LOG_H_
+
+#include <cstdint>
+
+#include "esp_cxx/cxx17hack.h"
+
+namespace esp_cxx {
+
+// A small ring of recent log text that survives a reboot. On the ESP32 it
+// lives in RTC slow memory which is preserved across software resets,
+// watchdog resets and panics (but not power loss). On FAKE_ESP_IDF it is
+// an mmap()ed file named by $ESPCXX_PERSISTENT_LOG, defaulting to
+// /tmp/espcxx_persistent_log.bin.
+//
+// SetLogFilter() calls InitPersistentLog(). Its drain task appends every
+// line, before the rate limiting and deduplication of the console and
+// network output, and lines not yet drained are appended on esp_restart().
+// Lines still queued at a panic or watchdog reset are lost.
+
+// Snapshots whatever the previous boot left behind, then starts a fresh
+// log for this boot. Safe to call more than once; only the first call
+// does anything.
+void InitPersistentLog();
+
+// Appends |text| to this boot's log. Overwrites the oldest text when full.
+void AppendPersistentLog(std::string_view text);
+
+// Log text recovered from the previous boot by InitPersistentLog(). Empty
+// if nothing valid survived (eg, after power loss).
+std::string_view GetPreviousBootLog();
+
+// Number of boots seen since the persistent memory was last invalidated.
+uint32_t GetPersistentLogBootCount();
+
+}  // namespace esp_cxx
+
+#endif  // ESPCXX_PERSISTENT_LOG_H_
@@ -61,6 +61,10 @@ class TaskRef {
   void Notify();
   void Wait();
 
+  // Same as Wait() but gives up after |timeout_ms|. Returns true if
+  // notified.
+  bool Wait(int timeout_ms);
+
   // Stop the task.
   void Stop();
 
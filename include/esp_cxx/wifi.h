@@ -1,13 +1,16 @@
 #ifndef ESPCXX_WIFI_H_
 #define ESPCXX_WIFI_H_
 
+#include <atomic>
 #include <string>
 #include <functional>
 
+#include "esp_cxx/backoff.h"
 #include "esp_cxx/cxx17hack.h"
 
 #ifndef FAKE_ESP_IDF
 #include "esp_event.h"
+#include "esp_timer.h"
 #endif
 
 namespace esp_cxx {
@@ -36,6 +39,10 @@ class Wifi {
   //
   // This is mutually exclusive with CreateSetupNetwork().
   bool ConnectToAP();
+
+  // Schedules a reconnect after a jittered backoff that is also charged
+  // against RetryBudget::ReserveShared(). The backoff resets once an IP
+  // is obtained. Repeated calls before the reconnect fires are ignored.
   void ReconnectToAP();
 
   // Set handlers for events associated with connecting to an access point.
@@ -69,8 +76,15 @@ class Wifi {
                    void* event_data);
 
   void WifiConnect(const wifi_config_t& wifi_config, bool is_station);
+
+  static void ReconnectTimerThunk(void* arg);
+
+  esp_timer_handle_t reconnect_timer_ = nullptr;
+  std::atomic<bool> reconnect_pending_{false};
 #endif
 
+  DecorrelatedJitterBackoff<1000, 5*60*1000> reconnect_backoff_;
+
   std::function<void(ip_event_got_ip_t*)> on_ap_connect_;
   std::function<void(uint8_t)> on_ap_disconnect_;
 };
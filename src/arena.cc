@@ -0,0 +1,210 @@
+#include "esp_cxx/arena.h"
+
+#include <cstdlib>
+#include <mutex>
+
+#include "cJSON.h"
+#include "esp_cxx/mutex.h"
+
+namespace esp_cxx {
+
+namespace {
+
+thread_local Arena* t_current_arena = nullptr;
+
+// Every live Arena, so memory handed out by one is never passed to free()
+// even when released outside of its Scope. Also guards each arena's block
+// list, which other tasks read through Arena::Owns(). On the ESP32 this is
+// a critical section so nothing is allocated or freed while it is held.
+Mutex g_arenas_lock;
+Arena* g_arenas = nullptr;
+
+void* ArenaMalloc(size_t size) {
+  Arena* arena = t_current_arena;
+  return arena ? arena->Allocate(size) : malloc(size);
+}
+
+void ArenaFree(void* ptr) {
+  Arena* arena = t_current_arena;
+  if (arena && arena->Contains(ptr)) {
+    return;
+  }
+  // Eg, a cJSON object allocated in a Scope but deleted after it ended.
+  if (Arena::Owns(ptr)) {
+    return;
+  }
+  free(ptr);
+}
+
+// cJSON has one global set of hooks. Outside of a Scope they are plain
+// malloc()/free() so installing them is harmless for other users.
+void InstallCJsonHooks() {
+  static bool installed = [] {
+    cJSON_Hooks hooks = {};
+    hooks.malloc_fn = &ArenaMalloc;
+    hooks.free_fn = &ArenaFree;
+    cJSON_InitHooks(&hooks);
+    return true;
+  }();
+  (void)installed;
+}
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+Arena::Arena(size_t block_size) : block_size_(block_size) {
+  std::lock_guard<Mutex> lock(g_arenas_lock);
+  next_arena_ = g_arenas;
+  g_arenas = this;
+}
+
+Arena::~Arena() {
+  {
+    std::lock_guard<Mutex> lock(g_arenas_lock);
+    Arena** link = &g_arenas;
+    while (*link != this) {
+      link = &(*link)->next_arena_;
+    }
+    *link = next_arena_;
+  }
+  FreeBlocks(blocks_);
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+  bytes_used_ += size;
+
+  if (size > block_size_ / 4) {
+    // Own block, linked in behind the current one so the current block
+    // keeps being filled.
+    Block* block = NewBlock(size + alignment);
+    if (!block) {
+      return nullptr;
+    }
+    std::lock_guard<Mutex> lock(g_arenas_lock);
+    if (blocks_) {
+      block->next = blocks_->next;
+      blocks_->next = block;
+    } else {
+      blocks_ = block;
+      used_in_block_ = block->size;
+    }
+    return reinterpret_cast<void*>(
+        AlignUp(reinterpret_cast<uintptr_t>(block->data()), alignment));
+  }
+
+  if (blocks_) {
+    uintptr_t base = reinterpret_cast<uintptr_t>(blocks_->data());
+    size_t offset = AlignUp(base + used_in_block_, alignment) - base;
+    if (offset + size <= blocks_->size) {
+      used_in_block_ = offset + size;
+      return blocks_->data() + offset;
+    }
+  }
+
+  Block* block = NewBlock(block_size_);
+  if (!block) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<Mutex> lock(g_arenas_lock);
+    block->next = blocks_;
+    blocks_ = block;
+  }
+  uintptr_t base = reinterpret_cast<uintptr_t>(block->data());
+  size_t offset = AlignUp(base, alignment) - base;
+  used_in_block_ = offset + size;
+  return block->data() + offset;
+}
+
+bool Arena::Contains(const void* ptr) const {
+  const char* p = static_cast<const char*>(ptr);
+  for (const Block* block = blocks_; block; block = block->next) {
+    if (p >= block->data() && p < block->data() + block->size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Arena::Reset() {
+  bytes_used_ = 0;
+  used_in_block_ = 0;
+  if (!blocks_) {
+    return;
+  }
+
+  // Keep one regular sized block. Dedicated blocks are released, outside
+  // of the lock.
+  Block* keep = nullptr;
+  Block* release = nullptr;
+  {
+    std::lock_guard<Mutex> lock(g_arenas_lock);
+    Block* block = blocks_;
+    while (block) {
+      Block* next = block->next;
+      if (!keep && block->size == block_size_) {
+        keep = block;
+        keep->next = nullptr;
+      } else {
+        block->next = release;
+        release = block;
+      }
+      block = next;
+    }
+    blocks_ = keep;
+  }
+  FreeBlocks(release);
+}
+
+// static
+bool Arena::Owns(const void* ptr) {
+  std::lock_guard<Mutex> lock(g_arenas_lock);
+  for (const Arena* arena = g_arenas; arena; arena = arena->next_arena_) {
+    if (arena->Contains(ptr)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// static
+Arena* Arena::Current() {
+  return t_current_arena;
+}
+
+Arena::Block* Arena::NewBlock(size_t size) {
+  Block* block = static_cast<Block*>(malloc(sizeof(Block) + size));
+  if (block) {
+    block->next = nullptr;
+    block->size = size;
+  }
+  return block;
+}
+
+void Arena::FreeBlocks(Block* first) {
+  while (first) {
+    Block* next = first->next;
+    free(first);
+    first = next;
+  }
+}
+
+Arena::Scope::Scope(Arena* arena)
+  : previous_(t_current_arena),
+    active_(arena != nullptr) {
+  if (active_) {
+    InstallCJsonHooks();
+    t_current_arena = arena;
+  }
+}
+
+Arena::Scope::~Scope() {
+  if (active_) {
+    t_current_arena = previous_;
+  }
+}
+
+}  // namespace esp_cxx
@@ -0,0 +1,62 @@
+#include "esp_cxx/backoff.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#ifndef FAKE_ESP_IDF
+#include "esp_system.h"
+#else
+#include <random>
+#endif
+
+namespace esp_cxx {
+
+namespace {
+std::atomic<RetryBudget*> g_shared_budget{nullptr};
+}  // namespace
+
+uint32_t RandomSeed() {
+#ifndef FAKE_ESP_IDF
+  // Only truly random with the radio on. Otherwise still differs per
+  // device which is what matters to avoid a synchronized herd.
+  return esp_random();
+#else
+  std::random_device rd;
+  return rd();
+#endif
+}
+
+RetryBudget::RetryBudget(int max_tokens, int refill_interval_ms)
+  : max_tokens_(max_tokens),
+    refill_interval_(std::chrono::milliseconds(refill_interval_ms)),
+    full_at_(Clock::now()) {
+}
+
+int RetryBudget::Reserve(int delay_ms) {
+  Clock::time_point now = Clock::now();
+  Clock::time_point retry_at = now + std::chrono::milliseconds(delay_ms);
+
+  std::lock_guard<Mutex> lock(lock_);
+  // The token is taken now whatever the delay, so a retry reserved far out
+  // does not hold up the other users of the budget.
+  Clock::time_point full_at = std::max(full_at_, now) + refill_interval_;
+  // The bucket may be at most |max_tokens_| intervals away from full.
+  retry_at = std::max(retry_at, full_at - refill_interval_ * max_tokens_);
+  full_at_ = full_at;
+
+  return std::chrono::ceil<std::chrono::milliseconds>(retry_at - now).count();
+}
+
+// static
+void RetryBudget::SetShared(RetryBudget* budget) {
+  g_shared_budget = budget;
+}
+
+// static
+int RetryBudget::ReserveShared(int delay_ms) {
+  RetryBudget* budget = g_shared_budget;
+  return budget ? budget->Reserve(delay_ms) : delay_ms;
+}
+
+}  // namespace esp_cxx
@@ -24,17 +24,29 @@ std::optional<std::string> ConfigStore::GetValue(std::string_view prefix, std::s
 
 unique_cJSON_ptr ConfigStore::GetAllValues() {
   unique_cJSON_ptr values(cJSON_CreateObject());
+  ForEachValue([&values](const char* full_key, std::string_view value) {
+    cJSON_AddStringToObject(values.get(), full_key, std::string(value).c_str());
+  });
+  return values;
+}
+
+void ConfigStore::ForEachValue(
+    const std::function<void(const char* full_key, std::string_view value)>& on_value) {
+#ifdef FAKE_ESP_IDF
+  nvs_handle_.ForEachString(on_value);
+#else
   nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, kNvsNamespace,
                                      NVS_TYPE_STR);
   while (it != NULL) {
     nvs_entry_info_t info;
     nvs_entry_info(it, &info);
     it = nvs_entry_next(it);
-    cJSON_AddStringToObject(values.get(), info.key,
-                            nvs_handle_.GetString(info.key).value().c_str());
+    auto value = nvs_handle_.GetString(info.key);
+    if (value) {
+      on_value(info.key, value.value());
+    }
   };
-
-  return values;
+#endif  // FAKE_ESP_IDF
 }
 
 }  // namespace esp_cxx
@@ -0,0 +1,439 @@
+#include "esp_cxx/deflate.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+namespace esp_cxx {
+
+namespace {
+
+// Length symbols 257..285 and distance symbols 0..29 (RFC 1951 3.2.5).
+constexpr uint16_t kLengthBase[] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t kLengthExtra[] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t kDistanceBase[] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+  16385, 24577};
+constexpr uint8_t kDistanceExtra[] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+constexpr int kNumLengthCodes = sizeof(kLengthBase) / sizeof(kLengthBase[0]);
+constexpr int kNumDistanceCodes = sizeof(kDistanceBase) / sizeof(kDistanceBase[0]);
+
+constexpr size_t kMinMatch = 3;
+constexpr size_t kMaxMatch = 258;
+constexpr int kMaxCodeBits = 15;
+
+// Match finder hash table. 512 entries is 2 KB per Deflate() call.
+constexpr int kHashBits = 9;
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::string* out) : out_(out) {}
+
+  void Put(uint32_t value, int num_bits) {
+    bits_ |= value << num_bits_;
+    num_bits_ += num_bits;
+    while (num_bits_ >= 8) {
+      out_->push_back(static_cast<char>(bits_));
+      bits_ >>= 8;
+      num_bits_ -= 8;
+    }
+  }
+
+  // Huffman codes are packed starting with their most significant bit.
+  void PutCode(uint32_t code, int num_bits) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < num_bits; ++i) {
+      reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    Put(reversed, num_bits);
+  }
+
+  void AlignToByte() {
+    if (num_bits_ > 0) {
+      Put(0, 8 - num_bits_);
+    }
+  }
+
+ private:
+  std::string* out_;
+  uint32_t bits_ = 0;
+  int num_bits_ = 0;
+};
+
+// Fixed literal/length code (RFC 1951 3.2.6).
+void PutLiteralOrLength(BitWriter* writer, int symbol) {
+  if (symbol < 144) {
+    writer->PutCode(0x30 + symbol, 8);
+  } else if (symbol < 256) {
+    writer->PutCode(0x190 + symbol - 144, 9);
+  } else if (symbol < 280) {
+    writer->PutCode(symbol - 256, 7);
+  } else {
+    writer->PutCode(0xc0 + symbol - 280, 8);
+  }
+}
+
+void PutMatch(BitWriter* writer, size_t length, size_t distance) {
+  int code = kNumLengthCodes - 1;
+  while (kLengthBase[code] > length) {
+    code--;
+  }
+  PutLiteralOrLength(writer, 257 + code);
+  writer->Put(length - kLengthBase[code], kLengthExtra[code]);
+
+  code = kNumDistanceCodes - 1;
+  while (kDistanceBase[code] > distance) {
+    code--;
+  }
+  writer->PutCode(code, 5);
+  writer->Put(distance - kDistanceBase[code], kDistanceExtra[code]);
+}
+
+uint32_t Hash(const uint8_t* p) {
+  uint32_t value = (p[0] << 16) | (p[1] << 8) | p[2];
+  return (value * 2654435761u) >> (32 - kHashBits);
+}
+
+// Canonical Huffman decoding table in the style of zlib's puff.c: symbols
+// sorted by code length, and the number of codes of each length.
+struct Huffman {
+  uint16_t count[kMaxCodeBits + 1];
+  uint16_t symbol[288];
+};
+
+// Returns 0 for a complete code, > 0 for an incomplete one and < 0 for an
+// over-subscribed one.
+int BuildHuffman(Huffman* huffman, const uint8_t* lengths, int num_symbols) {
+  std::fill(std::begin(huffman->count), std::end(huffman->count), 0);
+  for (int symbol = 0; symbol < num_symbols; ++symbol) {
+    huffman->count[lengths[symbol]]++;
+  }
+  if (huffman->count[0] == num_symbols) {
+    return 0;
+  }
+
+  int left = 1;
+  for (int len = 1; len <= kMaxCodeBits; ++len) {
+    left = (left << 1) - huffman->count[len];
+    if (left < 0) {
+      return left;
+    }
+  }
+
+  uint16_t offsets[kMaxCodeBits + 1];
+  offsets[1] = 0;
+  for (int len = 1; len < kMaxCodeBits; ++len) {
+    offsets[len + 1] = offsets[len] + huffman->count[len];
+  }
+  for (int symbol = 0; symbol < num_symbols; ++symbol) {
+    if (lengths[symbol] != 0) {
+      huffman->symbol[offsets[lengths[symbol]]++] = symbol;
+    }
+  }
+  return left;
+}
+
+class Inflater {
+ public:
+  Inflater(std::string_view input, size_t max_output, std::string* out)
+    : input_(reinterpret_cast<const uint8_t*>(input.data())),
+      input_size_(input.size()),
+      max_output_(max_output),
+      out_(out),
+      out_start_(out->size()) {
+  }
+
+  bool Run() {
+    bool last = false;
+    while (!last && ok_) {
+      // A stream cut at a block boundary, as after a sync flush.
+      if (pos_ == input_size_ && num_bits_ == 0) {
+        return true;
+      }
+      last = Bits(1);
+      switch (Bits(2)) {
+        case 0:
+          Stored();
+          break;
+        case 1:
+          Fixed();
+          break;
+        case 2:
+          Dynamic();
+          break;
+        default:
+          ok_ = false;
+      }
+    }
+    return ok_;
+  }
+
+ private:
+  uint32_t Bits(int needed) {
+    uint32_t value = bits_;
+    while (num_bits_ < needed) {
+      if (pos_ == input_size_) {
+        ok_ = false;
+        return 0;
+      }
+      value |= static_cast<uint32_t>(input_[pos_++]) << num_bits_;
+      num_bits_ += 8;
+    }
+    bits_ = value >> needed;
+    num_bits_ -= needed;
+    return value & ((1u << needed) - 1);
+  }
+
+  int Decode(const Huffman& huffman) {
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= kMaxCodeBits && ok_; ++len) {
+      code |= Bits(1);
+      int count = huffman.count[len];
+      if (code - count < first) {
+        return huffman.symbol[index + (code - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  void Stored() {
+    bits_ = 0;
+    num_bits_ = 0;
+    if (input_size_ - pos_ < 4) {
+      ok_ = false;
+      return;
+    }
+    size_t len = input_[pos_] | (input_[pos_ + 1] << 8);
+    size_t nlen = input_[pos_ + 2] | (input_[pos_ + 3] << 8);
+    pos_ += 4;
+    if (len != (~nlen & 0xffff) || input_size_ - pos_ < len ||
+        Produced() + len > max_output_) {
+      ok_ = false;
+      return;
+    }
+    out_->append(reinterpret_cast<const char*>(input_ + pos_), len);
+    pos_ += len;
+  }
+
+  void Fixed() {
+    // Built once per block; both tables together are under 1 KB.
+    uint8_t lengths[288];
+    std::fill(lengths, lengths + 144, 8);
+    std::fill(lengths + 144, lengths + 256, 9);
+    std::fill(lengths + 256, lengths + 280, 7);
+    std::fill(lengths + 280, lengths + 288, 8);
+    Huffman literals;
+    BuildHuffman(&literals, lengths, 288);
+
+    std::fill(lengths, lengths + 30, 5);
+    Huffman distances;
+    BuildHuffman(&distances, lengths, 30);
+
+    Codes(literals, distances);
+  }
+
+  void Dynamic() {
+    static constexpr uint8_t kOrder[19] = {
+      16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    int num_literals = Bits(5) + 257;
+    int num_distances = Bits(5) + 1;
+    int num_code_lengths = Bits(4) + 4;
+    if (!ok_ || num_literals > 286 || num_distances > 30) {
+      ok_ = false;
+      return;
+    }
+
+    uint8_t lengths[286 + 30] = {};
+    for (int i = 0; i < num_code_lengths; ++i) {
+      lengths[kOrder[i]] = Bits(3);
+    }
+    Huffman code_lengths;
+    if (BuildHuffman(&code_lengths, lengths, 19) != 0) {
+      ok_ = false;
+      return;
+    }
+
+    int index = 0;
+    while (index < num_literals + num_distances && ok_) {
+      int symbol = Decode(code_lengths);
+      if (symbol < 16) {
+        lengths[index++] = symbol;
+        continue;
+      }
+      uint8_t repeated = 0;
+      int times;
+      if (symbol == 16) {
+        if (index == 0) {
+          ok_ = false;
+          return;
+        }
+        repeated = lengths[index - 1];
+        times = 3 + Bits(2);
+      } else if (symbol == 17) {
+        times = 3 + Bits(3);
+      } else {
+        times = 11 + Bits(7);
+      }
+      if (index + times > num_literals + num_distances) {
+        ok_ = false;
+        return;
+      }
+      std::fill(lengths + index, lengths + index + times, repeated);
+      index += times;
+    }
+    if (!ok_ || lengths[256] == 0) {
+      ok_ = false;
+      return;
+    }
+
+    // Incomplete codes are only allowed when they have a single symbol.
+    Huffman literals;
+    int left = BuildHuffman(&literals, lengths, num_literals);
+    if (left < 0 || (left > 0 && num_literals - literals.count[0] != 1)) {
+      ok_ = false;
+      return;
+    }
+    Huffman distances;
+    left = BuildHuffman(&distances, lengths + num_literals, num_distances);
+    if (left < 0 || (left > 0 && num_distances - distances.count[0] != 1)) {
+      ok_ = false;
+      return;
+    }
+
+    Codes(literals, distances);
+  }
+
+  void Codes(const Huffman& literals, const Huffman& distances) {
+    for (;;) {
+      int symbol = Decode(literals);
+      if (!ok_ || symbol == 256) {
+        return;
+      }
+      if (symbol < 256) {
+        if (Produced() == max_output_) {
+          ok_ = false;
+          return;
+        }
+        out_->push_back(static_cast<char>(symbol));
+        continue;
+      }
+
+      symbol -= 257;
+      if (symbol >= kNumLengthCodes) {
+        ok_ = false;
+        return;
+      }
+      size_t length = kLengthBase[symbol] + Bits(kLengthExtra[symbol]);
+      symbol = Decode(distances);
+      if (symbol >= kNumDistanceCodes) {
+        ok_ = false;
+        return;
+      }
+      size_t distance = kDistanceBase[symbol] + Bits(kDistanceExtra[symbol]);
+      if (!ok_ || distance > Produced() || Produced() + length > max_output_) {
+        ok_ = false;
+        return;
+      }
+      // Byte at a time since the source may overlap what is being written.
+      size_t from = out_->size() - distance;
+      for (size_t i = 0; i < length; ++i) {
+        out_->push_back((*out_)[from + i]);
+      }
+    }
+  }
+
+  size_t Produced() const { return out_->size() - out_start_; }
+
+  const uint8_t* input_;
+  size_t input_size_;
+  size_t pos_ = 0;
+  uint32_t bits_ = 0;
+  int num_bits_ = 0;
+
+  size_t max_output_;
+  std::string* out_;
+  size_t out_start_;
+
+  bool ok_ = true;
+};
+
+}  // namespace
+
+void Deflate(std::string_view input, int window_bits, std::string* out) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(input.data());
+  const size_t size = input.size();
+  const size_t max_distance =
+      size_t{1} << std::min(std::max(window_bits, 8), kMaxDeflateWindowBits);
+
+  BitWriter writer(out);
+  // One non-final block with the fixed codes.
+  writer.Put(0, 1);
+  writer.Put(1, 2);
+
+  // Position + 1 of the last time each hash was seen; 0 if never.
+  std::unique_ptr<uint32_t[]> head(new uint32_t[1 << kHashBits]());
+
+  size_t pos = 0;
+  while (pos < size) {
+    size_t best_length = 0;
+    size_t best_distance = 0;
+    if (size - pos >= kMinMatch) {
+      uint32_t hash = Hash(&data[pos]);
+      size_t candidate = head[hash];
+      head[hash] = pos + 1;
+      if (candidate > 0 && pos - (candidate - 1) <= max_distance) {
+        const uint8_t* match = &data[candidate - 1];
+        size_t limit = std::min(kMaxMatch, size - pos);
+        size_t length = 0;
+        while (length < limit && match[length] == data[pos + length]) {
+          length++;
+        }
+        if (length >= kMinMatch) {
+          best_length = length;
+          best_distance = pos - (candidate - 1);
+        }
+      }
+    }
+
+    if (best_length == 0) {
+      PutLiteralOrLength(&writer, data[pos]);
+      pos++;
+      continue;
+    }
+
+    PutMatch(&writer, best_length, best_distance);
+    // Index the rest of the match so later repeats can find it.
+    size_t end = pos + best_length;
+    for (pos++; pos < end && size - pos >= kMinMatch; ++pos) {
+      head[Hash(&data[pos])] = pos + 1;
+    }
+    pos = end;
+  }
+  PutLiteralOrLength(&writer, 256);
+
+  // Sync flush: an empty, non-final stored block.
+  writer.Put(0, 3);
+  writer.AlignToByte();
+  out->append("\x00\x00\xff\xff", 4);
+}
+
+bool Inflate(std::string_view input, size_t max_output, std::string* out) {
+  return Inflater(input, max_output, out).Run();
+}
+
+}  // namespace esp_cxx
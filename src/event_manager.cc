@@ -5,20 +5,20 @@
 
 namespace esp_cxx {
 
-void EventManager::Run(std::function<void(void)> closure) {
-  RunDelayed(std::move(closure), 0);
+bool EventManager::Run(std::function<void(void)> closure) {
+  return RunDelayed(std::move(closure), 0);
 }
 
-void EventManager::RunDelayed(std::function<void(void)> closure, int delay_ms) {
+bool EventManager::RunDelayed(std::function<void(void)> closure, int delay_ms) {
   auto run_after = std::chrono::steady_clock::now() +  std::chrono::milliseconds(delay_ms);
-  RunAfter(std::move(closure), run_after);
+  return RunAfter(std::move(closure), run_after);
 }
 
-void EventManager::RunAfter(std::function<void(void)> closure, TimePoint run_after) {
+bool EventManager::RunAfter(std::function<void(void)> closure, TimePoint run_after) {
   std::lock_guard<Mutex> lock(lock_);
   if (num_entries_ >= closures_.size()) {
     // TODO(awong): Wait until there's space or drop? We need a cv.
-    return;
+    return false;
   }
 
   int index = (head_ + num_entries_) % closures_.size();
@@ -27,6 +27,7 @@ void EventManager::RunAfter(std::function<void(void)> closure, TimePoint run_aft
 
   // Wake up the poll loop.
   Wake();
+  return true;
 }
 
 void EventManager::Loop() {
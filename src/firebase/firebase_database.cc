@@ -42,11 +42,26 @@ void FirebaseDatabase::SetConnectInfo(std::string host,
                          "wss://" + host_ + "/.ws?v=5&ns=" + database_,
                          [this](WebsocketFrame frame) { OnWsFrame(std::move(frame)); },
                          [this] {
+                           // Queued puts must not reach the next connection
+                           // ahead of its authentication. Failing them marks
+                           // their paths dirty, to be resent after auth.
+                           connect_state_ &= ~(kConnectedBit | kAuthBit | kListenBit);
+                           websocket_.ClearSendQueue();
+
                            // Send reconnect on a different event frame to avoid reentrancy.
                            event_manager_->Run([this]{
                                                Reconnect();
                                                });
                          });
+  websocket_.set_deflate(websocket_deflate_);
+  // Low enough that a full send queue of even small puts crosses it, so
+  // puts it dropped are always retried when it drains.
+  static constexpr size_t kPublishHighWater = 1024;
+  websocket_.set_high_water(kPublishHighWater, [this](bool above) {
+    if (!above && (is_authenticated() || firebase_id_token_url_.empty())) {
+      SendDirtyPaths();
+    }
+  });
 }
 
 void FirebaseDatabase::SetAuthInfo(const std::string& auth_token_url,
@@ -93,17 +108,8 @@ void FirebaseDatabase::Publish(const std::string& path,
   // Example packet:
   //  {"t":"d","d":{"r":4,"a":"p","b":{"p":"/test","d":{"hi":"mom","num":1547104593160},"h":""}}}
 
-  // Insert data.
-  unique_cJSON_ptr command(cJSON_CreateObject());
-  cJSON_AddStringToObject(command.get(), "p", path.c_str());
-  cJSON_AddItemToObject(command.get(), "d", cJSON_Duplicate(new_value.get(), true));
-  WrapDataCommand("p", &command);
-
+  SendPut(path, new_value.get());
   ReplacePath(path.c_str(), std::move(new_value));
-
-  Send(PrintJson(command.get()).get());
-  // TODO(awong): If disconnected then we should mark dirty and handle
-  // update merging.
 }
 
 cJSON* FirebaseDatabase::Get(const std::string& path) {
@@ -186,7 +192,7 @@ void FirebaseDatabase::OnWsFrame(WebsocketFrame frame) {
 
     case WebsocketOpcode::kText: {
       unique_cJSON_ptr json(cJSON_Parse(frame.data().data()));
-      ESP_LOGI(kEspCxxTag, "Recv: %s", PrintJson(json.get()).get());
+      ESPCXX_LOGD(kEspCxxTag, "Recv: %s", PrintJson(json.get()).get());
       OnCommand(json.get());
       if (on_update_) {
         on_update_();
@@ -272,7 +278,7 @@ void FirebaseDatabase::OnDataCommand(cJSON* command) {
     //   {"t":"d","d":{"r":3,"b":{"s":"permission_denied","d":"Permission denied"}}}
     //
     // Since sends are infrequent, just log all responses.
-    ESP_LOGI(kEspCxxTag, "%s", PrintJson(command).get());
+    ESPCXX_LOGI(kEspCxxTag, "%s", PrintJson(command).get());
     if (cJSON_IsNumber(request_id)) {
       int r = request_id->valueint;
       cJSON* status = cJSON_GetObjectItemCaseSensitive(body, "s");
@@ -344,19 +350,53 @@ void FirebaseDatabase::MergePath(const char* path, unique_cJSON_ptr new_data) {
   }
 }
 
-bool FirebaseDatabase::Send(std::string_view text, bool should_log) {
+bool FirebaseDatabase::Send(std::string_view text, bool should_log,
+                            WebsocketChannel::SentCallback on_sent) {
   if (!is_connected()) {
     return false;
   }
 
   if (should_log) {
-    ESP_LOGI(kEspCxxTag, "Send: %.*s", text.length(), text.data());
+    ESPCXX_LOGI(kEspCxxTag, "Send: %.*s", static_cast<int>(text.length()), text.data());
   }
 
-  websocket_.SendText(text);
+  websocket_.SendText(text, std::move(on_sent));
   return true;
 }
 
+void FirebaseDatabase::SendPut(const std::string& path, cJSON* value) {
+  unique_cJSON_ptr command(cJSON_CreateObject());
+  cJSON_AddStringToObject(command.get(), "p", path.c_str());
+  cJSON_AddItemToObject(command.get(), "d",
+                        value ? cJSON_Duplicate(value, true) : cJSON_CreateNull());
+  WrapDataCommand("p", &command);
+
+  // Put commands are idempotent so resending the latest value for a path
+  // covers every update lost on the way, and repeated updates merge.
+  auto on_sent = [this, path](bool sent) {
+    if (!sent) {
+      dirty_paths_.insert(path);
+    }
+  };
+  if (!Send(PrintJson(command.get()).get(), true, on_sent)) {
+    dirty_paths_.insert(path);
+  }
+}
+
+void FirebaseDatabase::SendDirtyPaths() {
+  if (!is_connected() || dirty_paths_.empty()) {
+    return;
+  }
+
+  // Paths that fail again are marked dirty in the fresh set.
+  std::set<std::string> paths;
+  paths.swap(dirty_paths_);
+  ESP_LOGI(kEspCxxTag, "Resending %d dirty paths", static_cast<int>(paths.size()));
+  for (const std::string& path : paths) {
+    SendPut(path, Get(path));
+  }
+}
+
 void FirebaseDatabase::SendKeepalive(int generation) {
   if (connect_generation_ != generation) {
     // This has been cancelled.
@@ -378,6 +418,7 @@ void FirebaseDatabase::SendAuthentication(int generation) {
 
   if (firebase_id_token_url_.empty()) {
     SendListenIfNeeded();
+    SendDirtyPaths();
     return;
   }
 
@@ -467,6 +508,9 @@ void FirebaseDatabase::HandleAuth(HttpRequest request, int generation) {
   // a no-op.
   SendListenIfNeeded();
 
+  // Queued behind the auth request, so the server sees them authenticated.
+  SendDirtyPaths();
+
   // Schedule the next authentication refresh at 2 mins before expiration.
   event_manager_->RunDelayed([this, generation] {SendAuthentication(generation);},
                              (expires_in->valueint - 120) * 1000);
@@ -482,7 +526,7 @@ void FirebaseDatabase::Reconnect() {
   Disconnect();
 
   connect_state_ = kReconnectingBit;
-  int next_reconnect = backoff_.MsToNextTry();
+  int next_reconnect = RetryBudget::ReserveShared(backoff_.MsToNextTry());
   ESP_LOGI(kEspCxxTag, "Reconnecting WS in %d", next_reconnect);
   event_manager_->RunDelayed([this] { Connect(); }, next_reconnect);
 }
@@ -1,9 +1,22 @@
 #include "esp_cxx/httpd/config_endpoint.h"
+
+#include "esp_cxx/httpd/json_response.h"
 #include "esp_cxx/logging.h"
 #include "esp_cxx/cpointer.h"
 
 namespace esp_cxx {
 
+namespace {
+// POSTs are parsed in one piece. Far more than any real config.
+constexpr size_t kMaxConfigBodySize = 4096;
+}  // namespace
+
+ConfigEndpoint::ConfigEndpoint() {
+  set_max_body_size(kMaxConfigBodySize);
+  // The parsed POST body and the reply are request-scoped.
+  set_use_arena(true);
+}
+
 void ConfigEndpoint::OnHttp(HttpRequest request, HttpResponse response) {
   if (request.method() == HttpMethod::kGet) {
     OnGet(request, response);
@@ -15,9 +28,12 @@ void ConfigEndpoint::OnHttp(HttpRequest request, HttpResponse response) {
 }
 
 void ConfigEndpoint::OnGet(HttpRequest request, HttpResponse response) {
-  auto result_str = PrintJson(config_store_.GetAllValues().get());
-  response.Send(200, strlen(result_str.get()), HttpResponse::kContentTypeJson,
-                result_str.get());
+  JsonResponse json(request, response);
+  json.BeginObject();
+  config_store_.ForEachValue([&json](const char* full_key, std::string_view value) {
+    json.Key(full_key).String(value);
+  });
+  json.EndObject();
 }
 
 void ConfigEndpoint::OnPost(HttpRequest request, HttpResponse response) {
@@ -57,6 +73,14 @@ void ConfigEndpoint::OnPost(HttpRequest request, HttpResponse response) {
         ESP_LOGI(kEspCxxTag, "Set %s = %s", full_key, entry->valuestring);
         cJSON_AddStringToObject(result.get(), full_key, entry->valuestring);
         config_store_.SetValue(prefix->valuestring, entry->string, entry->valuestring);
+
+        // Log levels take effect immediately rather than on next boot.
+        if (strcmp(prefix->valuestring, kLogLevelConfigPrefix) == 0) {
+          auto level = ParseLogLevel(entry->valuestring);
+          if (level) {
+            SetLogLevel(entry->string, level.value());
+          }
+        }
       }
     }
   }
@@ -1,11 +1,29 @@
 #include "esp_cxx/httpd/connection.h"
 
+#include <algorithm>
+
+#include <errno.h>
+#include <sys/socket.h>
+
 #include "esp_cxx/httpd/mongoose_event_manager.h"
 
 #include "esp_cxx/logging.h"
 
 namespace esp_cxx {
 
+namespace {
+
+// One spare byte shows a datagram was longer than kMaxDatagramSize.
+constexpr size_t kRecvSlotSize = Connection::kMaxDatagramSize + 1;
+
+#ifdef FAKE_ESP_IDF
+constexpr size_t kRecvPoolSize = Connection::kRecvBatchSize;
+#else
+constexpr size_t kRecvPoolSize = 1;
+#endif
+
+}  // namespace
+
 Connection::Connection(MongooseEventManager *event_manager,
                        std::function<void(std::string_view)> on_packet)
   : event_manager_(event_manager),
@@ -26,6 +44,7 @@ void Connection::OnEventThunk(struct mg_connection *nc, int event,
 }
 
 bool Connection::Connect(const std::string& udp_url) {
+  connected_ = false;
   connection_ = mg_connect(event_manager_->underlying_manager(),
                            udp_url.c_str(), &OnEventThunk, this);
   return !!connection_;
@@ -37,7 +56,118 @@ void Connection::Send(std::string_view data) {
     return;
   }
 
-  mg_send(connection_, data.data(), data.size());
+  if (send_count_ == kSendBatchSize) {
+    Flush();
+    if (send_count_ == kSendBatchSize) {
+      // Still connecting.
+      dropped_datagrams_++;
+      return;
+    }
+  }
+  send_buffer_.append(data.data(), data.size());
+  send_sizes_[send_count_++] = data.size();
+}
+
+void Connection::Flush() {
+  if (!connection_ || !connected_ || send_count_ == 0) {
+    return;
+  }
+
+  // UDP is lossy anyway, so a full socket buffer drops the rest of the
+  // batch rather than holding it.
+  size_t sent = 0;
+#ifdef FAKE_ESP_IDF
+  mmsghdr messages[kSendBatchSize] = {};
+  iovec iovecs[kSendBatchSize];
+  size_t offset = 0;
+  for (size_t i = 0; i < send_count_; ++i) {
+    iovecs[i].iov_base = &send_buffer_[offset];
+    iovecs[i].iov_len = send_sizes_[i];
+    offset += send_sizes_[i];
+    messages[i].msg_hdr.msg_name = &connection_->sa;
+    messages[i].msg_hdr.msg_namelen = sizeof(connection_->sa.sin);
+    messages[i].msg_hdr.msg_iov = &iovecs[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+  int result = sendmmsg(connection_->sock, messages, send_count_, MSG_DONTWAIT);
+  if (result > 0) {
+    sent = result;
+  }
+#else
+  const char* data = send_buffer_.data();
+  for (; sent < send_count_; ++sent) {
+    if (sendto(connection_->sock, data, send_sizes_[sent], MSG_DONTWAIT,
+               &connection_->sa.sa, sizeof(connection_->sa.sin)) < 0) {
+      break;
+    }
+    data += send_sizes_[sent];
+  }
+#endif
+  if (sent < send_count_) {
+    ESPCXX_LOGD(kEspCxxTag, "UDP send dropped %d datagrams: %d",
+                static_cast<int>(send_count_ - sent), errno);
+    dropped_datagrams_ += send_count_ - sent;
+  }
+  send_buffer_.clear();
+  send_count_ = 0;
+}
+
+void Connection::OnRecv(struct mg_connection *nc, int size) {
+  // Each datagram is removed once handled, so the one just read is all of
+  // |recv_mbuf|. Checked anyway in case an earlier one was left behind.
+  size_t len = std::min<size_t>(size, nc->recv_mbuf.len);
+  if (on_packet_) {
+    on_packet_({nc->recv_mbuf.buf + nc->recv_mbuf.len - len, len});
+  }
+  mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+
+  ReadMore(nc);
+}
+
+void Connection::ReadMore(struct mg_connection *nc) {
+  if (!recv_pool_) {
+    recv_pool_.reset(new char[kRecvPoolSize * kRecvSlotSize]);
+  }
+
+  // mongoose read one datagram this poll. Take what else is waiting, up to
+  // a batch, so a burst is not spread over one poll per datagram.
+  size_t remaining = kRecvBatchSize - 1;
+  while (remaining > 0 && connection_ == nc) {
+#ifdef FAKE_ESP_IDF
+    mmsghdr messages[kRecvPoolSize] = {};
+    iovec iovecs[kRecvPoolSize];
+    for (size_t i = 0; i < remaining; ++i) {
+      iovecs[i].iov_base = &recv_pool_[i * kRecvSlotSize];
+      iovecs[i].iov_len = kRecvSlotSize;
+      messages[i].msg_hdr.msg_iov = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int received = recvmmsg(nc->sock, messages, remaining, MSG_DONTWAIT, nullptr);
+    if (received <= 0) {
+      return;
+    }
+    for (int i = 0; i < received; ++i) {
+      if (messages[i].msg_len > kMaxDatagramSize) {
+        dropped_datagrams_++;
+      } else if (on_packet_) {
+        on_packet_({&recv_pool_[i * kRecvSlotSize], messages[i].msg_len});
+      }
+    }
+    remaining -= received;
+#else
+    // LWIP has no recvmmsg().
+    int received = recv(nc->sock, recv_pool_.get(), kRecvSlotSize, MSG_DONTWAIT);
+    if (received < 0) {
+      return;
+    }
+    if (static_cast<size_t>(received) > kMaxDatagramSize) {
+      dropped_datagrams_++;
+    } else if (on_packet_) {
+      on_packet_({recv_pool_.get(), static_cast<size_t>(received)});
+    }
+    remaining--;
+#endif
+  }
 }
 
 void Connection::OnEvent(struct mg_connection *nc, int event, void *ev_data) {
@@ -46,19 +176,26 @@ void Connection::OnEvent(struct mg_connection *nc, int event, void *ev_data) {
       int status = *((int *) ev_data);
       if (status != 0) {
         ESP_LOGW(kEspCxxTag, "UDP Connect error: %d", status);
+      } else {
+        connected_ = true;
+        Flush();
       }
       break;
     }
 
-    case MG_EV_RECV: {
-      if (on_packet_) {
-        on_packet_({nc->recv_mbuf.buf, nc->recv_mbuf.len});
-      }
+    case MG_EV_RECV:
+      OnRecv(nc, *static_cast<int*>(ev_data));
+      // Replies queued by |on_packet_| go out together.
+      Flush();
+      break;
+
+    case MG_EV_POLL:
+      Flush();
       break;
-    }
 
     case MG_EV_CLOSE: {
       connection_ = nullptr;
+      connected_ = false;
       break;
     }
   }
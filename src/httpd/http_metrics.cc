@@ -0,0 +1,228 @@
+#include "esp_cxx/httpd/http_metrics.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include "esp_cxx/json_writer.h"
+
+#ifndef FAKE_ESP_IDF
+#include "esp_timer.h"
+#else
+#include <chrono>
+#endif
+
+namespace esp_cxx {
+
+namespace {
+
+constexpr const char* kStatusClasses[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+constexpr const char* kPhaseNames[] = {"parse", "handler", "flush"};
+
+// Collects formatted lines and hands them to a sink in pieces of at most
+// kSize bytes, so an HttpResponse sink gets a few chunks instead of one
+// per line.
+class LineBuffer {
+ public:
+  explicit LineBuffer(const std::function<void(std::string_view)>& sink)
+    : sink_(sink) {
+  }
+
+  ~LineBuffer() { Flush(); }
+
+  void Printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char line[kSize / 2];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len < 0) {
+      return;
+    }
+    len = std::min<int>(len, sizeof(line) - 1);
+
+    if (len_ + len > kSize) {
+      Flush();
+    }
+    memcpy(&buffer_[len_], line, len);
+    len_ += len;
+  }
+
+  void Flush() {
+    if (len_ > 0) {
+      sink_({buffer_, len_});
+      len_ = 0;
+    }
+  }
+
+ private:
+  static constexpr size_t kSize = 512;
+
+  const std::function<void(std::string_view)>& sink_;
+  char buffer_[kSize];
+  size_t len_ = 0;
+};
+
+}  // namespace
+
+HttpMetrics::HttpMetrics() {
+  // std::atomic has no value-initializing default constructor before
+  // C++20.
+  for (Route& route : routes_) {
+    route.name[0] = '\0';
+    route.requests = 0;
+    for (Counter& counter : route.status_classes) {
+      counter = 0;
+    }
+    route.bytes_in = 0;
+    route.bytes_out = 0;
+    for (Histogram& histogram : route.latency) {
+      for (Counter& counter : histogram.buckets) {
+        counter = 0;
+      }
+      histogram.sum_us = 0;
+    }
+  }
+  strcpy(routes_[0].name, "other");
+}
+
+int HttpMetrics::AddRoute(std::string_view pattern) {
+  // Truncated and with anything that would need escaping in a Prometheus
+  // label replaced, so names can be written out verbatim.
+  char name[kMaxRouteName];
+  size_t len = std::min(pattern.size(), kMaxRouteName - 1);
+  for (size_t i = 0; i < len; ++i) {
+    char c = pattern[i];
+    name[i] = (c == '"' || c == '\\' || c < 0x20) ? '_' : c;
+  }
+  name[len] = '\0';
+
+  for (int i = 1; i < num_routes_; ++i) {
+    if (strcmp(routes_[i].name, name) == 0) {
+      return i;
+    }
+  }
+
+  if (num_routes_ == kMaxRoutes) {
+    return 0;
+  }
+  strcpy(routes_[num_routes_].name, name);
+  return num_routes_++;
+}
+
+void HttpMetrics::RecordRequest(int route, int status, uint32_t bytes_in) {
+  Route& entry = routes_[route];
+  Add(&entry.requests, 1);
+  int status_class = status / 100 - 1;
+  if (status_class >= 0 && status_class < 5) {
+    Add(&entry.status_classes[status_class], 1);
+  }
+  Add(&entry.bytes_in, bytes_in);
+}
+
+void HttpMetrics::RecordBytesOut(int route, uint32_t bytes) {
+  Add(&routes_[route].bytes_out, bytes);
+}
+
+void HttpMetrics::RecordLatency(int route, Phase phase, uint32_t latency_us) {
+  Histogram& histogram = routes_[route].latency[phase];
+  int bucket = 0;
+  while (bucket < kNumBuckets && latency_us > (kFirstBucketUs << bucket)) {
+    bucket++;
+  }
+  Add(&histogram.buckets[bucket], 1);
+  Add(&histogram.sum_us, latency_us);
+}
+
+void HttpMetrics::WriteJson(JsonWriter* json) const {
+  json->BeginArray();
+  for (int i = 0; i < num_routes_; ++i) {
+    const Route& route = routes_[i];
+    json->BeginObject();
+    json->Key("route").String(route.name);
+    json->Key("requests").Uint(Load(route.requests));
+    for (int status_class = 0; status_class < 5; ++status_class) {
+      json->Key(kStatusClasses[status_class])
+          .Uint(Load(route.status_classes[status_class]));
+    }
+    json->Key("bytes_in").Uint(Load(route.bytes_in));
+    json->Key("bytes_out").Uint(Load(route.bytes_out));
+
+    for (int phase = 0; phase < kNumPhases; ++phase) {
+      const Histogram& histogram = route.latency[phase];
+      json->Key(kPhaseNames[phase]).BeginObject();
+      json->Key("sum_us").Uint(Load(histogram.sum_us));
+      // Non-cumulative counts. Bucket i is <= kFirstBucketUs << i.
+      json->Key("buckets").BeginArray();
+      for (const Counter& counter : histogram.buckets) {
+        json->Uint(Load(counter));
+      }
+      json->EndArray();
+      json->EndObject();
+    }
+    json->EndObject();
+  }
+  json->EndArray();
+}
+
+void HttpMetrics::WritePrometheus(
+    const std::function<void(std::string_view)>& sink) const {
+  LineBuffer out(sink);
+
+  out.Printf("# TYPE espcxx_http_requests_total counter\n");
+  for (int i = 0; i < num_routes_; ++i) {
+    for (int status_class = 0; status_class < 5; ++status_class) {
+      out.Printf("espcxx_http_requests_total{route=\"%s\",code=\"%s\"} %" PRIu32 "\n",
+                 routes_[i].name, kStatusClasses[status_class],
+                 Load(routes_[i].status_classes[status_class]));
+    }
+  }
+
+  out.Printf("# TYPE espcxx_http_request_bytes_total counter\n");
+  for (int i = 0; i < num_routes_; ++i) {
+    out.Printf("espcxx_http_request_bytes_total{route=\"%s\"} %" PRIu32 "\n",
+               routes_[i].name, Load(routes_[i].bytes_in));
+  }
+
+  out.Printf("# TYPE espcxx_http_response_bytes_total counter\n");
+  for (int i = 0; i < num_routes_; ++i) {
+    out.Printf("espcxx_http_response_bytes_total{route=\"%s\"} %" PRIu32 "\n",
+               routes_[i].name, Load(routes_[i].bytes_out));
+  }
+
+  for (int phase = 0; phase < kNumPhases; ++phase) {
+    out.Printf("# TYPE espcxx_http_%s_seconds histogram\n", kPhaseNames[phase]);
+    for (int i = 0; i < num_routes_; ++i) {
+      const Histogram& histogram = routes_[i].latency[phase];
+      uint32_t cumulative = 0;
+      for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+        cumulative += Load(histogram.buckets[bucket]);
+        out.Printf("espcxx_http_%s_seconds_bucket{route=\"%s\",le=\"%g\"} %" PRIu32 "\n",
+                   kPhaseNames[phase], routes_[i].name,
+                   (kFirstBucketUs << bucket) / 1e6, cumulative);
+      }
+      cumulative += Load(histogram.buckets[kNumBuckets]);
+      out.Printf("espcxx_http_%s_seconds_bucket{route=\"%s\",le=\"+Inf\"} %" PRIu32 "\n",
+                 kPhaseNames[phase], routes_[i].name, cumulative);
+      out.Printf("espcxx_http_%s_seconds_sum{route=\"%s\"} %g\n",
+                 kPhaseNames[phase], routes_[i].name,
+                 Load(histogram.sum_us) / 1e6);
+      out.Printf("espcxx_http_%s_seconds_count{route=\"%s\"} %" PRIu32 "\n",
+                 kPhaseNames[phase], routes_[i].name, cumulative);
+    }
+  }
+}
+
+// static
+int64_t HttpMetrics::NowUs() {
+#ifndef FAKE_ESP_IDF
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+}  // namespace esp_cxx
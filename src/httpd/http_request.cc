@@ -1,34 +1,112 @@
 #include "esp_cxx/httpd/http_request.h"
 
+#include <strings.h>
+
 namespace esp_cxx {
 
 namespace {
+
+// Methods are case-sensitive. Switching on the length leaves at most two
+// candidates to compare.
 HttpMethod GetMethod(http_message* message) {
-  if (mg_vcmp(&message->method, "GET") == 0) {
-    return HttpMethod::kGet;
-  } else if (mg_vcmp(&message->method, "HEAD") == 0) {
-    return HttpMethod::kHead;
-  } else if (mg_vcmp(&message->method, "POST") == 0) {
-    return HttpMethod::kPost;
-  } else if (mg_vcmp(&message->method, "PUT") == 0) {
-    return HttpMethod::kPut;
-  } else if (mg_vcmp(&message->method, "DELETE") == 0) {
-    return HttpMethod::kDelete;
-  } else if (mg_vcmp(&message->method, "CONNECT") == 0) {
-    return HttpMethod::kConnect;
-  } else if (mg_vcmp(&message->method, "OPTIONS") == 0) {
-    return HttpMethod::kOptions;
-  } else if (mg_vcmp(&message->method, "TRACE") == 0) {
-    return HttpMethod::kTrace;
-  } else {
-    return HttpMethod::kUnknown;
+  std::string_view method = ToStringView(message->method);
+  switch (method.size()) {
+    case 3:
+      if (method == "GET") return HttpMethod::kGet;
+      if (method == "PUT") return HttpMethod::kPut;
+      break;
+    case 4:
+      if (method == "POST") return HttpMethod::kPost;
+      if (method == "HEAD") return HttpMethod::kHead;
+      break;
+    case 5:
+      if (method == "TRACE") return HttpMethod::kTrace;
+      break;
+    case 6:
+      if (method == "DELETE") return HttpMethod::kDelete;
+      break;
+    case 7:
+      if (method == "OPTIONS") return HttpMethod::kOptions;
+      if (method == "CONNECT") return HttpMethod::kConnect;
+      break;
   }
+  return HttpMethod::kUnknown;
 }
+
+bool EqualsIgnoreCase(std::string_view a, const char* b) {
+  // Callers only pass |b| of the same length as |a|.
+  return strncasecmp(a.data(), b, a.size()) == 0;
+}
+
 }  // namespace
 
+HttpHeader ClassifyHttpHeader(std::string_view name) {
+  // Length, then the first letter where lengths collide, narrows it to a
+  // single case-insensitive compare.
+  HttpHeader candidate = HttpHeader::kNumHeaders;
+  const char* expected = nullptr;
+  switch (name.size()) {
+    case 4:
+      candidate = HttpHeader::kHost;
+      expected = "Host";
+      break;
+    case 6:
+      candidate = HttpHeader::kOrigin;
+      expected = "Origin";
+      break;
+    case 7:
+      candidate = HttpHeader::kUpgrade;
+      expected = "Upgrade";
+      break;
+    case 10:
+      candidate = HttpHeader::kConnection;
+      expected = "Connection";
+      break;
+    case 12:
+      candidate = HttpHeader::kContentType;
+      expected = "Content-Type";
+      break;
+    case 13:
+      if ((name[0] | 0x20) == 'a') {
+        candidate = HttpHeader::kAuthorization;
+        expected = "Authorization";
+      } else {
+        candidate = HttpHeader::kIfNoneMatch;
+        expected = "If-None-Match";
+      }
+      break;
+    case 14:
+      candidate = HttpHeader::kContentLength;
+      expected = "Content-Length";
+      break;
+    case 15:
+      candidate = HttpHeader::kAcceptEncoding;
+      expected = "Accept-Encoding";
+      break;
+    case 17:
+      if ((name[0] | 0x20) == 's') {
+        candidate = HttpHeader::kSecWebsocketKey;
+        expected = "Sec-WebSocket-Key";
+      } else {
+        candidate = HttpHeader::kTransferEncoding;
+        expected = "Transfer-Encoding";
+      }
+      break;
+    case 24:
+      candidate = HttpHeader::kSecWebsocketExtensions;
+      expected = "Sec-WebSocket-Extensions";
+      break;
+    default:
+      return HttpHeader::kNumHeaders;
+  }
+
+  return EqualsIgnoreCase(name, expected) ? candidate : HttpHeader::kNumHeaders;
+}
+
 HttpRequest::HttpRequest(http_message* raw_message)
   : method_(GetMethod(raw_message)),
     raw_message_(raw_message) {
+  IndexHeaders();
 }
 
 std::string_view HttpRequest::header_name(int n) const {
@@ -47,5 +125,32 @@ std::string_view HttpRequest::header_value(int n) const {
   return {};
 }
 
-}  // namespace esp_cxx
+std::string_view HttpRequest::GetHeader(const char* name) const {
+  mg_str* value = mg_get_http_header(raw_message_, name);
+  return value ? ToStringView(*value) : std::string_view();
+}
+
+std::string_view HttpRequest::GetHeader(HttpHeader header) const {
+  uint8_t index = header_index_[static_cast<size_t>(header)];
+  if (index == kNotPresent) {
+    return {};
+  }
+  return ToStringView(raw_message_->header_values[index]);
+}
+
+void HttpRequest::IndexHeaders() {
+  header_index_.fill(kNotPresent);
 
+  constexpr size_t kMaxHeaders =
+      sizeof(raw_message_->header_names) / sizeof(raw_message_->header_names[0]);
+  static_assert(kMaxHeaders < kNotPresent, "Header index does not fit");
+  for (size_t i = 0; i < kMaxHeaders && raw_message_->header_names[i].len > 0; ++i) {
+    HttpHeader header = ClassifyHttpHeader(ToStringView(raw_message_->header_names[i]));
+    if (header != HttpHeader::kNumHeaders &&
+        header_index_[static_cast<size_t>(header)] == kNotPresent) {
+      header_index_[static_cast<size_t>(header)] = i;
+    }
+  }
+}
+
+}  // namespace esp_cxx
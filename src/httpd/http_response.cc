@@ -1,8 +1,11 @@
 #include "esp_cxx/httpd/http_response.h"
 
+#include "esp_cxx/httpd/http_server.h"
 #include "esp_cxx/httpd/util.h"
 #include "esp_cxx/logging.h"
 
+#include <algorithm>
+
 #include "mongoose.h"
 
 /*
@@ -24,6 +27,7 @@ namespace esp_cxx {
 constexpr char HttpResponse::kContentTypeHtml[];
 constexpr char HttpResponse::kContentTypePlain[];
 constexpr char HttpResponse::kContentTypeJson[];
+constexpr size_t HttpResponse::kSendHighWater;
 
 HttpResponse::HttpResponse(mg_connection* connection)
    : connection_(connection) {}
@@ -41,6 +45,10 @@ void HttpResponse::Send(int status_code, int64_t content_length,
 
   mg_send_head(connection_, status_code, content_length, extra_headers);
   connection_->flags |= kHeaderSentFlag;
+  HttpServer::NoteResponseStatus(connection_, status_code);
+  if (content_length < 0) {
+    connection_->flags |= kChunkedFlag;
+  }
 
   SendMore(body);
 }
@@ -52,19 +60,90 @@ void HttpResponse::SendError(int status_code, const char* text) {
   }
 
   mg_http_send_error(connection_, status_code, text);
+  connection_->flags |= kHeaderSentFlag;
+  HttpServer::NoteResponseStatus(connection_, status_code);
 }
 
-void HttpResponse::SendMore(std::string_view data) {
+bool HttpResponse::SendMore(std::string_view data) {
   if (!HasSentHeaders()) {
     ESP_LOGW(kEspCxxTag, "SendMore() before headers!");
+    return false;
+  }
+
+  if (!data.empty()) {
+    if (connection_->flags & kChunkedFlag) {
+      mg_send_http_chunk(connection_, data.data(), data.size());
+    } else {
+      mg_send(connection_, data.data(), data.size());
+    }
+  }
+  return IsWritable();
+}
+
+bool HttpResponse::IsWritable() {
+  return connection_->send_mbuf.len < kSendHighWater;
+}
+
+void HttpResponse::OnWritable(WritableCallback on_writable) {
+  if (!HasSentHeaders()) {
+    ESP_LOGW(kEspCxxTag, "OnWritable() before headers!");
     return;
   }
 
-  if (data.empty()) {
+  if (HttpServer::SetWritableCallback(connection_, &on_writable)) {
     return;
   }
 
-  mg_send(connection_, data.data(), data.size());
+  // Nothing will call back later so the body is produced now. A producer
+  // with nothing ready cannot be waited for; cut the body short rather
+  // than spin.
+  for (;;) {
+    size_t queued = connection_->send_mbuf.len;
+    if (!on_writable(*this)) {
+      return;
+    }
+    if (connection_->send_mbuf.len == queued) {
+      ESP_LOGW(kEspCxxTag, "Body producer stalled. Closing.");
+      // No last chunk, so the client can tell the body is incomplete.
+      connection_->flags &= ~kChunkedFlag;
+      connection_->flags |= MG_F_SEND_AND_CLOSE;
+      return;
+    }
+  }
+}
+
+void HttpResponse::SendFrom(BodyReader reader) {
+  OnWritable([reader = std::move(reader)](HttpResponse response) {
+    // Copied through the stack rather than reserved in the send mbuf
+    // since chunked encoding needs the length before the data.
+    char buffer[512];
+    int len = reader(buffer, sizeof(buffer));
+    if (len < 0) {
+      if (len != kEndOfBody) {
+        ESP_LOGW(kEspCxxTag, "Body reader failed: %d", len);
+        response.connection_->flags |= MG_F_CLOSE_IMMEDIATELY;
+      }
+      return false;
+    }
+    response.SendMore({buffer, std::min(static_cast<size_t>(len), sizeof(buffer))});
+    return true;
+  });
+}
+
+void HttpResponse::SendStatic(std::string_view data) {
+  OnWritable([data](HttpResponse response) mutable {
+    size_t len = std::min(data.size(), kSendHighWater);
+    response.SendMore(data.substr(0, len));
+    data.remove_prefix(len);
+    return !data.empty();
+  });
+}
+
+void HttpResponse::Finish() {
+  if (connection_->flags & kChunkedFlag) {
+    mg_send_http_chunk(connection_, "", 0);
+    connection_->flags &= ~kChunkedFlag;
+  }
 }
 
 }  // namespace esp_cxx
@@ -1,33 +1,76 @@
 #include "esp_cxx/httpd/http_server.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
 #include "esp_cxx/httpd/mongoose_event_manager.h"
 #include "esp_cxx/logging.h"
 
+#ifndef FAKE_ESP_IDF
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+#endif
+
 namespace esp_cxx {
 
+namespace {
+
+// Written straight to the socket for connections over a limit.
+constexpr char kServiceUnavailable[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "Retry-After: 1\r\n\r\n";
+
+// How soon a streaming body producer that had nothing ready is asked again.
+constexpr double kProducerRetryS = 0.01;
+
+// RFC 6455 4.2.2.
+constexpr char kWebsocketGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// Writes the Sec-WebSocket-Accept value for |key|. |accept| must hold 29
+// bytes.
+bool ComputeWebsocketAccept(std::string_view key, char* accept) {
+#ifndef FAKE_ESP_IDF
+  char input[64 + sizeof(kWebsocketGuid)];
+  if (key.size() > 64) {
+    return false;
+  }
+  memcpy(input, key.data(), key.size());
+  memcpy(input + key.size(), kWebsocketGuid, sizeof(kWebsocketGuid) - 1);
+
+  unsigned char digest[20];
+  size_t len = 0;
+  return mbedtls_sha1_ret(reinterpret_cast<unsigned char*>(input),
+                          key.size() + sizeof(kWebsocketGuid) - 1, digest) == 0 &&
+         mbedtls_base64_encode(reinterpret_cast<unsigned char*>(accept), 29, &len,
+                               digest, sizeof(digest)) == 0;
+#else
+  // No mbedtls on host builds; the extension is just not negotiated.
+  return false;
+#endif
+}
+
+}  // namespace
+
 void HttpServer::Endpoint::OnHttpEventThunk(mg_connection *new_connection, int event,
-                                            void *ev_data, void *user_data) {
-  ESP_LOGD(kEspCxxTag, "Thunked");
+                                            void *ev_data, const HttpRequest& request,
+                                            void *user_data) {
+  ESPCXX_LOGV(kEspCxxTag, "Thunked");
   Endpoint *endpoint = static_cast<Endpoint*>(user_data);
-  bool should_close = false;
   switch (event) {
     case MG_EV_HTTP_REQUEST:
-      should_close = true;
-      ESP_LOGD(kEspCxxTag, "Got request");
-      endpoint->OnHttp(
-          HttpRequest(static_cast<http_message*>(ev_data)),
-          HttpResponse(new_connection));
+      ESPCXX_LOGD(kEspCxxTag, "Got request");
+      endpoint->OnHttp(request, HttpResponse(new_connection));
       break;
 
     case MG_EV_HTTP_MULTIPART_REQUEST:
-      endpoint->OnMultipartStart(
-          HttpRequest(static_cast<http_message*>(ev_data)),
-          HttpResponse(new_connection));
+      endpoint->OnMultipartStart(request, HttpResponse(new_connection));
       break;
 
     case MG_EV_HTTP_MULTIPART_REQUEST_END:
-      should_close = true;
-      [[fallthrough]];
     case MG_EV_HTTP_PART_BEGIN:
     case MG_EV_HTTP_PART_DATA:
     case MG_EV_HTTP_PART_END: {
@@ -38,41 +81,29 @@ void HttpServer::Endpoint::OnHttpEventThunk(mg_connection *new_connection, int e
     }
 
     case MG_EV_WEBSOCKET_HANDSHAKE_REQUEST:
-      endpoint->OnWebsocketHandshake(
-          HttpRequest(static_cast<http_message*>(ev_data)),
-          HttpResponse(new_connection));
+      endpoint->OnWebsocketHandshake(request, HttpResponse(new_connection));
       break;
 
     case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
-      endpoint->OnWebsocketHandshakeComplete(WebsocketSender(new_connection));
+      endpoint->OnWebsocketHandshakeComplete(SenderFor(new_connection));
       break;
 
     case MG_EV_WEBSOCKET_CONTROL_FRAME:
     case MG_EV_WEBSOCKET_FRAME:
       endpoint->OnWebsocketFrame(
           WebsocketFrame(static_cast<websocket_message*>(ev_data)),
-          WebsocketSender(new_connection));
+          SenderFor(new_connection));
       break;
 
     case MG_EV_CLOSE:
       if (new_connection->flags & MG_F_IS_WEBSOCKET) {
-        endpoint->OnWebsocketClosed(WebsocketSender(new_connection));
+        endpoint->OnWebsocketClosed(SenderFor(new_connection));
       }
       break;
 
     default:
-      should_close = true;
       break;
   }
-
-  if (should_close) {
-    new_connection->flags |= MG_F_SEND_AND_CLOSE;
-    HttpResponse response(new_connection);
-    if (!response.HasSentHeaders()) {
-      ESP_LOGD(kEspCxxTag, "500");
-      response.SendError(500);
-    }
-  }
 }
 
 HttpServer::HttpServer(MongooseEventManager* event_manager,
@@ -81,6 +112,16 @@ HttpServer::HttpServer(MongooseEventManager* event_manager,
     event_manager_(event_manager) {
 }
 
+void HttpServer::SetKeepAlive(int idle_timeout_s, int max_requests) {
+  idle_timeout_s_ = idle_timeout_s;
+  max_requests_per_connection_ = max_requests;
+}
+
+void HttpServer::SetConnectionLimits(int max_connections, int max_per_ip) {
+  max_connections_ = max_connections;
+  max_connections_per_ip_ = max_per_ip;
+}
+
 void HttpServer::Listen(const char* port) {
   connection_ = mg_bind(event_manager_->underlying_manager(), port, &DefaultHandlerThunk, this);
 }
@@ -91,31 +132,635 @@ void HttpServer::EnableWebsockets() {
   mg_set_protocol_http_websocket(connection_);
 }
 
-void HttpServer::RegisterEndpoint(const char* path_pattern, Endpoint* endpoint) {
-  mg_register_http_endpoint(connection_, path_pattern, &Endpoint::OnHttpEventThunk, endpoint);
+void HttpServer::RegisterEndpoint(const char* path_pattern, Endpoint* endpoint,
+                                  HttpMethodMask methods) {
+  RouteTarget target;
+  target.endpoint = endpoint;
+  target.metrics_route = metrics_.AddRoute(path_pattern);
+  routes_.Add(path_pattern, methods, target);
+}
+
+void HttpServer::RegisterEndpoint(const char* path_pattern, HttpCallback handler,
+                                  HttpMethodMask methods) {
+  RouteTarget target;
+  target.callback = handler;
+  target.metrics_route = metrics_.AddRoute(path_pattern);
+  routes_.Add(path_pattern, methods, target);
+}
+
+bool HttpServer::AdmitConnection(mg_connection* nc) {
+  uint32_t ip = nc->sa.sin.sin_addr.s_addr;
+  auto it = std::find_if(ip_counts_.begin(), ip_counts_.end(),
+                         [ip](const IpCount& entry) { return entry.ip == ip; });
+  if (num_connections_ >= max_connections_ ||
+      (it != ip_counts_.end() && it->count >= max_connections_per_ip_)) {
+    return false;
+  }
+
+  num_connections_++;
+  if (it == ip_counts_.end()) {
+    ip_counts_.push_back({ip, 1});
+  } else {
+    it->count++;
+  }
+  return true;
+}
+
+void HttpServer::ReleaseConnection(mg_connection* nc) {
+  uint32_t ip = nc->sa.sin.sin_addr.s_addr;
+  auto it = std::find_if(ip_counts_.begin(), ip_counts_.end(),
+                         [ip](const IpCount& entry) { return entry.ip == ip; });
+  num_connections_--;
+  if (it != ip_counts_.end() && --it->count == 0) {
+    *it = ip_counts_.back();
+    ip_counts_.pop_back();
+  }
+}
+
+// static
+bool HttpServer::SetTarget(ConnectionState* state, RouteTarget target) {
+  Endpoint* old_endpoint = state->target.endpoint;
+  if (old_endpoint) {
+    old_endpoint->num_connections_--;
+  }
+  state->target = {};
+
+  Endpoint* endpoint = target.endpoint;
+  if (endpoint) {
+    if (endpoint->max_connections_ &&
+        endpoint->num_connections_ >= endpoint->max_connections_) {
+      return false;
+    }
+    endpoint->num_connections_++;
+  }
+  state->target = target;
+  return true;
+}
+
+bool HttpServer::RouteRequest(mg_connection* nc, ConnectionState* state,
+                              http_message* message) {
+  // The one place the headers are indexed. Later events of this request
+  // and the endpoint use this same HttpRequest.
+  state->request = HttpRequest(message);
+  const HttpRequest& request = state->request;
+
+  // Nothing may time the connection out while a request is in progress.
+  mg_set_timer(nc, 0);
+  state->in_request = true;
+  state->num_requests++;
+  state->keep_alive = WantsKeepAlive(request) &&
+      state->num_requests < max_requests_per_connection_;
+
+  // Body bytes are added as they are delivered.
+  state->status = 0;
+  state->bytes_in = message->body.p - message->message.p;
+  state->response_recorded = false;
+  int64_t now_us = HttpMetrics::NowUs();
+  if (!state->request_start_us) {
+    // Pipelined behind the previous request so no receive marked it.
+    state->request_start_us = now_us;
+  }
+
+  auto result = routes_.Find(request.uri(), request.method());
+  state->metrics_route = result.target.metrics_route;
+  metrics_.RecordLatency(state->metrics_route, HttpMetrics::kParse,
+                         now_us - state->request_start_us);
+
+  switch (result.match) {
+    case RouteTable<RouteTarget>::Match::kFound: {
+      size_t max_body_size = MaxBodySize(result.target);
+      if (max_body_size && message->body.len != static_cast<size_t>(~0) &&
+          message->body.len > max_body_size) {
+        RejectRequest(nc, state, 413);
+        return false;
+      }
+      if (!SetTarget(state, result.target)) {
+        RejectRequest(nc, state, 503);
+        return false;
+      }
+      return true;
+    }
+
+    case RouteTable<RouteTarget>::Match::kWrongMethod: {
+      char allow[64] = "Allow: ";
+      FormatAllowedMethods(result.allowed, &allow[7], sizeof(allow) - 7);
+      mg_send_head(nc, 405, 0, allow);
+      nc->flags |= MG_F_SEND_AND_CLOSE;
+      state->status = 405;
+      RecordResponse(nc, state);
+      return false;
+    }
+
+    case RouteTable<RouteTarget>::Match::kNone:
+    default:
+      ESP_LOGI(kEspCxxTag, "HTTP received: %.*s for %.*s",
+               static_cast<int>(message->method.len), message->method.p,
+               static_cast<int>(message->uri.len), message->uri.p);
+      SendNotFound(nc);
+      state->status = 404;
+      RecordResponse(nc, state);
+      return false;
+  }
+}
+
+void HttpServer::RejectRequest(mg_connection* nc, ConnectionState* state,
+                               int status) {
+  mg_http_send_error(nc, status, nullptr);
+  state->status = status;
+  RecordResponse(nc, state);
+}
+
+void HttpServer::CheckRequestHeaders(mg_connection* nc, ConnectionState* state) {
+  http_message message;
+  if (mg_parse_http(nc->recv_mbuf.buf, nc->recv_mbuf.len, &message, 1) <= 0) {
+    return;  // Headers not complete yet.
+  }
+  state->headers_checked = true;
+
+  HttpRequest request(&message);
+  std::string_view content_length = request.GetHeader(HttpHeader::kContentLength);
+  if (content_length.empty()) {
+    return;
+  }
+  auto result = routes_.Find(request.uri(), request.method());
+  size_t max_body_size = MaxBodySize(result.target);
+  // The value is followed by "\r\n" so strtoul() stops in the buffer.
+  if (max_body_size && strtoul(content_length.data(), nullptr, 10) > max_body_size) {
+    state->metrics_route = result.target.metrics_route;
+    state->bytes_in = message.body.p - message.message.p;
+    state->response_recorded = false;
+    RejectRequest(nc, state, 413);
+    // The request will never be parsed so don't bother buffering it.
+    mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+  }
+}
+
+void HttpServer::OnHttpChunk(mg_connection* nc, ConnectionState* state,
+                             http_message* message) {
+  // Chunks are only ever taken or discarded from here on.
+  if (nc->flags & (MG_F_SEND_AND_CLOSE | MG_F_CLOSE_IMMEDIATELY)) {
+    nc->flags |= MG_F_DELETE_CHUNK;
+    return;
+  }
+  // See the pipelining case in DefaultHandlerThunk().
+  if (state->on_writable) {
+    state->keep_alive = false;
+    nc->flags |= MG_F_DELETE_CHUNK;
+    return;
+  }
+
+  if (!state->in_request) {
+    SetTarget(state, {});
+    state->body_bytes = 0;
+    if (!RouteRequest(nc, state, message)) {
+      nc->flags |= MG_F_DELETE_CHUNK;
+      return;
+    }
+  } else {
+    state->request.Rebind(message);
+  }
+
+  std::string_view chunk = ToStringView(message->body);
+  state->body_bytes += chunk.size();
+  state->bytes_in += chunk.size();
+  size_t max_body_size = MaxBodySize(state->target);
+  if (max_body_size && state->body_bytes > max_body_size) {
+    RejectRequest(nc, state, 413);
+    nc->flags |= MG_F_DELETE_CHUNK;
+    return;
+  }
+
+  Endpoint* endpoint = state->target.endpoint;
+  if (endpoint && !chunk.empty()) {
+    Arena::Scope arena_scope(ArenaFor(state));
+    if (endpoint->OnHttpChunk(state->request, chunk, HttpResponse(nc))) {
+      nc->flags |= MG_F_DELETE_CHUNK;
+    }
+  }
+}
+
+// static
+Arena* HttpServer::ArenaFor(ConnectionState* state) {
+  Endpoint* endpoint = state->target.endpoint;
+  if (!endpoint || !endpoint->use_arena_) {
+    return nullptr;
+  }
+  if (!state->arena) {
+    state->arena = std::make_unique<Arena>();
+  }
+  return state->arena.get();
+}
+
+// static
+size_t HttpServer::MaxBodySize(const RouteTarget& target) {
+  return target.endpoint ? target.endpoint->max_body_size_ : 0;
+}
+
+// static
+bool HttpServer::WantsKeepAlive(const HttpRequest& request) {
+  // HTTP/1.0 keep-alive needs a "Connection: keep-alive" response header
+  // which mg_send_head() does not write. Only bother with HTTP/1.1.
+  if (request.proto() != "HTTP/1.1") {
+    return false;
+  }
+  std::string_view connection = request.GetHeader(HttpHeader::kConnection);
+  return connection.size() != 5 || strncasecmp(connection.data(), "close", 5) != 0;
+}
+
+// static
+bool HttpServer::SetWritableCallback(mg_connection* nc,
+                                     HttpResponse::WritableCallback* on_writable) {
+  if (!nc->listener || nc->listener->handler != &DefaultHandlerThunk) {
+    return false;
+  }
+
+  ConnectionState* state = static_cast<ConnectionState*>(nc->user_data);
+  if (!state || state->on_writable) {
+    return false;
+  }
+
+  state->on_writable = std::move(*on_writable);
+  PumpResponseBody(nc, state);
+  return true;
+}
+
+// static
+void HttpServer::NoteResponseStatus(mg_connection* nc, int status) {
+  if (!nc->listener || nc->listener->handler != &DefaultHandlerThunk) {
+    return;
+  }
+
+  ConnectionState* state = static_cast<ConnectionState*>(nc->user_data);
+  if (state) {
+    state->status = status;
+  }
+}
+
+// static
+void HttpServer::PumpResponseBody(mg_connection* nc, ConnectionState* state) {
+  HttpResponse response(nc);
+  Arena::Scope arena_scope(ArenaFor(state));
+  while (state->on_writable && response.IsWritable()) {
+    size_t queued = nc->send_mbuf.len;
+    if (!state->on_writable(response)) {
+      state->on_writable = nullptr;
+    } else if (nc->send_mbuf.len == queued) {
+      // Nothing ready. Retried from MG_EV_TIMER, or MG_EV_POLL if the loop
+      // wakes sooner. The idle timer is off for the rest of the request
+      // and the timer also bounds how long mongoose sleeps.
+      mg_set_timer(nc, mg_time() + kProducerRetryS);
+      break;
+    }
+  }
+
+  if (!state->on_writable) {
+    // No retry pending. FinishRequest() arms the idle timer again.
+    mg_set_timer(nc, 0);
+    if (state->finish_deferred) {
+      state->finish_deferred = false;
+      state->server->FinishRequest(nc, state);
+    }
+  }
+}
+
+void HttpServer::FinishRequest(mg_connection* nc, ConnectionState* state) {
+  if (state->on_writable) {
+    state->finish_deferred = true;
+    // The flush time includes streaming the rest of the body.
+    RecordResponse(nc, state);
+    return;
+  }
+
+  HttpResponse response(nc);
+  if (!response.HasSentHeaders()) {
+    ESP_LOGD(kEspCxxTag, "500");
+    response.SendError(500);
+  }
+  response.Finish();
+  RecordResponse(nc, state);
+
+  // Errors sent via mg_http_send_error() already close the connection.
+  if (!state->keep_alive || (nc->flags & MG_F_SEND_AND_CLOSE)) {
+    nc->flags |= MG_F_SEND_AND_CLOSE;
+    return;
+  }
+
+  // Ready for the next request, which may already be buffered if the
+  // client is pipelining.
+  nc->flags &= ~(kHeaderSentFlag | kChunkedFlag);
+  SetTarget(state, {});
+  if (state->arena) {
+    state->arena->Reset();
+  }
+  state->in_request = false;
+  state->headers_checked = false;
+  state->body_bytes = 0;
+  mg_set_timer(nc, mg_time() + idle_timeout_s_);
+}
+
+void HttpServer::RecordResponse(mg_connection* nc, ConnectionState* state) {
+  if (state->response_recorded) {
+    return;
+  }
+  state->response_recorded = true;
+
+  metrics_.RecordRequest(state->metrics_route, state->status, state->bytes_in);
+  state->request_start_us = 0;
+  state->flush_route = state->metrics_route;
+  state->flush_start_us = HttpMetrics::NowUs();
+  CheckResponseFlushed(nc, state);
+}
+
+void HttpServer::CheckResponseFlushed(mg_connection* nc, ConnectionState* state) {
+  if (state->flush_route < 0 || nc->send_mbuf.len > 0 || state->on_writable) {
+    return;
+  }
+
+  metrics_.RecordLatency(state->flush_route, HttpMetrics::kFlush,
+                         HttpMetrics::NowUs() - state->flush_start_us);
+  state->flush_route = -1;
+}
+
+void HttpServer::SendNotFound(mg_connection* nc) {
+  if (resp404_html_.empty()) {
+    mg_http_send_error(nc, 404, nullptr);
+  } else {
+    mg_send_head(nc, 404, resp404_html_.size(), HttpResponse::kContentTypeHtml);
+    mg_send(nc, resp404_html_.data(), resp404_html_.size());
+  }
+  nc->flags |= MG_F_SEND_AND_CLOSE;
 }
 
 void HttpServer::DefaultHandlerThunk(struct mg_connection *nc,
                                      int event,
                                      void *event_data,
                                      void* user_data) {
-  HttpServer* self = static_cast<HttpServer*>(user_data);
+  // The listening connection itself keeps the HttpServer as user_data.
+  if (!nc->listener) {
+    return;
+  }
+
+  // Accepted connections inherit the listener's user_data. Swap it out for
+  // per-connection state.
+  if (event == MG_EV_ACCEPT) {
+    HttpServer* self = static_cast<HttpServer*>(nc->user_data);
+    ConnectionState* state = new ConnectionState{self};
+    nc->user_data = state;
+    if (!self->AdmitConnection(nc)) {
+      // Skip the HTTP parser entirely. Received bytes come straight here
+      // and are dropped.
+      state->rejected = true;
+      self->metrics_.RecordRequest(0, 503, 0);
+      nc->proto_handler = nullptr;
+      mg_send(nc, kServiceUnavailable, sizeof(kServiceUnavailable) - 1);
+      nc->flags |= MG_F_SEND_AND_CLOSE;
+      return;
+    }
+    mg_set_timer(nc, mg_time() + self->idle_timeout_s_);
+    return;
+  }
+
+  ConnectionState* state = static_cast<ConnectionState*>(nc->user_data);
+  if (state->rejected) {
+    if (event == MG_EV_RECV) {
+      mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+    } else if (event == MG_EV_CLOSE) {
+      nc->user_data = nullptr;
+      delete state;
+    }
+    return;
+  }
+
+  // A compressed frame is swapped for its inflated form. Both outlive the
+  // dispatch to the endpoint below.
+  std::string inflated;
+  websocket_message inflated_message;
+
   switch (event) {
-    case MG_EV_HTTP_REQUEST:
-    case MG_EV_HTTP_MULTIPART_REQUEST: {
-      http_message* message = static_cast<http_message*>(event_data);
-      ESP_LOGI(kEspCxxTag, "HTTP received: %.*s for %.*s",
-               message->method.len, message->method.p, message->uri.len, message->uri.p);
-      if (self->resp404_html_.empty()) {
-        mg_http_send_error(nc, 404, nullptr);
-      } else {
-        mg_send_head(nc, 404, self->resp404_html_.size(),
-                     HttpResponse::kContentTypeHtml);
-        mg_send(nc, self->resp404_html_.data(), self->resp404_html_.size());
+    case MG_EV_RECV:
+      if (!state->in_request && !(nc->flags & MG_F_IS_WEBSOCKET)) {
+        // Headers or a buffered body still arriving. Mongoose only reports
+        // the request once all of it is in, so the idle timeout counts
+        // from the last bytes received rather than from the last request.
+        mg_set_timer(nc, mg_time() + state->server->idle_timeout_s_);
+        if (!state->request_start_us) {
+          state->request_start_us = HttpMetrics::NowUs();
+        }
+        if (!state->headers_checked) {
+          state->server->CheckRequestHeaders(nc, state);
+        }
       }
-      nc->flags |= MG_F_SEND_AND_CLOSE;
+      return;
+
+    case MG_EV_SEND: {
+      int sent = *static_cast<int*>(event_data);
+      if (sent > 0) {
+        state->server->metrics_.RecordBytesOut(
+            state->flush_route >= 0 ? state->flush_route : state->metrics_route,
+            sent);
+      }
+      if (state->on_writable) {
+        PumpResponseBody(nc, state);
+      }
+      state->server->CheckResponseFlushed(nc, state);
+      if ((nc->flags & MG_F_IS_WEBSOCKET) && state->target.endpoint) {
+        state->target.endpoint->OnWebsocketWritable(SenderFor(nc));
+      }
+      return;
     }
+
+    case MG_EV_POLL:
+      // Retries a producer that had nothing ready. MG_EV_SEND covers the
+      // case where it is waiting on the socket.
+      if (state->on_writable && nc->send_mbuf.len == 0) {
+        PumpResponseBody(nc, state);
+        state->server->CheckResponseFlushed(nc, state);
+      }
+      return;
+
+    case MG_EV_HTTP_CHUNK:
+      state->server->OnHttpChunk(nc, state, static_cast<http_message*>(event_data));
+      return;
+
+    case MG_EV_HTTP_REQUEST:
+    case MG_EV_HTTP_MULTIPART_REQUEST:
+    case MG_EV_WEBSOCKET_HANDSHAKE_REQUEST:
+      // Pipelined requests after one that closes the connection are
+      // dropped rather than answered out of turn.
+      if (nc->flags & (MG_F_SEND_AND_CLOSE | MG_F_CLOSE_IMMEDIATELY)) {
+        return;
+      }
+      // A pipelined request while the last response is still streaming.
+      // Close once that finishes; the client retries unanswered requests.
+      if (state->on_writable) {
+        state->keep_alive = false;
+        return;
+      }
+      // Already routed by its first chunk.
+      if (event == MG_EV_HTTP_REQUEST && state->in_request) {
+        state->request.Rebind(static_cast<http_message*>(event_data));
+        break;
+      }
+      SetTarget(state, {});
+      if (!state->server->RouteRequest(nc, state,
+                                       static_cast<http_message*>(event_data))) {
+        return;
+      }
+      if (event == MG_EV_HTTP_REQUEST) {
+        state->bytes_in += static_cast<http_message*>(event_data)->body.len;
+      }
+      break;
+
+    case MG_EV_HTTP_MULTIPART_REQUEST_END:
+    case MG_EV_HTTP_PART_BEGIN:
+    case MG_EV_HTTP_PART_DATA:
+    case MG_EV_HTTP_PART_END:
+      if (!state->target.endpoint && !state->target.callback) {
+        // Request was rejected while routing.
+        return;
+      }
+      if (event == MG_EV_HTTP_PART_DATA) {
+        state->bytes_in += static_cast<mg_http_multipart_part*>(event_data)->data.len;
+      }
+      break;
+
+    case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
+    case MG_EV_WEBSOCKET_CONTROL_FRAME:
+      break;
+
+    case MG_EV_WEBSOCKET_FRAME:
+      if (static_cast<websocket_message*>(event_data)->flags & kWebsocketCompressedFlag) {
+        inflated_message = *static_cast<websocket_message*>(event_data);
+        if (!InflateFrame(nc, state, &inflated_message, &inflated)) {
+          return;
+        }
+        event_data = &inflated_message;
+      }
+      break;
+
+    case MG_EV_TIMER:
+      if (state->on_writable) {
+        PumpResponseBody(nc, state);
+        state->server->CheckResponseFlushed(nc, state);
+        return;
+      }
+      // Idle timeout. Websockets manage their own lifetime.
+      if (!(nc->flags & MG_F_IS_WEBSOCKET)) {
+        nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+      }
+      return;
+
+    case MG_EV_CLOSE:
+      if (state->target.endpoint) {
+        Arena::Scope arena_scope(
+            (nc->flags & MG_F_IS_WEBSOCKET) ? nullptr : ArenaFor(state));
+        Endpoint::OnHttpEventThunk(nc, event, event_data, state->request,
+                                   state->target.endpoint);
+      }
+      SetTarget(state, {});
+      state->server->ReleaseConnection(nc);
+      nc->user_data = nullptr;
+      delete state;
+      return;
+
+    default:
+      // Transport events (MG_EV_SEND, MG_EV_POLL, ...) are not for endpoints.
+      return;
+  }
+
+  HttpServer* self = state->server;
+  bool finishes_request =
+      event == MG_EV_HTTP_REQUEST || event == MG_EV_HTTP_MULTIPART_REQUEST_END;
+  int64_t handler_start_us = HttpMetrics::NowUs();
+  if (state->target.endpoint) {
+    // The arena is only reset between requests, which a websocket never
+    // reaches, so its events would grow it until the connection closes.
+    bool websocket = (nc->flags & MG_F_IS_WEBSOCKET) ||
+        event == MG_EV_WEBSOCKET_HANDSHAKE_REQUEST;
+    Arena::Scope arena_scope(websocket ? nullptr : ArenaFor(state));
+    Endpoint::OnHttpEventThunk(nc, event, event_data, state->request,
+                               state->target.endpoint);
+  } else if (state->target.callback && event == MG_EV_HTTP_REQUEST) {
+    state->target.callback(state->request, HttpResponse(nc));
+  } else if (state->target.callback) {
+    // Function handlers cannot take multipart or websocket requests.
+    SetTarget(state, {});
+    HttpResponse(nc).SendError(400);
+    self->RecordResponse(nc, state);
+    return;
+  } else {
+    return;
+  }
+
+  if (event == MG_EV_WEBSOCKET_HANDSHAKE_REQUEST) {
+    NegotiateWebsocketDeflate(nc, state);
+  }
+
+  if (finishes_request) {
+    self->metrics_.RecordLatency(state->metrics_route, HttpMetrics::kHandler,
+                                 HttpMetrics::NowUs() - handler_start_us);
+    self->FinishRequest(nc, state);
+  }
+}
+
+// static
+WebsocketSender HttpServer::SenderFor(mg_connection* nc) {
+  ConnectionState* state = static_cast<ConnectionState*>(nc->user_data);
+  return WebsocketSender(nc, state ? state->deflate_window_bits : 0);
+}
+
+// static
+void HttpServer::NegotiateWebsocketDeflate(mg_connection* nc, ConnectionState* state) {
+  // Mongoose only sends its own handshake response if the endpoint has not
+  // written anything, such as a rejection, already.
+  if (!state->target.endpoint || !state->target.endpoint->websocket_deflate_ ||
+      nc->send_mbuf.len > 0 ||
+      (nc->flags & (MG_F_SEND_AND_CLOSE | MG_F_CLOSE_IMMEDIATELY))) {
+    return;
+  }
+
+  const HttpRequest& request = state->request;
+  char extensions[128];
+  int window_bits = AcceptWebsocketDeflateOffer(
+      request.GetHeader(HttpHeader::kSecWebsocketExtensions), extensions,
+      sizeof(extensions));
+  char accept[29];
+  if (!window_bits ||
+      !ComputeWebsocketAccept(request.GetHeader(HttpHeader::kSecWebsocketKey), accept)) {
+    return;
+  }
+
+  // Same response mongoose would send, plus the extension.
+  mg_printf(nc, "HTTP/1.1 101 Switching Protocols\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n");
+  std::string_view protocol = request.GetHeader("Sec-WebSocket-Protocol");
+  if (!protocol.empty()) {
+    mg_printf(nc, "Sec-WebSocket-Protocol: %.*s\r\n",
+              static_cast<int>(protocol.size()), protocol.data());
+  }
+  mg_printf(nc, "Sec-WebSocket-Accept: %s\r\n"
+                "Sec-WebSocket-Extensions: %s\r\n\r\n",
+            accept, extensions);
+  state->deflate_window_bits = window_bits;
+}
+
+// static
+bool HttpServer::InflateFrame(mg_connection* nc, ConnectionState* state,
+                              websocket_message* message, std::string* storage) {
+  if (!state->deflate_window_bits ||
+      !InflateWebsocketMessage({reinterpret_cast<char*>(message->data), message->size},
+                               storage)) {
+    ESP_LOGW(kEspCxxTag, "WS bad compressed frame");
+    // 1007: Invalid frame payload data.
+    mg_send_websocket_frame(nc, WEBSOCKET_OP_CLOSE, "\x03\xef", 2);
+    nc->flags |= MG_F_SEND_AND_CLOSE;
+    return false;
   }
+  message->data = reinterpret_cast<unsigned char*>(&(*storage)[0]);
+  message->size = storage->size();
+  message->flags &= ~kWebsocketCompressedFlag;
+  return true;
 }
 
 }  // namespace esp_cxx
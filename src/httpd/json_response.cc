@@ -0,0 +1,31 @@
+#include "esp_cxx/httpd/json_response.h"
+
+namespace esp_cxx {
+
+JsonResponse::JsonResponse(const HttpRequest& request, HttpResponse response,
+                           int status_code)
+  : JsonWriter([this](std::string_view data) {
+      if (buffered_) {
+        body_.append(data.data(), data.size());
+      } else {
+        response_.SendMore(data);
+      }
+    }),
+    response_(response),
+    status_code_(status_code),
+    buffered_(request.proto() != "HTTP/1.1") {
+  if (!buffered_) {
+    response_.Send(status_code_, -1, HttpResponse::kContentTypeJson, {});
+  }
+}
+
+JsonResponse::~JsonResponse() {
+  // Here rather than in ~JsonWriter(), which runs after the members the
+  // sink uses are gone.
+  Flush();
+  if (buffered_) {
+    response_.Send(status_code_, body_.size(), HttpResponse::kContentTypeJson, body_);
+  }
+}
+
+}  // namespace esp_cxx
@@ -1,52 +1,44 @@
 #include "esp_cxx/httpd/log_stream_endpoint.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
 #include "esp_cxx/httpd/util.h"
 #include "esp_cxx/logging.h"
+#include "esp_cxx/task.h"
 
 namespace esp_cxx {
 
 namespace {
 
-void SendLogFrame(mg_connection* nc, int ev, void* ev_data, void* user_data) {
-  /* This should be formatted into json */
-  // Only send to marked connections.
-  if (!(nc->flags & kLogStreamFlag)) {
-    return;
-  }
-
-  switch (ev) {
-    case MG_EV_POLL: {
-      // Write a frame here.
-      size_t len = strlen(static_cast<const char*>(ev_data));
-      mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, ev_data, len);
-      break;
-    }
-
-    default:
-      // No other cases should show up.
-      break;
+// Lines in a frame, as reported in gap notices. A trailing partial line
+// counts too.
+uint32_t CountLines(std::string_view text) {
+  uint32_t lines = std::count(text.begin(), text.end(), '\n');
+  if (!text.empty() && text.back() != '\n') {
+    lines++;
   }
+  return lines;
 }
 
 }  // namespace
 
-void LogStreamEndpoint::OnWebsocketHandshake(HttpRequest request,
-                                             HttpResponse response) {
-  if (num_listeners_ >= kMaxListeners) {
-    response.SendError(503);
-  } else {
-    num_listeners_++;
-  }
+LogStreamEndpoint::LogStreamEndpoint(OverflowPolicy policy)
+  : broadcaster_(policy) {
+  set_max_connections(kMaxListeners);
+  set_websocket_deflate(true);
+  broadcaster_.set_gap_notice([](uint32_t missed, char* buffer, size_t size) {
+    int len = snprintf(buffer, size, "[logz: %" PRIu32 " log lines dropped]\n", missed);
+    return len < 0 ? 0 : std::min<size_t>(len, size - 1);
+  });
 }
 
 void LogStreamEndpoint::OnWebsocketHandshakeComplete(WebsocketSender sender) {
-  // Initialize |event_manager_| on the first successful Websocket Connection.
-  if (!event_manager_) {
-    event_manager_ = sender.connection()->mgr;
-  }
-
-  // Mark the logstream for publishing. Used in the mg_broadcast handler.
-  sender.connection()->flags |= kLogStreamFlag;
+  broadcaster_.Subscribe(sender);
 }
 
 void LogStreamEndpoint::OnWebsocketFrame(WebsocketFrame frame,
@@ -84,17 +76,125 @@ void LogStreamEndpoint::OnWebsocketFrame(WebsocketFrame frame,
 }
 
 void LogStreamEndpoint::OnWebsocketClosed(WebsocketSender sender) {
-  num_listeners_--;
-  if (num_listeners_ == 0) {
-    event_manager_ = nullptr;
-  }
+  broadcaster_.Unsubscribe(sender);
+}
+
+void LogStreamEndpoint::OnWebsocketWritable(WebsocketSender sender) {
+  broadcaster_.OnWritable(sender);
+}
+
+void LogStreamEndpoint::set_batching(size_t max_bytes, int max_delay_ms) {
+  max_batch_bytes_ = std::min(max_bytes, kMaxBatchBytes);
+  max_batch_delay_ms_ = max_delay_ms;
 }
 
 void LogStreamEndpoint::PublishLog(std::string_view log) {
-  if (event_manager_) {
-    mg_broadcast(event_manager_, &SendLogFrame,
-                 const_cast<char*>(log.data()), log.size());
+  // No logging in here. This runs from the log drain task.
+  if (broadcaster_.num_subscribers() == 0) {
+    return;
+  }
+
+  if (!event_manager_ || log.size() >= max_batch_bytes_) {
+    FlushBatch(true);
+    broadcaster_.Publish(WebsocketOpcode::kText, log, CountLines(log));
+    return;
+  }
+
+  int64_t now_ms = NowMs();
+  bool appended = false;
+  bool started = false;
+  bool full = false;
+  for (;;) {
+    {
+      std::lock_guard<Mutex> lock(batch_lock_);
+      // An overdue batch, which the timer did not get to, is sent first.
+      bool overdue = batch_len_ > 0 && now_ms - batch_start_ms_ >= max_batch_delay_ms_;
+      if (!overdue && batch_len_ + log.size() <= max_batch_bytes_) {
+        memcpy(&batch_[batch_len_], log.data(), log.size());
+        if (batch_len_ == 0) {
+          batch_start_ms_ = now_ms;
+          started = true;
+        }
+        batch_len_ += log.size();
+        full = batch_len_ == max_batch_bytes_;
+        appended = true;
+      }
+    }
+    if (appended) {
+      break;
+    }
+    FlushBatch(true);
+  }
+
+  if (full) {
+    FlushBatch(true);
+  } else if (started && !timer_pending_.exchange(true)) {
+    if (!event_manager_->RunDelayed([this] { OnBatchTimer(); }, max_batch_delay_ms_)) {
+      // No room for the timer. Send the batch now rather than leave it
+      // waiting for one that never fires.
+      timer_pending_ = false;
+      FlushBatch(true);
+    }
+  }
+}
+
+// static
+int64_t LogStreamEndpoint::NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool LogStreamEndpoint::FlushBatch(bool wait) {
+  while (flushing_.exchange(true)) {
+    if (!wait) {
+      return false;
+    }
+    // Only the log task waits, and the event pump never holds this for
+    // more than one Publish().
+    TaskRef::Delay(1);
+  }
+
+  size_t len;
+  {
+    std::lock_guard<Mutex> lock(batch_lock_);
+    len = batch_len_;
+    memcpy(flush_buffer_, batch_, len);
+    batch_len_ = 0;
+  }
+  if (len > 0) {
+    std::string_view batch(flush_buffer_, len);
+    broadcaster_.Publish(WebsocketOpcode::kText, batch, CountLines(batch));
+  }
+  flushing_ = false;
+  return true;
+}
+
+void LogStreamEndpoint::OnBatchTimer() {
+  timer_pending_ = false;
+
+  int64_t delay_ms;
+  {
+    std::lock_guard<Mutex> lock(batch_lock_);
+    if (batch_len_ == 0) {
+      return;
+    }
+    delay_ms = batch_start_ms_ + max_batch_delay_ms_ - NowMs();
+  }
+
+  // The batch in front of the timer may have been flushed for size and a
+  // newer one started since. If a flush is already running it takes the
+  // batch with it.
+  if (delay_ms > 0) {
+    if (timer_pending_.exchange(true)) {
+      return;
+    }
+    if (event_manager_->RunDelayed([this] { OnBatchTimer(); }, delay_ms)) {
+      return;
+    }
+    // Could not rearm. Flush early instead.
+    timer_pending_ = false;
   }
+  FlushBatch(false);
 }
 
 }  // namespace esp_cxx
@@ -0,0 +1,116 @@
+#include "esp_cxx/httpd/query_params.h"
+
+namespace esp_cxx {
+
+namespace {
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Decodes one character of |encoded| at |*pos| and advances past it.
+char DecodeNext(std::string_view encoded, size_t* pos) {
+  char c = encoded[*pos];
+  if (c == '+') {
+    (*pos)++;
+    return ' ';
+  }
+  if (c == '%' && *pos + 2 < encoded.size() &&
+      HexValue(encoded[*pos + 1]) >= 0 && HexValue(encoded[*pos + 2]) >= 0) {
+    char decoded = HexValue(encoded[*pos + 1]) << 4 | HexValue(encoded[*pos + 2]);
+    *pos += 3;
+    return decoded;
+  }
+  (*pos)++;
+  return c;
+}
+
+// Compares the decoded form of |encoded| to |plain| without a buffer.
+bool DecodedEquals(std::string_view encoded, std::string_view plain) {
+  size_t pos = 0;
+  for (char expected : plain) {
+    if (pos >= encoded.size() || DecodeNext(encoded, &pos) != expected) {
+      return false;
+    }
+  }
+  return pos == encoded.size();
+}
+
+}  // namespace
+
+QueryParams::Iterator::Iterator(std::string_view encoded)
+  : rest_(encoded),
+    done_(false) {
+  Advance();
+}
+
+void QueryParams::Iterator::Advance() {
+  // Skips empty pieces like the one in "a=1&&b=2".
+  while (!rest_.empty()) {
+    size_t end = rest_.find('&');
+    std::string_view piece = rest_.substr(0, end);
+    rest_.remove_prefix(end == std::string_view::npos ? rest_.size() : end + 1);
+    if (piece.empty()) {
+      continue;
+    }
+
+    size_t equals = piece.find('=');
+    if (equals == std::string_view::npos) {
+      param_ = {piece, {}};
+    } else {
+      param_ = {piece.substr(0, equals), piece.substr(equals + 1)};
+    }
+    return;
+  }
+
+  // Same state as a default constructed end().
+  rest_ = {};
+  param_ = {};
+  done_ = true;
+}
+
+std::optional<std::string_view> QueryParams::Find(std::string_view key) const {
+  for (const Param& param : *this) {
+    if (DecodedEquals(param.key, key)) {
+      return param.value;
+    }
+  }
+  return {};
+}
+
+std::optional<std::string_view> QueryParams::Get(std::string_view key,
+                                                 char* buffer, size_t size) const {
+  auto value = Find(key);
+  if (!value || !NeedsDecoding(value.value())) {
+    return value;
+  }
+  return Decode(value.value(), buffer, size);
+}
+
+// static
+std::optional<std::string_view> QueryParams::Decode(std::string_view encoded,
+                                                    char* buffer, size_t size) {
+  size_t pos = 0;
+  size_t len = 0;
+  while (pos < encoded.size()) {
+    if (len == size) {
+      return {};
+    }
+    buffer[len++] = DecodeNext(encoded, &pos);
+  }
+  return std::string_view(buffer, len);
+}
+
+// static
+bool QueryParams::NeedsDecoding(std::string_view encoded) {
+  return encoded.find_first_of("%+") != std::string_view::npos;
+}
+
+}  // namespace esp_cxx
@@ -0,0 +1,40 @@
+#include "esp_cxx/httpd/route_table.h"
+
+#include <cstdio>
+
+namespace esp_cxx {
+
+void FormatAllowedMethods(HttpMethodMask methods, char* buf, size_t size) {
+  static constexpr struct {
+    HttpMethod method;
+    const char* name;
+  } kMethodNames[] = {
+    {HttpMethod::kGet, "GET"},
+    {HttpMethod::kHead, "HEAD"},
+    {HttpMethod::kPost, "POST"},
+    {HttpMethod::kPut, "PUT"},
+    {HttpMethod::kDelete, "DELETE"},
+    {HttpMethod::kConnect, "CONNECT"},
+    {HttpMethod::kOptions, "OPTIONS"},
+    {HttpMethod::kTrace, "TRACE"},
+  };
+
+  if (size == 0) {
+    return;
+  }
+  buf[0] = '\0';
+
+  size_t len = 0;
+  for (const auto& entry : kMethodNames) {
+    if (!(methods & ToMask(entry.method)) || len >= size) {
+      continue;
+    }
+    int written = snprintf(&buf[len], size - len, "%s%s",
+                           len ? ", " : "", entry.name);
+    if (written > 0) {
+      len += written;
+    }
+  }
+}
+
+}  // namespace esp_cxx
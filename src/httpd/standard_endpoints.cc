@@ -3,7 +3,10 @@
 #include <string>
 
 #include "esp_cxx/cxx17hack.h"
+#include "esp_cxx/httpd/json_response.h"
+#include "esp_cxx/httpd/mongoose_event_manager.h"
 #include "esp_cxx/logging.h"
+#include "esp_cxx/persistent_log.h"
 #include "esp_cxx/wifi.h"
 
 #ifndef FAKE_ESP_IDF
@@ -15,38 +18,88 @@
 namespace esp_cxx {
 
 void StandardEndpoints::RegisterEndpoints(HttpServer* server) {
-  server->RegisterEndpoint("/$", index_endpoint());
-  server->RegisterEndpoint<&ResetEndpoint>("/api/reset$");
-  server->RegisterEndpoint<&StatsEndpoint>("/api/stats$");
+  constexpr HttpMethodMask kGet = ToMask(HttpMethod::kGet);
+  constexpr HttpMethodMask kHead = ToMask(HttpMethod::kHead);
+  constexpr HttpMethodMask kPost = ToMask(HttpMethod::kPost);
 
-  server->RegisterEndpoint("/api/config$", config_endpoint());
-  server->RegisterEndpoint("/api/ota$", ota_endpoint());
+  if (asset_endpoint_) {
+    // Prefix match, so it only gets paths no other endpoint claims.
+    server->RegisterEndpoint("/", asset_endpoint_.get(), kGet | kHead);
+  } else {
+    server->RegisterEndpoint("/$", index_endpoint(), kGet | kHead);
+  }
+  server->RegisterEndpoint<&ResetEndpoint>("/api/reset$", kGet | kPost);
+  stats_endpoint_.set_metrics(server->metrics());
+  stats_endpoint_.set_log_stream(log_stream_endpoint());
+  metrics_endpoint_.set_metrics(server->metrics());
+  server->RegisterEndpoint("/api/stats$", stats_endpoint(), kGet);
+  server->RegisterEndpoint("/metrics$", metrics_endpoint(), kGet);
+  server->RegisterEndpoint<&PreviousBootLogEndpoint>("/api/prevlogz$", kGet);
+
+  server->RegisterEndpoint("/api/config$", config_endpoint(), kGet | kPost);
+  server->RegisterEndpoint("/api/ota$", ota_endpoint(), kPost);
 
   server->EnableWebsockets();
-  server->RegisterEndpoint("/api/logz$", log_stream_endpoint());
+  log_stream_endpoint_.set_event_manager(server->event_manager());
+  server->RegisterEndpoint("/api/logz$", log_stream_endpoint(), kGet);
 }
 
+// Methods are filtered by the route table in RegisterEndpoints().
 void StandardEndpoints::ResetEndpoint(HttpRequest request, HttpResponse response) {
-  if (request.method() == HttpMethod::kGet ||
-      request.method() == HttpMethod::kPost) {
 #ifndef FAKE_ESP_IDF
-    esp_restart();
+  esp_restart();
 #endif
-  }
 }
 
-void StandardEndpoints::StatsEndpoint(HttpRequest request, HttpResponse response) {
-  if (request.method() == HttpMethod::kGet) {
-    unique_cJSON_ptr stats(cJSON_CreateObject());
+void StandardEndpoints::PreviousBootLogEndpoint(HttpRequest request,
+                                                HttpResponse response) {
+  std::string_view log = GetPreviousBootLog();
+  response.Send(200, log.size(), HttpResponse::kContentTypePlain, log);
+}
 
-    cJSON_AddNumberToObject(stats.get(), "free_heap_bytes", xPortGetFreeHeapSize());
-    cJSON_AddNumberToObject(stats.get(), "uptime_ms", esp_timer_get_time() / 1000);
+void StatsEndpoint::OnHttp(HttpRequest request, HttpResponse response) {
+  JsonResponse json(request, response);
+  json.BeginObject();
+  json.Key("free_heap_bytes").Uint(xPortGetFreeHeapSize());
+  json.Key("uptime_ms").Int(esp_timer_get_time() / 1000);
 
-    auto result = PrintJson(stats.get());
-    response.Send(200, strlen(result.get()), HttpResponse::kContentTypeJson, result.get());
-  } else {
-    response.SendError(400);
+  LogStats log_stats = GetLogStats();
+  json.Key("log_dropped").Uint(log_stats.dropped);
+  json.Key("log_rate_limited").Uint(log_stats.rate_limited);
+  json.Key("log_deduplicated").Uint(log_stats.deduplicated);
+  json.Key("boot_count").Uint(GetPersistentLogBootCount());
+  if (log_stream_) {
+    WebsocketBroadcaster::Stats logz = log_stream_->stats();
+    json.Key("logz_listeners").Int(log_stream_->num_listeners());
+    json.Key("logz_dropped").Uint(logz.dropped);
+    json.Key("logz_disconnected").Uint(logz.disconnected);
+  }
+  if (metrics_) {
+    json.Key("http");
+    metrics_->WriteJson(&json);
   }
+  json.EndObject();
+}
+
+void MetricsEndpoint::OnHttp(HttpRequest request, HttpResponse response) {
+  if (!metrics_) {
+    response.SendError(404);
+    return;
+  }
+
+  static constexpr char kContentType[] = "Content-Type: text/plain; version=0.0.4";
+  // As in JsonResponse, HTTP/1.0 clients cannot take a chunked body.
+  if (request.proto() != "HTTP/1.1") {
+    std::string body;
+    metrics_->WritePrometheus(
+        [&body](std::string_view data) { body.append(data.data(), data.size()); });
+    response.Send(200, body.size(), kContentType, body);
+    return;
+  }
+
+  response.Send(200, -1, kContentType, {});
+  metrics_->WritePrometheus(
+      [&response](std::string_view data) { response.SendMore(data); });
 }
 
 }  // namespace esp_cxx
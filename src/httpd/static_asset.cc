@@ -0,0 +1,141 @@
+#include "esp_cxx/httpd/static_asset.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "esp_cxx/logging.h"
+
+namespace esp_cxx {
+
+namespace {
+
+uint32_t Fnv1a(std::string_view data) {
+  uint32_t hash = 2166136261u;
+  for (char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// True if the comma separated |header| lists |token| without "q=0".
+bool HeaderHasToken(std::string_view header, std::string_view token) {
+  while (!header.empty()) {
+    size_t comma = header.find(',');
+    std::string_view item = header.substr(0, comma);
+    header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+
+    while (!item.empty() && item.front() == ' ') {
+      item.remove_prefix(1);
+    }
+    size_t semicolon = item.find(';');
+    std::string_view name = item.substr(0, semicolon);
+    while (!name.empty() && name.back() == ' ') {
+      name.remove_suffix(1);
+    }
+    if (name != token) {
+      continue;
+    }
+    size_t q = item.find("q=");
+    if (q == std::string_view::npos) {
+      return true;
+    }
+    // Values are at most "1.000" so a small copy gets NUL termination.
+    char value[8] = {};
+    item.copy(value, sizeof(value) - 1, q + 2);
+    return strtod(value, nullptr) > 0;
+  }
+  return false;
+}
+
+bool EtagMatches(std::string_view if_none_match, std::string_view etag) {
+  return if_none_match == "*" ||
+      if_none_match.find(etag) != std::string_view::npos;
+}
+
+}  // namespace
+
+std::string ComputeEtag(std::string_view data) {
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"%08x\"", Fnv1a(data));
+  return etag;
+}
+
+void ServeStaticAsset(const StaticAsset& asset, std::string_view etag,
+                      HttpRequest request, HttpResponse response) {
+  bool has_gzip = !asset.gzip_data.empty();
+  bool use_gzip = has_gzip &&
+      HeaderHasToken(request.GetHeader(HttpHeader::kAcceptEncoding), "gzip");
+  if (!use_gzip && asset.data.empty()) {
+    response.SendError(406, "gzip required");
+    return;
+  }
+
+  // The two representations differ byte for byte so they need distinct
+  // strong ETags. The suffix goes inside the closing quote.
+  char gzip_etag[32];
+  if (use_gzip) {
+    std::string_view opaque = etag;
+    if (!opaque.empty() && opaque.back() == '"') {
+      opaque.remove_suffix(1);
+    }
+    snprintf(gzip_etag, sizeof(gzip_etag), "%.*s-gz%s",
+             static_cast<int>(opaque.size()), opaque.data(),
+             opaque.size() < etag.size() ? "\"" : "");
+    etag = gzip_etag;
+  }
+
+  // Revalidate with no-cache rather than expiring. Assets change with each
+  // OTA.
+  char headers[256];
+  snprintf(headers, sizeof(headers),
+           "%s\r\nETag: %.*s\r\nCache-Control: no-cache%s%s",
+           asset.content_type, static_cast<int>(etag.size()), etag.data(),
+           has_gzip ? "\r\nVary: Accept-Encoding" : "",
+           use_gzip ? "\r\nContent-Encoding: gzip" : "");
+
+  if (EtagMatches(request.GetHeader(HttpHeader::kIfNoneMatch), etag)) {
+    response.Send(304, 0, headers, {});
+    return;
+  }
+
+  std::string_view body = use_gzip ? asset.gzip_data : asset.data;
+  response.Send(200, body.size(), headers, {});
+  if (request.method() != HttpMethod::kHead) {
+    response.SendStatic(body);
+  }
+}
+
+StaticAssetEndpoint::StaticAssetEndpoint(const StaticAsset* assets,
+                                         size_t num_assets)
+  : assets_(assets),
+    num_assets_(num_assets),
+    computed_etags_(num_assets) {
+  for (size_t i = 0; i < num_assets_; ++i) {
+    if (assets_[i].etag.empty()) {
+      computed_etags_[i] = ComputeEtag(
+          assets_[i].data.empty() ? assets_[i].gzip_data : assets_[i].data);
+    }
+  }
+}
+
+void StaticAssetEndpoint::OnHttp(HttpRequest request, HttpResponse response) {
+  std::string_view path = request.uri();
+  if (path == "/") {
+    path = "/index.html";
+  }
+
+  for (size_t i = 0; i < num_assets_; ++i) {
+    const StaticAsset& asset = assets_[i];
+    if (asset.path == path) {
+      ServeStaticAsset(asset,
+                       asset.etag.empty() ? computed_etags_[i] : asset.etag,
+                       request, response);
+      return;
+    }
+  }
+
+  response.SendError(404);
+}
+
+}  // namespace esp_cxx
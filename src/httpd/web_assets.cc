@@ -0,0 +1,18 @@
+#include "esp_cxx/httpd/web_assets.h"
+
+#ifdef ESPCXX_HAVE_WEB_ASSETS
+// Generated into the component build directory. See component.mk.
+#include "esp_cxx_web_assets.h"
+#else
+namespace esp_cxx_generated {
+constexpr esp_cxx::StaticAsset kWebAssets[] = {{}};
+}  // namespace esp_cxx_generated
+#endif
+
+namespace esp_cxx {
+
+const StaticAsset* const kWebAssets = esp_cxx_generated::kWebAssets;
+const size_t kNumWebAssets =
+    sizeof(esp_cxx_generated::kWebAssets) / sizeof(esp_cxx_generated::kWebAssets[0]);
+
+}  // namespace esp_cxx
@@ -1,11 +1,265 @@
 #include "esp_cxx/httpd/websocket.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "esp_cxx/deflate.h"
 #include "esp_cxx/httpd/mongoose_event_manager.h"
 
 #include "esp_cxx/logging.h"
 
 namespace esp_cxx {
 
+namespace {
+
+constexpr char kPermessageDeflate[] = "permessage-deflate";
+
+// Close status for a message that could not be decoded (RFC 6455 7.4.1).
+constexpr char kCloseInvalidPayload[] = "\x03\xef";
+
+std::string_view Trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// Splits off the piece of |*list| before the next |separator|.
+std::string_view NextToken(std::string_view* list, char separator) {
+  size_t end = list->find(separator);
+  std::string_view token = list->substr(0, end);
+  list->remove_prefix(end == std::string_view::npos ? list->size() : end + 1);
+  return Trim(token);
+}
+
+// One element of a Sec-WebSocket-Extensions header, as far as
+// permessage-deflate is concerned.
+struct DeflateParams {
+  bool server_no_context_takeover = false;
+  bool client_no_context_takeover = false;
+  int server_max_window_bits = 0;  // 0 if absent.
+  bool client_max_window_bits = false;
+};
+
+// Parses the parameters of a permessage-deflate element. Returns false on
+// unknown, repeated or out of range parameters.
+bool ParseDeflateParams(std::string_view params, DeflateParams* out) {
+  bool seen[4] = {};
+  while (!params.empty()) {
+    std::string_view value = NextToken(&params, ';');
+    std::string_view name = NextToken(&value, '=');
+    if (!value.empty() && value.front() == '"' && value.size() >= 2 &&
+        value.back() == '"') {
+      value = value.substr(1, value.size() - 2);
+    }
+
+    int bits = 0;
+    if (!value.empty()) {
+      if (value.size() > 2 || value.find_first_not_of("0123456789") != std::string_view::npos) {
+        return false;
+      }
+      bits = atoi(std::string(value).c_str());
+      if (bits < 8 || bits > kMaxDeflateWindowBits) {
+        return false;
+      }
+    }
+
+    int index;
+    if (name == "server_no_context_takeover" && value.empty()) {
+      index = 0;
+      out->server_no_context_takeover = true;
+    } else if (name == "client_no_context_takeover" && value.empty()) {
+      index = 1;
+      out->client_no_context_takeover = true;
+    } else if (name == "server_max_window_bits" && bits) {
+      index = 2;
+      out->server_max_window_bits = bits;
+    } else if (name == "client_max_window_bits") {
+      index = 3;
+      out->client_max_window_bits = true;
+    } else {
+      return false;
+    }
+    if (seen[index]) {
+      return false;
+    }
+    seen[index] = true;
+  }
+  return true;
+}
+
+std::string Join(const std::string_view* parts, size_t num_parts, size_t size) {
+  std::string joined;
+  joined.reserve(size);
+  for (size_t i = 0; i < num_parts; ++i) {
+    joined.append(parts[i].data(), parts[i].size());
+  }
+  return joined;
+}
+
+// Sends |parts| as one frame, compressed if |deflate_window_bits| allows it
+// and it helps. |mask_rng| is given for client connections, whose frames
+// must be masked.
+void SendMessage(mg_connection* nc, WebsocketOpcode opcode,
+                 const std::string_view* parts, size_t num_parts,
+                 int deflate_window_bits, XorShift32* mask_rng) {
+  size_t size = 0;
+  for (size_t i = 0; i < num_parts; ++i) {
+    size += parts[i].size();
+  }
+
+  bool is_data = opcode == WebsocketOpcode::kText || opcode == WebsocketOpcode::kBinary;
+  std::string compressed;
+  if (is_data && deflate_window_bits && size >= kMinWebsocketDeflateSize) {
+    // Compression makes a new buffer anyway.
+    std::string joined = Join(parts, num_parts, size);
+    if (!DeflateWebsocketMessage(joined, deflate_window_bits, &compressed)) {
+      std::string_view whole = joined;
+      SendMessage(nc, opcode, &whole, 1, 0, mask_rng);
+      return;
+    }
+  } else if (num_parts <= kMaxWebsocketFrameParts) {
+    // Mongoose masks client frames itself.
+    mg_str strings[kMaxWebsocketFrameParts];
+    for (size_t i = 0; i < num_parts; ++i) {
+      strings[i] = {parts[i].data(), parts[i].size()};
+    }
+    mg_send_websocket_framev(nc, static_cast<int>(opcode), strings, num_parts);
+    return;
+  } else {
+    std::string joined = Join(parts, num_parts, size);
+    mg_send_websocket_frame(nc, static_cast<int>(opcode), joined.data(), joined.size());
+    return;
+  }
+
+  // mg_send_websocket_frame() cannot set RSV1.
+  uint8_t header[kMaxWebsocketHeaderSize + 4];
+  size_t header_size = EncodeWebsocketHeader(opcode, compressed.size(), header,
+                                             true);
+  if (mask_rng) {
+    header[1] |= 0x80;
+    uint32_t key = mask_rng->Next();
+    memcpy(&header[header_size], &key, sizeof(key));
+    for (size_t i = 0; i < compressed.size(); ++i) {
+      compressed[i] ^= header[header_size + i % 4];
+    }
+    header_size += 4;
+  }
+  mg_send(nc, header, header_size);
+  mg_send(nc, compressed.data(), compressed.size());
+}
+
+}  // namespace
+
+size_t EncodeWebsocketHeader(WebsocketOpcode opcode, size_t payload_size,
+                             uint8_t* out, bool compressed) {
+  out[0] = 0x80 | static_cast<uint8_t>(opcode);  // FIN.
+  if (compressed) {
+    out[0] |= kWebsocketCompressedFlag;
+  }
+  if (payload_size < 126) {
+    out[1] = payload_size;
+    return 2;
+  }
+  if (payload_size <= 0xffff) {
+    out[1] = 126;
+    out[2] = payload_size >> 8;
+    out[3] = payload_size;
+    return 4;
+  }
+  out[1] = 127;
+  uint64_t size = payload_size;
+  for (int i = 0; i < 8; ++i) {
+    out[2 + i] = size >> (56 - 8 * i);
+  }
+  return 10;
+}
+
+int AcceptWebsocketDeflateOffer(std::string_view extensions,
+                                char* response, size_t response_size) {
+  // Offers are in order of preference.
+  while (!extensions.empty()) {
+    std::string_view params = NextToken(&extensions, ',');
+    if (NextToken(&params, ';') != kPermessageDeflate) {
+      continue;
+    }
+    DeflateParams offer;
+    if (!ParseDeflateParams(params, &offer)) {
+      continue;
+    }
+
+    // The client's no_context_takeover is imposed, not asked for, so that
+    // received messages never refer back to earlier ones.
+    int bits = offer.server_max_window_bits;
+    int len = snprintf(response, response_size,
+                       "%s; server_no_context_takeover; client_no_context_takeover",
+                       kPermessageDeflate);
+    if (bits) {
+      len += snprintf(response + len, response_size - len,
+                      "; server_max_window_bits=%d", bits);
+    }
+    if (len < 0 || static_cast<size_t>(len) >= response_size) {
+      return 0;
+    }
+    return bits ? bits : kMaxDeflateWindowBits;
+  }
+  return 0;
+}
+
+bool CheckWebsocketDeflateResponse(std::string_view extensions, bool* accepted) {
+  *accepted = false;
+  while (!extensions.empty()) {
+    std::string_view params = NextToken(&extensions, ',');
+    if (params.empty()) {
+      continue;
+    }
+    // Only what was offered may come back, and only once.
+    DeflateParams response;
+    if (*accepted || NextToken(&params, ';') != kPermessageDeflate ||
+        !ParseDeflateParams(params, &response) ||
+        !response.server_no_context_takeover ||
+        response.client_max_window_bits) {
+      return false;
+    }
+    *accepted = true;
+  }
+  return true;
+}
+
+bool DeflateWebsocketMessage(std::string_view data, int window_bits,
+                             std::string* out) {
+  size_t start = out->size();
+  Deflate(data, window_bits, out);
+  // The sync flush trailer is implied (RFC 7692 7.2.1).
+  out->resize(out->size() - 4);
+  if (out->size() - start >= data.size()) {
+    out->resize(start);
+    return false;
+  }
+  return true;
+}
+
+bool InflateWebsocketMessage(std::string_view data, std::string* out) {
+  std::string stream;
+  stream.reserve(data.size() + 4);
+  stream.append(data.data(), data.size());
+  stream.append("\x00\x00\xff\xff", 4);
+  return Inflate(stream, kMaxInflatedWebsocketMessage, out);
+}
+
+void WebsocketSender::SendFrame(WebsocketOpcode opcode, std::string_view data) {
+  SendMessage(connection_, opcode, &data, 1, deflate_window_bits_, nullptr);
+}
+
+void WebsocketSender::SendFrameV(WebsocketOpcode opcode,
+                                 const std::string_view* parts, size_t num_parts) {
+  SendMessage(connection_, opcode, parts, num_parts, deflate_window_bits_, nullptr);
+}
+
 WebsocketChannel::WebsocketChannel(MongooseEventManager* event_manager,
                                    const std::string& ws_url,
                                    std::function<void(WebsocketFrame)> on_frame_cb,
@@ -17,15 +271,30 @@ WebsocketChannel::WebsocketChannel(MongooseEventManager* event_manager,
 }
 
 WebsocketChannel::~WebsocketChannel() {
+  // The owner is going away too, so SentCallbacks are not run.
+  pending_sends_.clear();
+  send_queue_.clear();
+
   // TODO(awong): Will this UAF an attempt to dispatch a CLOSE message?
   Disconnect();
 }
 
 bool WebsocketChannel::Connect() {
   ESP_LOGI(kEspCxxTag, "Websocket connecting to %s", ws_url_.c_str());
+  char extra_headers[sizeof(kWebsocketDeflateOffer) + 32];
+  snprintf(extra_headers, sizeof(extra_headers),
+           "Sec-WebSocket-Extensions: %s\r\n", kWebsocketDeflateOffer);
+  deflate_window_bits_ = 0;
+  bytes_sent_ = 0;
+  open_ = false;
+  ping_sent_at_ = 0;
   connection_ = mg_connect_ws(event_manager_->underlying_manager(),
                               &WebsocketChannel::OnWsEventThunk,
-                              this, ws_url_.c_str(), NULL, NULL);
+                              this, ws_url_.c_str(), NULL,
+                              deflate_offered_ ? extra_headers : NULL);
+  if (connection_) {
+    SetTimer(handshake_timeout_ms_);
+  }
   return !!connection_;
 }
 
@@ -33,18 +302,190 @@ void WebsocketChannel::Disconnect() {
   if (connection_) {
     ESP_LOGI(kEspCxxTag, "Disconnecting");
     mg_send_websocket_frame(connection_, WEBSOCKET_OP_CLOSE, "", 0);
+    // Not left waiting for the server's close, which a dead peer never sends.
+    connection_->flags |= MG_F_SEND_AND_CLOSE;
     connection_ = nullptr;
+    open_ = false;
+    CompleteSends(true);
+    CheckHighWater();
     on_disconnect_cb_();
   }
 }
 
-void WebsocketChannel::SendText(std::string_view text) {
-  if (connection_) {
-    mg_send_websocket_frame(connection_, WEBSOCKET_OP_TEXT, text.data(), text.size());
+void WebsocketChannel::SendText(std::string_view text, SentCallback on_sent) {
+  Send(WebsocketOpcode::kText, &text, 1, std::move(on_sent));
+}
+
+void WebsocketChannel::SendBinary(const std::string_view* parts, size_t num_parts,
+                                  SentCallback on_sent) {
+  Send(WebsocketOpcode::kBinary, parts, num_parts, std::move(on_sent));
+}
+
+void WebsocketChannel::ClearSendQueue() {
+  std::deque<QueuedMessage> dropped;
+  dropped.swap(send_queue_);
+  send_queue_bytes_ = 0;
+  for (QueuedMessage& message : dropped) {
+    if (message.on_sent) {
+      message.on_sent(false);
+    }
+  }
+  CheckHighWater();
+}
+
+void WebsocketChannel::Send(WebsocketOpcode opcode, const std::string_view* parts,
+                            size_t num_parts, SentCallback on_sent) {
+  if (send_queue_.empty() && can_write()) {
+    Write(opcode, parts, num_parts, std::move(on_sent));
+    CheckHighWater();
+    return;
+  }
+
+  size_t size = 0;
+  for (size_t i = 0; i < num_parts; ++i) {
+    size += parts[i].size();
+  }
+  auto is_full = [&] {
+    return send_queue_.size() >= max_queued_messages_ ||
+           send_queue_bytes_ + size > max_queued_bytes_;
+  };
+  if (size > max_queued_bytes_ ||
+      (is_full() && overflow_policy_ == OverflowPolicy::kDropNewest)) {
+    dropped_messages_++;
+    if (on_sent) {
+      on_sent(false);
+    }
+    return;
+  }
+
+  // Taken off the queue before the callback runs since it may send more.
+  while (!send_queue_.empty() && is_full()) {
+    QueuedMessage oldest = std::move(send_queue_.front());
+    send_queue_.pop_front();
+    send_queue_bytes_ -= oldest.data.size();
+    dropped_messages_++;
+    if (oldest.on_sent) {
+      oldest.on_sent(false);
+    }
+  }
+
+  send_queue_.push_back({opcode, Join(parts, num_parts, size), std::move(on_sent)});
+  send_queue_bytes_ += size;
+  CheckHighWater();
+}
+
+void WebsocketChannel::Write(WebsocketOpcode opcode, const std::string_view* parts,
+                             size_t num_parts, SentCallback on_sent) {
+  SendMessage(connection_, opcode, parts, num_parts, deflate_window_bits_,
+              &mask_rng_);
+  if (on_sent) {
+    // Everything already in the send buffer goes out first.
+    pending_sends_.push_back({bytes_sent_ + connection_->send_mbuf.len,
+                              std::move(on_sent)});
+  }
+}
+
+void WebsocketChannel::FlushSendQueue() {
+  while (!send_queue_.empty() && can_write()) {
+    QueuedMessage message = std::move(send_queue_.front());
+    send_queue_.pop_front();
+    send_queue_bytes_ -= message.data.size();
+    std::string_view data = message.data;
+    Write(message.opcode, &data, 1, std::move(message.on_sent));
+  }
+  CheckHighWater();
+}
+
+void WebsocketChannel::CheckHighWater() {
+  if (!on_high_water_) {
+    return;
+  }
+
+  size_t waiting = send_queue_bytes_ + (connection_ ? connection_->send_mbuf.len : 0);
+  if (!above_high_water_ && waiting > high_water_) {
+    above_high_water_ = true;
+    on_high_water_(true);
+  } else if (above_high_water_ && waiting <= high_water_ / 2) {
+    above_high_water_ = false;
+    on_high_water_(false);
+  }
+}
+
+void WebsocketChannel::CompleteSends(bool connection_lost) {
+  // Callbacks may send more, so each is taken off the queue before it runs.
+  while (!pending_sends_.empty() &&
+         (connection_lost || pending_sends_.front().end <= bytes_sent_)) {
+    SentCallback on_sent = std::move(pending_sends_.front().on_sent);
+    pending_sends_.pop_front();
+    on_sent(!connection_lost);
+  }
+}
+
+void WebsocketChannel::SetTimer(int delay_ms) {
+  mg_set_timer(connection_, mg_time() + delay_ms / 1000.0);
+}
+
+void WebsocketChannel::OnTimer() {
+  if (!open_) {
+    ESP_LOGW(kEspCxxTag, "WS handshake timed out");
+    connection_->flags |= MG_F_CLOSE_IMMEDIATELY;
+    return;
+  }
+
+  if (ping_sent_at_ != 0) {
+    ESP_LOGW(kEspCxxTag, "WS pong timed out");
+    connection_->flags |= MG_F_CLOSE_IMMEDIATELY;
+    return;
+  }
+
+  // Sent past the send queue; a ping stuck behind a backed up buffer is a
+  // sign of trouble in its own right.
+  ping_sequence_++;
+  ping_sent_at_ = mg_time();
+  mg_send_websocket_frame(connection_, WEBSOCKET_OP_PING, &ping_sequence_,
+                          sizeof(ping_sequence_));
+  SetTimer(pong_timeout_ms_);
+}
+
+void WebsocketChannel::OnPong(websocket_message* message) {
+  if (ping_sent_at_ == 0 || message->size != sizeof(ping_sequence_) ||
+      memcmp(message->data, &ping_sequence_, sizeof(ping_sequence_)) != 0) {
+    return;
+  }
+
+  double now = mg_time();
+  last_rtt_ms_ = static_cast<int>((now - ping_sent_at_) * 1000);
+  if (smoothed_rtt_ms_ < 0) {
+    smoothed_rtt_ms_ = last_rtt_ms_;
+  } else {
+    smoothed_rtt_ms_ += (last_rtt_ms_ - smoothed_rtt_ms_) / 8;
+  }
+  ESPCXX_LOGD(kEspCxxTag, "WS rtt %d ms", last_rtt_ms_);
+
+  // The next ping is due an interval after this one went out.
+  mg_set_timer(connection_, ping_sent_at_ + ping_interval_ms_ / 1000.0);
+  ping_sent_at_ = 0;
+}
+
+void WebsocketChannel::OnHandshakeDone(http_message* response) {
+  if (!deflate_offered_ || !response) {
+    return;
+  }
+
+  mg_str* extensions = mg_get_http_header(response, "Sec-WebSocket-Extensions");
+  bool accepted = false;
+  if (extensions &&
+      !CheckWebsocketDeflateResponse(ToStringView(*extensions), &accepted)) {
+    ESP_LOGW(kEspCxxTag, "WS bad extensions response: %.*s",
+             static_cast<int>(extensions->len), extensions->p);
+    connection_->flags |= MG_F_CLOSE_IMMEDIATELY;
+    return;
   }
+  // Messages are compressed independently, so the full window is fine.
+  deflate_window_bits_ = accepted ? kMaxDeflateWindowBits : 0;
 }
 
-void WebsocketChannel::OnWsEvent(mg_connection *new_connection, int event, websocket_message *ev_data) {
+void WebsocketChannel::OnWsEvent(mg_connection *new_connection, int event, void *ev_data) {
   switch (event) {
     case MG_EV_CONNECT: {
       int status = *((int *) ev_data);
@@ -58,20 +499,78 @@ void WebsocketChannel::OnWsEvent(mg_connection *new_connection, int event, webso
 
     case MG_EV_WEBSOCKET_HANDSHAKE_DONE:
       ESP_LOGI(kEspCxxTag, "WS handshake done.");
-      // TODO(awong): Does there need to be a timeout on WS handshake failure?
-      // Otherwise do nothing.
+      OnHandshakeDone(static_cast<http_message*>(ev_data));
+      if (new_connection == connection_ &&
+          !(new_connection->flags & MG_F_CLOSE_IMMEDIATELY)) {
+        open_ = true;
+        if (ping_interval_ms_ > 0) {
+          SetTimer(ping_interval_ms_);
+        } else {
+          mg_set_timer(connection_, 0);
+        }
+        FlushSendQueue();
+      }
+      break;
+
+    case MG_EV_WEBSOCKET_CONTROL_FRAME: {
+      // Mongoose answers pings itself.
+      websocket_message* message = static_cast<websocket_message*>(ev_data);
+      if (new_connection == connection_ &&
+          (message->flags & 0xf) == WEBSOCKET_OP_PONG) {
+        OnPong(message);
+      }
+      break;
+    }
+
+    case MG_EV_TIMER:
+      if (new_connection == connection_) {
+        OnTimer();
+      }
       break;
 
-    case MG_EV_WEBSOCKET_FRAME:
-      ESP_LOGI(kEspCxxTag, "WS frame.");
+    case MG_EV_WEBSOCKET_FRAME: {
+      ESPCXX_LOGD(kEspCxxTag, "WS frame.");
       // Mongoose already handles merging fragmented messages. Thus a received
       // frame in mongoose IS a complete message. Pass it straight along.
-      on_frame_cb_(WebsocketFrame(static_cast<websocket_message*>(ev_data)));
+      websocket_message* message = static_cast<websocket_message*>(ev_data);
+      if (!(message->flags & kWebsocketCompressedFlag)) {
+        on_frame_cb_(WebsocketFrame(message));
+        break;
+      }
+
+      std::string inflated;
+      if (!deflate_window_bits_ ||
+          !InflateWebsocketMessage({reinterpret_cast<char*>(message->data), message->size},
+                                   &inflated)) {
+        ESP_LOGW(kEspCxxTag, "WS bad compressed frame");
+        mg_send_websocket_frame(new_connection, WEBSOCKET_OP_CLOSE,
+                                kCloseInvalidPayload, 2);
+        new_connection->flags |= MG_F_SEND_AND_CLOSE;
+        break;
+      }
+      on_frame_cb_(WebsocketFrame(inflated,
+                                  static_cast<WebsocketOpcode>(message->flags & 0xf)));
+      break;
+    }
+
+    case MG_EV_SEND:
+      if (new_connection == connection_) {
+        bytes_sent_ += *static_cast<int*>(ev_data);
+        CompleteSends(false);
+        FlushSendQueue();
+      }
       break;
 
     case MG_EV_CLOSE:
+      if (new_connection != connection_) {
+        // A connection already given up by Disconnect().
+        break;
+      }
       ESP_LOGI(kEspCxxTag, "WS closed by remote");
       connection_ = nullptr;
+      open_ = false;
+      CompleteSends(true);
+      CheckHighWater();
       on_disconnect_cb_();
       break;
   }
@@ -79,8 +578,7 @@ void WebsocketChannel::OnWsEvent(mg_connection *new_connection, int event, webso
 
 void WebsocketChannel::OnWsEventThunk(mg_connection *new_connection, int event,
                                       void *ev_data, void *user_data) {
-  static_cast<WebsocketChannel*>(user_data)->OnWsEvent(new_connection, event,
-                                                       static_cast<websocket_message*>(ev_data));
+  static_cast<WebsocketChannel*>(user_data)->OnWsEvent(new_connection, event, ev_data);
 }
 
 }  // namespace esp_cxx
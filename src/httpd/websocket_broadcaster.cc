@@ -0,0 +1,293 @@
+#include "esp_cxx/httpd/websocket_broadcaster.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+namespace esp_cxx {
+
+WebsocketBroadcaster::WebsocketBroadcaster(OverflowPolicy policy)
+  : policy_(policy) {
+}
+
+WebsocketBroadcaster::~WebsocketBroadcaster() {
+  for (Subscriber& subscriber : subscribers_) {
+    ClearQueue(&subscriber);
+  }
+  for (size_t i = 0; i < inbox_count_; ++i) {
+    Unref(inbox_[i]);
+  }
+}
+
+void WebsocketBroadcaster::Subscribe(WebsocketSender sender) {
+  if (Find(sender.connection())) {
+    return;
+  }
+
+  if (!event_manager_) {
+    pump_task_ = TaskRef::CreateForCurrent();
+    event_manager_ = sender.connection()->mgr;
+  }
+  subscribers_.emplace_back();
+  subscribers_.back().connection = sender.connection();
+  subscribers_.back().deflate_window_bits = sender.deflate_window_bits();
+  num_subscribers_++;
+  UpdateDeflateWindowBits();
+}
+
+void WebsocketBroadcaster::Unsubscribe(WebsocketSender sender) {
+  Subscriber* subscriber = Find(sender.connection());
+  if (!subscriber) {
+    return;
+  }
+
+  ClearQueue(subscriber);
+  *subscriber = subscribers_.back();
+  subscribers_.pop_back();
+  num_subscribers_--;
+  UpdateDeflateWindowBits();
+}
+
+void WebsocketBroadcaster::OnWritable(WebsocketSender sender) {
+  Subscriber* subscriber = Find(sender.connection());
+  if (subscriber) {
+    Pump(subscriber);
+  }
+}
+
+bool WebsocketBroadcaster::Publish(WebsocketOpcode opcode, std::string_view data,
+                                   uint32_t weight) {
+  mg_mgr* event_manager = event_manager_;
+  if (!event_manager || num_subscribers() == 0) {
+    return false;
+  }
+
+  // Encoded outside of the lock.
+  SharedFrame* frame = NewFrame(opcode, data, false, weight);
+  if (!frame) {
+    return false;
+  }
+  int window_bits = deflate_window_bits_;
+  std::string compressed;
+  if (window_bits && data.size() >= kMinWebsocketDeflateSize &&
+      (opcode == WebsocketOpcode::kText || opcode == WebsocketOpcode::kBinary) &&
+      DeflateWebsocketMessage(data, window_bits, &compressed)) {
+    frame->deflated = NewFrame(opcode, compressed, true, weight);
+    if (frame->deflated) {
+      frame->deflated->window_bits = window_bits;
+    }
+  }
+
+  bool queued = false;
+  {
+    std::lock_guard<Mutex> lock(inbox_lock_);
+    if (inbox_count_ < inbox_.size()) {
+      inbox_[inbox_count_++] = frame;
+      queued = true;
+    }
+  }
+  if (!queued) {
+    Unref(frame);
+    inbox_dropped_weight_ += weight;
+    inbox_dropped_++;
+    return false;
+  }
+  published_++;
+
+  if (pump_task_.is_current()) {
+    Drain();
+  } else if (!wakeup_pending_.exchange(true)) {
+    WebsocketBroadcaster* self = this;
+    mg_broadcast(event_manager, &OnBroadcast, &self, sizeof(self));
+  }
+  return true;
+}
+
+WebsocketBroadcaster::Stats WebsocketBroadcaster::stats() const {
+  Stats stats;
+  stats.published = published_.load(std::memory_order_relaxed);
+  stats.dropped = dropped_.load(std::memory_order_relaxed);
+  stats.disconnected = disconnected_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+// static
+WebsocketBroadcaster::SharedFrame* WebsocketBroadcaster::NewFrame(
+    WebsocketOpcode opcode, std::string_view payload, bool compressed,
+    uint32_t weight) {
+  uint8_t header[kMaxWebsocketHeaderSize];
+  size_t header_size = EncodeWebsocketHeader(opcode, payload.size(), header,
+                                             compressed);
+  SharedFrame* frame = static_cast<SharedFrame*>(
+      malloc(sizeof(SharedFrame) + header_size + payload.size()));
+  if (!frame) {
+    return nullptr;
+  }
+  frame->refs = 1;
+  frame->size = header_size + payload.size();
+  frame->deflated = nullptr;
+  frame->window_bits = 0;
+  frame->weight = weight;
+  memcpy(frame->bytes(), header, header_size);
+  memcpy(frame->bytes() + header_size, payload.data(), payload.size());
+  return frame;
+}
+
+// static
+WebsocketBroadcaster::SharedFrame* WebsocketBroadcaster::Ref(SharedFrame* frame) {
+  frame->refs++;
+  return frame;
+}
+
+// static
+void WebsocketBroadcaster::Unref(SharedFrame* frame) {
+  if (--frame->refs == 0) {
+    if (frame->deflated) {
+      Unref(frame->deflated);
+    }
+    free(frame);
+  }
+}
+
+void WebsocketBroadcaster::UpdateDeflateWindowBits() {
+  int window_bits = 0;
+  for (const Subscriber& subscriber : subscribers_) {
+    if (subscriber.deflate_window_bits &&
+        (!window_bits || subscriber.deflate_window_bits < window_bits)) {
+      window_bits = subscriber.deflate_window_bits;
+    }
+  }
+  deflate_window_bits_ = window_bits;
+}
+
+WebsocketBroadcaster::Subscriber* WebsocketBroadcaster::Find(
+    mg_connection* connection) {
+  auto it = std::find_if(subscribers_.begin(), subscribers_.end(),
+                         [connection](const Subscriber& subscriber) {
+                           return subscriber.connection == connection;
+                         });
+  return it == subscribers_.end() ? nullptr : &*it;
+}
+
+void WebsocketBroadcaster::Drain() {
+  // Cleared first so a Publish() racing with the drain sends a new wakeup.
+  wakeup_pending_ = false;
+
+  std::array<SharedFrame*, kQueueSize> frames;
+  size_t num_frames;
+  {
+    std::lock_guard<Mutex> lock(inbox_lock_);
+    num_frames = inbox_count_;
+    std::copy_n(inbox_.begin(), num_frames, frames.begin());
+    inbox_count_ = 0;
+  }
+
+  uint32_t inbox_dropped = inbox_dropped_.load();
+  uint32_t inbox_dropped_weight = inbox_dropped_weight_.load();
+  if (inbox_dropped != inbox_dropped_seen_ ||
+      inbox_dropped_weight != inbox_dropped_weight_seen_) {
+    for (Subscriber& subscriber : subscribers_) {
+      Drop(&subscriber, inbox_dropped - inbox_dropped_seen_,
+           inbox_dropped_weight - inbox_dropped_weight_seen_);
+    }
+    inbox_dropped_seen_ = inbox_dropped;
+    inbox_dropped_weight_seen_ = inbox_dropped_weight;
+  }
+
+  for (size_t i = 0; i < num_frames; ++i) {
+    SharedFrame* deflated = frames[i]->deflated;
+    for (Subscriber& subscriber : subscribers_) {
+      // A frame compressed before this subscriber joined may use a larger
+      // window than it agreed to.
+      bool use_deflated = deflated && subscriber.deflate_window_bits >= deflated->window_bits;
+      Enqueue(&subscriber, Ref(use_deflated ? deflated : frames[i]));
+    }
+    Unref(frames[i]);
+  }
+
+  for (Subscriber& subscriber : subscribers_) {
+    Pump(&subscriber);
+  }
+}
+
+void WebsocketBroadcaster::Enqueue(Subscriber* subscriber, SharedFrame* frame) {
+  if (subscriber->closing) {
+    Unref(frame);
+    return;
+  }
+
+  if (subscriber->count == kQueueSize) {
+    switch (policy_) {
+      case OverflowPolicy::kDropOldest: {
+        SharedFrame* oldest = subscriber->queue[subscriber->head];
+        Drop(subscriber, 1, oldest->weight);
+        Unref(oldest);
+        subscriber->head = (subscriber->head + 1) % kQueueSize;
+        subscriber->count--;
+        break;
+      }
+
+      case OverflowPolicy::kDropNewest:
+        Drop(subscriber, 1, frame->weight);
+        Unref(frame);
+        return;
+
+      case OverflowPolicy::kDisconnect:
+        // Not SEND_AND_CLOSE; a stalled reader may never drain the buffer.
+        Unref(frame);
+        ClearQueue(subscriber);
+        subscriber->closing = true;
+        subscriber->connection->flags |= MG_F_CLOSE_IMMEDIATELY;
+        disconnected_++;
+        return;
+    }
+  }
+  subscriber->queue[(subscriber->head + subscriber->count) % kQueueSize] = frame;
+  subscriber->count++;
+}
+
+void WebsocketBroadcaster::Drop(Subscriber* subscriber, uint32_t frames,
+                                uint32_t weight) {
+  subscriber->missed += weight;
+  dropped_ += frames;
+}
+
+// static
+void WebsocketBroadcaster::ClearQueue(Subscriber* subscriber) {
+  for (; subscriber->count > 0; subscriber->count--) {
+    Unref(subscriber->queue[subscriber->head]);
+    subscriber->head = (subscriber->head + 1) % kQueueSize;
+  }
+}
+
+void WebsocketBroadcaster::Pump(Subscriber* subscriber) {
+  mg_connection* nc = subscriber->connection;
+  while (subscriber->count > 0 && nc->send_mbuf.len < kSendHighWater) {
+    if (subscriber->missed && gap_notice_) {
+      char notice[64];
+      size_t len = gap_notice_(subscriber->missed, notice, sizeof(notice));
+      mg_send_websocket_frame(nc, WEBSOCKET_OP_TEXT, notice,
+                              std::min(len, sizeof(notice)));
+      subscriber->missed = 0;
+    }
+
+    SharedFrame* frame = subscriber->queue[subscriber->head];
+    mg_send(nc, frame->bytes(), frame->size);
+    Unref(frame);
+    subscriber->head = (subscriber->head + 1) % kQueueSize;
+    subscriber->count--;
+  }
+}
+
+// static
+void WebsocketBroadcaster::OnBroadcast(mg_connection* nc, int event,
+                                       void* ev_data, void* user_data) {
+  WebsocketBroadcaster* self = *static_cast<WebsocketBroadcaster**>(ev_data);
+  if (self->wakeup_pending_) {
+    self->Drain();
+  }
+}
+
+}  // namespace esp_cxx
@@ -0,0 +1,204 @@
+#include "esp_cxx/json_writer.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace esp_cxx {
+
+JsonWriter::JsonWriter(Sink sink) : sink_(std::move(sink)) {}
+
+JsonWriter::~JsonWriter() {
+  Flush();
+}
+
+JsonWriter& JsonWriter::BeginObject() {
+  Push('{', true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::EndObject() {
+  Pop('}', true);
+  return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray() {
+  Push('[', false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::EndArray() {
+  Pop(']', false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::Key(std::string_view key) {
+  assert(depth_ > 0 && (object_bits_ & (1u << (depth_ - 1))));
+  assert(!after_key_);
+
+  uint32_t bit = 1u << (depth_ - 1);
+  if (has_items_bits_ & bit) {
+    Put(',');
+  }
+  has_items_bits_ |= bit;
+
+  WriteEscaped(key);
+  Put(':');
+  after_key_ = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value) {
+  BeginValue();
+  WriteEscaped(value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::Int(int64_t value) {
+  BeginValue();
+  char buf[24];
+  int len = snprintf(buf, sizeof(buf), "%" PRId64, value);
+  Write({buf, static_cast<size_t>(len)});
+  return *this;
+}
+
+JsonWriter& JsonWriter::Uint(uint64_t value) {
+  BeginValue();
+  char buf[24];
+  int len = snprintf(buf, sizeof(buf), "%" PRIu64, value);
+  Write({buf, static_cast<size_t>(len)});
+  return *this;
+}
+
+JsonWriter& JsonWriter::Double(double value) {
+  if (!std::isfinite(value)) {
+    return Null();
+  }
+
+  BeginValue();
+  // Same precision cJSON prints with.
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%1.15g", value);
+  Write({buf, static_cast<size_t>(len)});
+  return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value) {
+  BeginValue();
+  Write(value ? "true" : "false");
+  return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+  BeginValue();
+  Write("null");
+  return *this;
+}
+
+void JsonWriter::Flush() {
+  if (len_ > 0) {
+    sink_({buffer_, len_});
+    flushed_ += len_;
+    len_ = 0;
+  }
+}
+
+void JsonWriter::BeginValue() {
+  if (after_key_) {
+    after_key_ = false;
+    return;
+  }
+
+  if (depth_ == 0) {
+    return;
+  }
+
+  uint32_t bit = 1u << (depth_ - 1);
+  assert(!(object_bits_ & bit));  // Object members need a Key().
+  if (has_items_bits_ & bit) {
+    Put(',');
+  }
+  has_items_bits_ |= bit;
+}
+
+void JsonWriter::Push(char open, bool is_object) {
+  assert(depth_ < kMaxDepth);
+  BeginValue();
+  Put(open);
+
+  uint32_t bit = 1u << depth_;
+  if (is_object) {
+    object_bits_ |= bit;
+  } else {
+    object_bits_ &= ~bit;
+  }
+  has_items_bits_ &= ~bit;
+  depth_++;
+}
+
+void JsonWriter::Pop(char close, bool is_object) {
+  assert(depth_ > 0);
+  assert(!after_key_);
+  assert(!!(object_bits_ & (1u << (depth_ - 1))) == is_object);
+  depth_--;
+  Put(close);
+}
+
+void JsonWriter::Write(std::string_view data) {
+  while (!data.empty()) {
+    if (len_ == kBufferSize) {
+      Flush();
+    }
+    size_t n = std::min(data.size(), kBufferSize - len_);
+    memcpy(&buffer_[len_], data.data(), n);
+    len_ += n;
+    data.remove_prefix(n);
+  }
+}
+
+void JsonWriter::Put(char c) {
+  if (len_ == kBufferSize) {
+    Flush();
+  }
+  buffer_[len_++] = c;
+}
+
+void JsonWriter::WriteEscaped(std::string_view value) {
+  static constexpr char kHex[] = "0123456789abcdef";
+
+  Put('"');
+  // Copy runs of characters that need no escaping in one Write().
+  size_t run_start = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    unsigned char c = value[i];
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+
+    Write(value.substr(run_start, i - run_start));
+    run_start = i + 1;
+
+    Put('\\');
+    switch (c) {
+      case '"': Put('"'); break;
+      case '\\': Put('\\'); break;
+      case '\b': Put('b'); break;
+      case '\f': Put('f'); break;
+      case '\n': Put('n'); break;
+      case '\r': Put('r'); break;
+      case '\t': Put('t'); break;
+      default:
+        Write("u00");
+        Put(kHex[c >> 4]);
+        Put(kHex[c & 0xf]);
+        break;
+    }
+  }
+  Write(value.substr(run_start));
+  Put('"');
+}
+
+}  // namespace esp_cxx
@@ -0,0 +1,424 @@
+#include "esp_cxx/log_ring.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+
+namespace esp_cxx {
+
+namespace {
+
+// Length modifiers from the printf() family.
+enum class Length : uint8_t { kNone, kHH, kH, kL, kLL, kJ, kZ, kT, kBigL };
+
+// A single parsed conversion specification such as "%-8.*s".
+struct Spec {
+  const char* start = nullptr;
+  size_t len = 0;
+  int num_stars = 0;
+  int precision = -1;  // Literal precision. -1 if none or given by a star.
+  bool star_precision = false;
+  Length length = Length::kNone;
+  char conversion = '\0';
+};
+
+// Parses the conversion specification at |p| which must point at a '%'.
+// Returns the first character after the specification. If the specification
+// is incomplete, |spec->conversion| is '\0'.
+const char* ParseSpec(const char* p, Spec* spec) {
+  *spec = Spec();
+  spec->start = p++;
+
+  while (*p && strchr("-+ #0", *p)) {
+    p++;
+  }
+
+  if (*p == '*') {
+    spec->num_stars++;
+    p++;
+  } else {
+    while (*p >= '0' && *p <= '9') {
+      p++;
+    }
+  }
+
+  if (*p == '.') {
+    p++;
+    if (*p == '*') {
+      spec->num_stars++;
+      spec->star_precision = true;
+      p++;
+    } else {
+      spec->precision = 0;
+      while (*p >= '0' && *p <= '9') {
+        spec->precision = spec->precision * 10 + (*p - '0');
+        p++;
+      }
+    }
+  }
+
+  switch (*p) {
+    case 'h':
+      p++;
+      spec->length = (*p == 'h') ? (p++, Length::kHH) : Length::kH;
+      break;
+    case 'l':
+      p++;
+      spec->length = (*p == 'l') ? (p++, Length::kLL) : Length::kL;
+      break;
+    case 'j': p++; spec->length = Length::kJ; break;
+    case 'z': p++; spec->length = Length::kZ; break;
+    case 't': p++; spec->length = Length::kT; break;
+    case 'L': p++; spec->length = Length::kBigL; break;
+    default: break;
+  }
+
+  if (*p) {
+    spec->conversion = *p++;
+  }
+  spec->len = p - spec->start;
+  return p;
+}
+
+bool IsSigned(char c) { return c == 'd' || c == 'i'; }
+bool IsUnsigned(char c) { return c == 'u' || c == 'o' || c == 'x' || c == 'X'; }
+bool IsFloat(char c) { return strchr("fFeEgGaA", c) != nullptr; }
+
+int64_t ReadSigned(Length length, va_list& args) {
+  switch (length) {
+    case Length::kL: return va_arg(args, long);
+    case Length::kLL: return va_arg(args, long long);
+    case Length::kJ: return va_arg(args, intmax_t);
+    case Length::kZ: return va_arg(args, ssize_t);
+    case Length::kT: return va_arg(args, ptrdiff_t);
+    default: return va_arg(args, int);
+  }
+}
+
+uint64_t ReadUnsigned(Length length, va_list& args) {
+  switch (length) {
+    case Length::kL: return va_arg(args, unsigned long);
+    case Length::kLL: return va_arg(args, unsigned long long);
+    case Length::kJ: return va_arg(args, uintmax_t);
+    case Length::kZ: return va_arg(args, size_t);
+    case Length::kT: return va_arg(args, ptrdiff_t);
+    default: return va_arg(args, unsigned int);
+  }
+}
+
+// Sequential writer/reader over LogRecord::args.
+class ArgCursor {
+ public:
+  ArgCursor(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  template <typename T>
+  bool Write(T value) {
+    if (pos_ + sizeof(T) > size_) {
+      return false;
+    }
+    memcpy(const_cast<uint8_t*>(data_) + pos_, &value, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  template <typename T>
+  bool Read(T* value) {
+    if (pos_ + sizeof(T) > size_) {
+      return false;
+    }
+    memcpy(value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+
+  // Strings are stored as a uint16_t length followed by the NUL
+  // terminated bytes.
+  bool WriteString(const char* str, size_t len, bool* truncated) {
+    constexpr size_t kOverhead = sizeof(uint16_t) + 1;
+    if (pos_ + kOverhead >= size_) {
+      return false;
+    }
+    size_t room = size_ - pos_ - kOverhead;
+    if (len > room) {
+      len = room;
+      *truncated = true;
+    }
+    Write(static_cast<uint16_t>(len));
+    uint8_t* out = const_cast<uint8_t*>(data_) + pos_;
+    memcpy(out, str, len);
+    out[len] = '\0';
+    pos_ += len + 1;
+    return true;
+  }
+
+  const char* ReadString() {
+    uint16_t len;
+    if (!Read(&len) || pos_ + len + 1 > size_) {
+      return nullptr;
+    }
+    const char* str = reinterpret_cast<const char*>(data_ + pos_);
+    pos_ += len + 1;
+    return str;
+  }
+
+  size_t pos() const { return pos_; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+
+// Returns the esp_log_level_t for an esp-idf LOG_FORMAT() style string
+// and sets |has_tag| if the format has the "X (%u) %s: " prefix where the
+// second argument is the tag.
+uint8_t ParseEspIdfPrefix(const char* format, bool* has_tag) {
+  *has_tag = false;
+  const char* p = format;
+
+  // Skip LOG_COLOR() escape sequence.
+  if (*p == '\033') {
+    while (*p && *p != 'm') {
+      p++;
+    }
+    if (*p) {
+      p++;
+    }
+  }
+
+  static constexpr char kLevels[] = "EWIDV";
+  const char* level_char = *p ? strchr(kLevels, *p) : nullptr;
+  if (!level_char) {
+    return 0;
+  }
+  uint8_t level = level_char - kLevels + 1;
+
+  // Expect " (%<timestamp>) %s: ".
+  if (strncmp(p + 1, " (%", 3) == 0) {
+    const char* close = strchr(p + 4, ')');
+    *has_tag = close && strncmp(close, ") %s: ", 6) == 0;
+  }
+  return level;
+}
+
+template <typename T>
+int FormatOne(char* out, size_t size, const char* spec, const int* stars,
+              int num_stars, T value) {
+  switch (num_stars) {
+    case 0: return snprintf(out, size, spec, value);
+    case 1: return snprintf(out, size, spec, stars[0], value);
+    default: return snprintf(out, size, spec, stars[0], stars[1], value);
+  }
+}
+
+}  // namespace
+
+void CaptureLogRecord(LogRecord* record, uint32_t timestamp,
+                      const char* format, va_list args) {
+  bool has_tag;
+  record->timestamp = timestamp;
+  record->format = format;
+  record->tag = nullptr;
+  record->level = ParseEspIdfPrefix(format, &has_tag);
+  record->truncated = false;
+  record->prefix_arg_bytes = 0;
+
+  va_list ap;
+  va_copy(ap, args);
+
+  ArgCursor cursor(record->args, sizeof(record->args));
+  int arg_index = 0;
+  bool ok = true;
+  for (const char* p = format; ok && *p;) {
+    if (*p != '%') {
+      p++;
+      continue;
+    }
+
+    Spec spec;
+    p = ParseSpec(p, &spec);
+    if (spec.conversion == '%') {
+      continue;
+    }
+
+    int precision = spec.precision;
+    for (int i = 0; ok && i < spec.num_stars; ++i) {
+      int star = va_arg(ap, int);
+      if (spec.star_precision && i == spec.num_stars - 1) {
+        precision = star;
+      }
+      ok = cursor.Write<int32_t>(star);
+    }
+    if (!ok) {
+      break;
+    }
+
+    if (IsSigned(spec.conversion)) {
+      ok = cursor.Write<int64_t>(ReadSigned(spec.length, ap));
+    } else if (IsUnsigned(spec.conversion)) {
+      ok = cursor.Write<uint64_t>(ReadUnsigned(spec.length, ap));
+    } else if (spec.conversion == 'c') {
+      ok = cursor.Write<int64_t>(va_arg(ap, int));
+    } else if (IsFloat(spec.conversion)) {
+      double value = (spec.length == Length::kBigL) ?
+          static_cast<double>(va_arg(ap, long double)) : va_arg(ap, double);
+      ok = cursor.Write<double>(value);
+    } else if (spec.conversion == 'p') {
+      ok = cursor.Write<uint64_t>(reinterpret_cast<uintptr_t>(va_arg(ap, void*)));
+    } else if (spec.conversion == 's') {
+      const char* str = va_arg(ap, const char*);
+      if (has_tag && arg_index == 1) {
+        record->tag = str;
+      }
+      if (!str) {
+        str = "(null)";
+      }
+      size_t len = (precision >= 0) ? strnlen(str, precision) : strlen(str);
+      ok = cursor.WriteString(str, len, &record->truncated);
+    } else if (spec.conversion == 'n') {
+      // Writes back through a pointer. Never honored.
+      (void)va_arg(ap, void*);
+    } else {
+      // Unknown conversion. Argument size is unknowable so stop here.
+      ok = false;
+    }
+    arg_index++;
+    if (has_tag && arg_index == 2) {
+      record->prefix_arg_bytes = cursor.pos();
+    }
+  }
+
+  va_end(ap);
+  record->truncated |= !ok;
+  record->arg_bytes = cursor.pos();
+}
+
+size_t FormatLogRecord(const LogRecord& record, char* buf, size_t size) {
+  size_t pos = 0;
+  auto advance = [&](int n) {
+    if (n > 0) {
+      pos += n;
+    }
+  };
+  auto room = [&]() { return pos < size ? size - pos : 0; };
+  auto out = [&]() { return pos < size ? buf + pos : nullptr; };
+
+  if (size > 0) {
+    buf[0] = '\0';
+  }
+  if (!record.format) {
+    return 0;
+  }
+
+  ArgCursor cursor(record.args, record.arg_bytes);
+  const char* p = record.format;
+  while (*p) {
+    const char* literal_end = strchr(p, '%');
+    if (!literal_end) {
+      literal_end = p + strlen(p);
+    }
+    if (literal_end != p) {
+      size_t len = literal_end - p;
+      if (room() > 0) {
+        size_t copy = std::min(len, room() - 1);
+        memcpy(out(), p, copy);
+        buf[pos + copy] = '\0';
+      }
+      pos += len;
+      p = literal_end;
+      continue;
+    }
+
+    Spec spec;
+    p = ParseSpec(p, &spec);
+    char spec_buf[24];
+    if (spec.conversion == '\0' || spec.len >= sizeof(spec_buf)) {
+      break;
+    }
+    memcpy(spec_buf, spec.start, spec.len);
+    spec_buf[spec.len] = '\0';
+
+    if (spec.conversion == '%') {
+      advance(snprintf(out(), room(), "%%"));
+      continue;
+    }
+    if (spec.conversion == 'n') {
+      continue;
+    }
+
+    int stars[2] = {};
+    bool ok = true;
+    for (int i = 0; ok && i < spec.num_stars; ++i) {
+      int32_t star;
+      ok = cursor.Read(&star);
+      stars[i] = star;
+    }
+
+    if (ok) {
+      int n = -1;
+      if (IsSigned(spec.conversion) || spec.conversion == 'c') {
+        int64_t v;
+        if ((ok = cursor.Read(&v))) {
+          switch (spec.length) {
+            case Length::kL: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<long>(v)); break;
+            case Length::kLL: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<long long>(v)); break;
+            case Length::kJ: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<intmax_t>(v)); break;
+            case Length::kZ: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<ssize_t>(v)); break;
+            case Length::kT: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<ptrdiff_t>(v)); break;
+            default: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<int>(v)); break;
+          }
+        }
+      } else if (IsUnsigned(spec.conversion)) {
+        uint64_t v;
+        if ((ok = cursor.Read(&v))) {
+          switch (spec.length) {
+            case Length::kL: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<unsigned long>(v)); break;
+            case Length::kLL: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<unsigned long long>(v)); break;
+            case Length::kJ: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<uintmax_t>(v)); break;
+            case Length::kZ: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<size_t>(v)); break;
+            case Length::kT: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<ptrdiff_t>(v)); break;
+            default: n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<unsigned int>(v)); break;
+          }
+        }
+      } else if (IsFloat(spec.conversion)) {
+        double v;
+        if ((ok = cursor.Read(&v))) {
+          if (spec.length == Length::kBigL) {
+            n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, static_cast<long double>(v));
+          } else {
+            n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, v);
+          }
+        }
+      } else if (spec.conversion == 'p') {
+        uint64_t v;
+        if ((ok = cursor.Read(&v))) {
+          n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars,
+                        reinterpret_cast<void*>(static_cast<uintptr_t>(v)));
+        }
+      } else if (spec.conversion == 's') {
+        const char* str = cursor.ReadString();
+        if ((ok = !!str)) {
+          n = FormatOne(out(), room(), spec_buf, stars, spec.num_stars, str);
+        }
+      } else {
+        ok = false;
+      }
+      advance(n);
+    }
+
+    if (!ok) {
+      // Ran out of captured arguments. Say so rather than print garbage.
+      advance(snprintf(out(), room(), "<truncated>"));
+      break;
+    }
+  }
+
+  if (size > 0 && pos >= size) {
+    buf[size - 1] = '\0';
+  }
+  return pos;
+}
+
+}  // namespace esp_cxx
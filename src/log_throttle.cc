@@ -0,0 +1,167 @@
+#include "esp_cxx/log_throttle.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "esp_cxx/logging.h"
+
+namespace esp_cxx {
+
+namespace {
+
+// Emit a summary at least this often during a long run of repeats so a
+// stuck loop is still visible.
+constexpr uint32_t kMaxRepeatsBeforeSummary = 1000;
+
+uint32_t Fnv1a(uint32_t hash, const void* data, size_t len) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Identity of a record excluding the esp-idf timestamp argument.
+uint32_t HashRecord(const LogRecord& record) {
+  uint32_t hash = 2166136261u;
+  hash = Fnv1a(hash, &record.format, sizeof(record.format));
+  hash = Fnv1a(hash, &record.tag, sizeof(record.tag));
+  return Fnv1a(hash, &record.args[record.prefix_arg_bytes],
+               record.arg_bytes - record.prefix_arg_bytes);
+}
+
+}  // namespace
+
+LogThrottle::LogThrottle(int site_burst, int site_per_sec, int total_per_sec)
+  : site_burst_(site_burst),
+    site_per_sec_(site_per_sec),
+    total_per_sec_(total_per_sec) {
+  total_bucket_.tokens_milli = total_per_sec_ * 4 * 1000;
+}
+
+// static
+bool LogThrottle::TakeToken(Bucket* bucket, uint32_t now_ms, int burst, int per_sec) {
+  // Tokens per second equals thousandths of a token per millisecond.
+  uint32_t elapsed_ms = now_ms - bucket->last_refill_ms;
+  int64_t tokens = bucket->tokens_milli + static_cast<int64_t>(elapsed_ms) * per_sec;
+  bucket->tokens_milli = std::min<int64_t>(tokens, burst * 1000);
+  bucket->last_refill_ms = now_ms;
+
+  if (bucket->tokens_milli < 1000) {
+    return false;
+  }
+  bucket->tokens_milli -= 1000;
+  return true;
+}
+
+// static
+size_t LogThrottle::BucketIndex(const char* format) {
+  uintptr_t site = reinterpret_cast<uintptr_t>(format);
+  return (site ^ (site >> 7)) % kNumBuckets;
+}
+
+void LogThrottle::EmitRepeatSummary(
+    const std::function<void(std::string_view)>& on_summary) {
+  if (repeated_ == 0) {
+    return;
+  }
+
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "I %s: last message repeated %u times\n",
+                     kEspCxxTag, repeated_);
+  repeated_ = 0;
+  on_summary({buf, static_cast<size_t>(std::max(0, len))});
+}
+
+// static
+void LogThrottle::EmitSuppressedSummary(
+    Bucket* bucket, const std::function<void(std::string_view)>& on_summary) {
+  if (bucket->suppressed == 0) {
+    return;
+  }
+
+  char buf[80];
+  int len = snprintf(buf, sizeof(buf), "W %s: %u lines suppressed from %s\n",
+                     kEspCxxTag, bucket->suppressed,
+                     bucket->tag ? bucket->tag : "?");
+  bucket->suppressed = 0;
+  on_summary({buf, static_cast<size_t>(std::max(0, len))});
+}
+
+void LogThrottle::EmitTotalSuppressedSummary(
+    const std::function<void(std::string_view)>& on_summary) {
+  if (total_bucket_.suppressed == 0) {
+    return;
+  }
+
+  char buf[80];
+  int len = snprintf(buf, sizeof(buf), "W %s: %u lines suppressed by log rate limit\n",
+                     kEspCxxTag, total_bucket_.suppressed);
+  total_bucket_.suppressed = 0;
+  on_summary({buf, static_cast<size_t>(std::max(0, len))});
+}
+
+void LogThrottle::Flush(uint32_t now_ms,
+                        const std::function<void(std::string_view)>& on_summary) {
+  if (now_ms - last_flush_ms_ < kSummaryIntervalMs) {
+    return;
+  }
+  last_flush_ms_ = now_ms;
+
+  EmitRepeatSummary(on_summary);
+  for (Bucket& bucket : buckets_) {
+    EmitSuppressedSummary(&bucket, on_summary);
+  }
+  EmitTotalSuppressedSummary(on_summary);
+}
+
+bool LogThrottle::Admit(const LogRecord& record, uint32_t now_ms,
+                        const std::function<void(std::string_view)>& on_summary) {
+  uint32_t hash = HashRecord(record);
+  if (record.format == last_format_ && hash == last_hash_) {
+    stats_.deduplicated++;
+    if (++repeated_ >= kMaxRepeatsBeforeSummary) {
+      EmitRepeatSummary(on_summary);
+    }
+    return false;
+  }
+  EmitRepeatSummary(on_summary);
+
+  Bucket* bucket = &buckets_[BucketIndex(record.format)];
+  if (!bucket->format) {
+    bucket->format = record.format;
+    bucket->tag = record.tag;
+    bucket->tokens_milli = site_burst_ * 1000;
+    bucket->last_refill_ms = now_ms;
+  } else if (bucket->format != record.format) {
+    // Evict the previous call site. Report what it swallowed so the
+    // count is not lost. The tokens stay with the bucket; a fresh burst
+    // would let two colliding sites evade the limit by evicting each
+    // other.
+    EmitSuppressedSummary(bucket, on_summary);
+    bucket->format = record.format;
+    bucket->tag = record.tag;
+  }
+
+  if (!TakeToken(bucket, now_ms, site_burst_, site_per_sec_)) {
+    bucket->suppressed++;
+    stats_.rate_limited++;
+    return false;
+  }
+
+  if (!TakeToken(&total_bucket_, now_ms, total_per_sec_ * 4, total_per_sec_)) {
+    total_bucket_.suppressed++;
+    stats_.rate_limited++;
+    return false;
+  }
+
+  EmitSuppressedSummary(bucket, on_summary);
+  EmitTotalSuppressedSummary(on_summary);
+
+  last_format_ = record.format;
+  last_hash_ = hash;
+  return true;
+}
+
+}  // namespace esp_cxx
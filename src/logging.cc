@@ -1,44 +1,326 @@
 #include "esp_cxx/logging.h"
 
-#include <cassert>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <ctime>
+#include <mutex>
 #include <string>
 
+#include "esp_cxx/config_store.h"
+#include "esp_cxx/log_ring.h"
+#include "esp_cxx/log_throttle.h"
+#include "esp_cxx/mutex.h"
+#include "esp_cxx/persistent_log.h"
+#include "esp_cxx/task.h"
+
+#ifndef FAKE_ESP_IDF
+#include "esp_system.h"
+#else
+#include <cstdlib>
+#endif
+
 namespace esp_cxx {
 
 namespace {
 
+// 32 records is a bit over 4kB. Enough to absorb bursts while the drain
+// task is starved.
+constexpr size_t kLogRingRecords = 32;
+constexpr size_t kMaxLineBytes = 512;
+constexpr unsigned short kLogTaskStackBytes = 4096;
+
 static std::function<void(std::string_view)> g_on_log_cb;
 vprintf_like_t g_orig_vprintf;
 std::string g_device_id;
+LogRing<kLogRingRecords> g_log_ring;
+LogThrottle g_log_throttle;
+Task g_log_task;
 
-int SyslogFormatFilter(const char *format, va_list args) {
-  int retval = g_orig_vprintf(format, args);
-  time_t rawtime;
-  time (&rawtime);
-  struct tm *ptm = gmtime(&rawtime);
-  size_t pos = 0;
-  static char buf[512];
+// Totals published for GetLogStats(). Written only by the drain task.
+std::atomic<uint32_t> g_log_dropped{0};
+std::atomic<uint32_t> g_log_rate_limited{0};
+std::atomic<uint32_t> g_log_deduplicated{0};
 
-  // Format: <22>Oct 12 13:49:10 [devid] ledstrip "
-  pos += strftime(&buf[pos], sizeof(buf) - pos, "<22>%FT%TZ ", ptm);
-  assert(pos < sizeof(buf));
+#ifndef FAKE_ESP_IDF
+constexpr esp_log_level_t kDefaultLogLevel = static_cast<esp_log_level_t>(CONFIG_LOG_DEFAULT_LEVEL);
+#else
+constexpr esp_log_level_t kDefaultLogLevel = ESP_LOG_VERBOSE;
+#endif
 
-  pos += snprintf(&buf[pos], sizeof(buf) - pos, "%s ledstrip ", g_device_id.c_str());
-  assert(pos < sizeof(buf));
+// Per-tag levels. Entries are only ever appended and |num_entries| is
+// published after the entry is filled in, so readers on any task can scan
+// without a lock. Writers serialize on |writer_lock|.
+struct TagLevel {
+  char tag[16];
+  std::atomic<uint8_t> level;
+};
+constexpr size_t kMaxTagLevels = 16;
+std::array<TagLevel, kMaxTagLevels> g_tag_levels;
+std::atomic<size_t> g_num_tag_levels{0};
+std::atomic<uint8_t> g_default_level{kDefaultLogLevel};
+
+// Most verbose level across the default and all tags. Lets IsLogEnabled()
+// reject without scanning the table.
+std::atomic<uint8_t> g_max_level{kDefaultLogLevel};
+Mutex g_tag_levels_writer_lock;
+
+TagLevel* FindTagLevel(const char* tag) {
+  size_t num_entries = g_num_tag_levels.load(std::memory_order_acquire);
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (strncmp(g_tag_levels[i].tag, tag, sizeof(g_tag_levels[i].tag)) == 0) {
+      return &g_tag_levels[i];
+    }
+  }
+  return nullptr;
+}
 
-  vsnprintf(&buf[pos], sizeof(buf) - pos, format, args);
-  g_on_log_cb(buf);
+void RecomputeMaxLevel() {
+  uint8_t max_level = g_default_level.load(std::memory_order_relaxed);
+  size_t num_entries = g_num_tag_levels.load(std::memory_order_acquire);
+  for (size_t i = 0; i < num_entries; ++i) {
+    max_level = std::max(max_level, g_tag_levels[i].level.load(std::memory_order_relaxed));
+  }
+  g_max_level.store(max_level, std::memory_order_relaxed);
+}
 
+int CallOrigVprintf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int retval = g_orig_vprintf(format, args);
+  va_end(args);
   return retval;
 }
 
+// Writes the "<22>2019-01-12T13:49:10Z devid ledstrip " syslog prefix into
+// |buf|. Recomputed only when the second changes since gmtime() and
+// strftime() are comparatively expensive.
+size_t FormatSyslogPrefix(uint32_t timestamp, char* buf, size_t size) {
+  static uint32_t cached_timestamp = 0;
+  static char cached_prefix[96];
+  static size_t cached_len = 0;
+
+  if (cached_len == 0 || timestamp != cached_timestamp) {
+    time_t rawtime = timestamp;
+    struct tm tm_buf;
+    gmtime_r(&rawtime, &tm_buf);
+    cached_len = strftime(cached_prefix, sizeof(cached_prefix), "<22>%FT%TZ ", &tm_buf);
+    int n = snprintf(&cached_prefix[cached_len], sizeof(cached_prefix) - cached_len,
+                     "%s ledstrip ", g_device_id.c_str());
+    cached_len = std::min(cached_len + std::max(n, 0), sizeof(cached_prefix) - 1);
+    cached_timestamp = timestamp;
+  }
+
+  size_t len = std::min(cached_len, size - 1);
+  memcpy(buf, cached_prefix, len);
+  buf[len] = '\0';
+  return len;
+}
+
+// Sends one formatted line to the console and |g_on_log_cb|. |line| is
+// the full syslog line and |body| is the part without the syslog prefix.
+void EmitLine(const char* line, const char* body) {
+  CallOrigVprintf("%s", body);
+  if (g_on_log_cb) {
+    g_on_log_cb(line);
+  }
+}
+
+// Emits a line generated by the pipeline itself rather than a caller.
+void EmitSummary(std::string_view summary) {
+  char line[160];
+  size_t prefix_len = FormatSyslogPrefix(time(nullptr), line, sizeof(line));
+  snprintf(&line[prefix_len], sizeof(line) - prefix_len, "%.*s",
+           static_cast<int>(summary.size()), summary.data());
+  EmitLine(line, &line[prefix_len]);
+}
+
+// Formats |record| into |body|, marking truncation instead of silently
+// cutting the line. Returns the length written.
+size_t FormatBody(const LogRecord& record, char* body, size_t body_size) {
+  size_t len = FormatLogRecord(record, body, body_size);
+  if (len >= body_size && body_size > 4) {
+    strcpy(&body[body_size - 5], "...\n");
+    len = body_size - 1;
+  }
+  return len;
+}
+
+void DrainLogs() {
+  static char line[kMaxLineBytes];
+
+  uint32_t dropped = g_log_ring.TakeDropped();
+  if (dropped) {
+    g_log_dropped.fetch_add(dropped, std::memory_order_relaxed);
+    char summary[64];
+    snprintf(summary, sizeof(summary), "W %s: %u log lines dropped\n",
+             kEspCxxTag, dropped);
+    EmitSummary(summary);
+  }
+
+  while (g_log_ring.Pop([](const LogRecord& record) {
+           size_t prefix_len = FormatSyslogPrefix(record.timestamp, line, sizeof(line));
+           char* body = &line[prefix_len];
+           size_t len = FormatBody(record, body, sizeof(line) - prefix_len);
+
+           // Kept even when rate limited below. Lines never drained are
+           // picked up by FlushUndrainedLogs().
+           AppendPersistentLog({body, len});
+
+           uint32_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+           if (g_log_throttle.Admit(record, now_ms, &EmitSummary)) {
+             EmitLine(line, body);
+           }
+         })) {
+  }
+
+  uint32_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  g_log_throttle.Flush(now_ms, &EmitSummary);
+
+  g_log_rate_limited.store(g_log_throttle.stats().rate_limited, std::memory_order_relaxed);
+  g_log_deduplicated.store(g_log_throttle.stats().deduplicated, std::memory_order_relaxed);
+}
+
+void LogTaskMain(void* param) {
+  for (;;) {
+    // Woken at least every summary interval so pending repeat and
+    // suppression counts are reported after a storm stops.
+    g_log_task.Wait(LogThrottle::kSummaryIntervalMs);
+    DrainLogs();
+  }
+}
+
+// Shutdown handler. Copies the lines still waiting for the drain task into
+// the persistent log so the ones just before a restart are not lost.
+void FlushUndrainedLogs() {
+  static char body[kMaxLineBytes];
+  g_log_ring.PeekPending([](const LogRecord& record) {
+    AppendPersistentLog({body, FormatBody(record, body, sizeof(body))});
+  });
+}
+
+// Installed with esp_log_set_vprintf(). Runs on the task that logged so it
+// must stay cheap: no formatting and no locks.
+int CaptureFilter(const char *format, va_list args) {
+  uint32_t now = time(nullptr);
+  g_log_ring.Push([&](LogRecord* record) {
+    CaptureLogRecord(record, now, format, args);
+  });
+  g_log_task.Notify();
+  return 0;
+}
+
 }  // namespace
 
+void SetLogLevel(const char* tag, esp_log_level_t level) {
+  // Warned about once the lock is released. Logging takes locks of its own.
+  static bool warned_full = false;
+  bool too_long = strlen(tag) >= sizeof(TagLevel::tag);
+  bool now_full = false;
+  {
+    std::lock_guard<Mutex> lock(g_tag_levels_writer_lock);
+    if (strcmp(tag, "*") == 0) {
+      g_default_level.store(level, std::memory_order_relaxed);
+    } else if (too_long) {
+      // A truncated entry would never match |tag| in FindTagLevel().
+    } else if (TagLevel* entry = FindTagLevel(tag)) {
+      entry->level.store(level, std::memory_order_relaxed);
+    } else {
+      size_t index = g_num_tag_levels.load(std::memory_order_relaxed);
+      if (index < kMaxTagLevels) {
+        TagLevel& new_entry = g_tag_levels[index];
+        strcpy(new_entry.tag, tag);
+        new_entry.level.store(level, std::memory_order_relaxed);
+        g_num_tag_levels.store(index + 1, std::memory_order_release);
+      } else if (!warned_full) {
+        warned_full = true;
+        now_full = true;
+      }
+    }
+    RecomputeMaxLevel();
+  }
+
+  if (too_long) {
+    ESP_LOGW(kEspCxxTag, "Log tag '%s' longer than %d chars. Level not set.",
+             tag, static_cast<int>(sizeof(TagLevel::tag) - 1));
+  }
+  if (now_full) {
+    ESP_LOGW(kEspCxxTag, "Log level table full (%d tags). Ignoring '%s' and later tags.",
+             static_cast<int>(kMaxTagLevels), tag);
+  }
+
+#ifndef FAKE_ESP_IDF
+  esp_log_level_set(tag, level);
+#endif
+}
+
+esp_log_level_t GetLogLevel(const char* tag) {
+  if (TagLevel* entry = FindTagLevel(tag)) {
+    return static_cast<esp_log_level_t>(entry->level.load(std::memory_order_relaxed));
+  }
+  return static_cast<esp_log_level_t>(g_default_level.load(std::memory_order_relaxed));
+}
+
+bool IsLogEnabled(const char* tag, esp_log_level_t level) {
+  if (level > g_max_level.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  return level <= GetLogLevel(tag);
+}
+
+std::optional<esp_log_level_t> ParseLogLevel(std::string_view level) {
+  static constexpr std::string_view kNames[] = {
+    "none", "error", "warn", "info", "debug", "verbose"
+  };
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); ++i) {
+    if (level == kNames[i] ||
+        (level.size() == 1 && level[0] == static_cast<char>('0' + i))) {
+      return static_cast<esp_log_level_t>(i);
+    }
+  }
+  return {};
+}
+
+void LoadLogLevels(ConfigStore* config_store) {
+  static constexpr size_t kPrefixLen = sizeof(kLogLevelConfigPrefix) - 1;
+  config_store->ForEachValue([](const char* full_key, std::string_view value) {
+    std::string_view key(full_key);
+    if (key.size() > kPrefixLen + 1 &&
+        key.substr(0, kPrefixLen) == kLogLevelConfigPrefix &&
+        key[kPrefixLen] == ':') {
+      auto level = ParseLogLevel(value);
+      if (level) {
+        SetLogLevel(full_key + kPrefixLen + 1, level.value());
+      }
+    }
+  });
+}
+
+LogStats GetLogStats() {
+  LogStats stats;
+  stats.dropped = g_log_dropped.load(std::memory_order_relaxed);
+  stats.rate_limited = g_log_rate_limited.load(std::memory_order_relaxed);
+  stats.deduplicated = g_log_deduplicated.load(std::memory_order_relaxed);
+  return stats;
+}
+
 void SetLogFilter(std::function<void(std::string_view)> on_log, std::string_view device_id) {
   g_on_log_cb = std::move(on_log);
   g_device_id = device_id.empty() ? "unset" : device_id;
   if (!g_orig_vprintf) {
-    g_orig_vprintf = esp_log_set_vprintf(&SyslogFormatFilter);
+    InitPersistentLog();
+    g_log_task = Task(&LogTaskMain, nullptr, "espcxx_log", kLogTaskStackBytes);
+#ifndef FAKE_ESP_IDF
+    esp_register_shutdown_handler(&FlushUndrainedLogs);
+#else
+    atexit(&FlushUndrainedLogs);
+#endif
+    g_orig_vprintf = esp_log_set_vprintf(&CaptureFilter);
   }
 }
 
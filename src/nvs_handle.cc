@@ -3,11 +3,33 @@
 #include <string.h>
 #include <assert.h>
 
+#ifdef FAKE_ESP_IDF
+#include <map>
+#endif
+
 namespace esp_cxx {
 
+#ifdef FAKE_ESP_IDF
+namespace {
+
+struct FakeNvsNamespace {
+  std::map<std::string, std::string> strings;
+  std::map<std::string, uint8_t> bytes;
+};
+
+FakeNvsNamespace* GetFakeNamespace(NvsHandle::nvs_handle handle) {
+  return static_cast<FakeNvsNamespace*>(handle);
+}
+
+}  // namespace
+#endif  // FAKE_ESP_IDF
+
 NvsHandle::NvsHandle(const char* name, Mode mode) {
 #ifndef FAKE_ESP_IDF
   nvs_open(name, static_cast<nvs_open_mode>(mode), &handle_);
+#else
+  static std::map<std::string, FakeNvsNamespace> namespaces;
+  handle_ = &namespaces[name];
 #endif
 }
 
@@ -54,6 +76,12 @@ std::optional<std::string> NvsHandle::GetString(const char* key) {
   } else {
     ESP_ERROR_CHECK(err);
   }
+#else
+  auto& strings = GetFakeNamespace(handle_)->strings;
+  auto it = strings.find(key);
+  if (it != strings.end()) {
+    result = it->second;
+  }
 #endif  // FAKE_ESP_IDF
   
   return result;
@@ -65,6 +93,8 @@ void NvsHandle::SetString(const char* key, const std::string& value) {
 
 #ifndef FAKE_ESP_IDF
   ESP_ERROR_CHECK(nvs_set_str(handle_, key, value.c_str()));
+#else
+  GetFakeNamespace(handle_)->strings[key] = value;
 #endif  // FAKE_ESP_IDF
 }
 
@@ -80,6 +110,12 @@ std::optional<uint8_t> NvsHandle::GetByte(const char* key) {
   } else {
     ESP_ERROR_CHECK(err);
   }
+#else
+  auto& bytes = GetFakeNamespace(handle_)->bytes;
+  auto it = bytes.find(key);
+  if (it != bytes.end()) {
+    result = it->second;
+  }
 #endif
 
   return result;
@@ -91,7 +127,18 @@ void NvsHandle::SetByte(const char* key, uint8_t value) {
 
 #ifndef FAKE_ESP_IDF
   ESP_ERROR_CHECK(nvs_set_u8(handle_, key, value));
+#else
+  GetFakeNamespace(handle_)->bytes[key] = value;
 #endif  // FAKE_ESP_IDF
 }
 
+#ifdef FAKE_ESP_IDF
+void NvsHandle::ForEachString(
+    const std::function<void(const char* key, std::string_view value)>& on_value) {
+  for (const auto& entry : GetFakeNamespace(handle_)->strings) {
+    on_value(entry.first.c_str(), entry.second);
+  }
+}
+#endif  // FAKE_ESP_IDF
+
 }  // namespace esp_cxx
@@ -0,0 +1,166 @@
+#include "esp_cxx/persistent_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "esp_cxx/mutex.h"
+
+#ifndef FAKE_ESP_IDF
+#include "esp_attr.h"
+#include "esp_system.h"
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace esp_cxx {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x65737043;  // "espC"
+
+// RTC slow memory is 8kB on the ESP32 and shared with the ULP and other
+// RTC_NOINIT users. Take a modest slice.
+constexpr size_t kDataBytes = 3 * 1024;
+
+struct PersistentLogBuffer {
+  uint32_t magic;
+  uint32_t check;  // ~(write_pos ^ boot_count). Catches garbage at power on.
+  uint32_t write_pos;  // Total bytes ever written. Wraps modulo kDataBytes.
+  uint32_t boot_count;
+  char data[kDataBytes];
+
+  bool IsValid() const {
+    return magic == kMagic && check == ~(write_pos ^ boot_count);
+  }
+  void Seal() { check = ~(write_pos ^ boot_count); }
+};
+
+#ifndef FAKE_ESP_IDF
+RTC_NOINIT_ATTR PersistentLogBuffer g_rtc_buffer;
+
+PersistentLogBuffer* MapBuffer() {
+  return &g_rtc_buffer;
+}
+#else
+// File-backed stand-in for RTC memory so host builds can exercise the
+// same recovery path across process restarts.
+PersistentLogBuffer* MapBuffer() {
+  static PersistentLogBuffer fallback;
+  const char* path = getenv("ESPCXX_PERSISTENT_LOG");
+  if (!path) {
+    path = "/tmp/espcxx_persistent_log.bin";
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return &fallback;
+  }
+  void* mapping = MAP_FAILED;
+  if (ftruncate(fd, sizeof(PersistentLogBuffer)) == 0) {
+    mapping = mmap(nullptr, sizeof(PersistentLogBuffer), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  return mapping == MAP_FAILED ? &fallback
+                               : static_cast<PersistentLogBuffer*>(mapping);
+}
+#endif
+
+// Serializes appends. Never held across allocation since on the ESP32 this
+// is a critical section.
+Mutex g_lock;
+std::atomic<bool> g_initialized{false};
+PersistentLogBuffer* g_buffer = nullptr;
+std::string g_previous_boot_log;
+
+// Copies the ring out in chronological order, dropping the partial line
+// at the start if the ring has wrapped.
+void RecoverPreviousBoot(const PersistentLogBuffer& buffer) {
+  size_t start = buffer.write_pos % kDataBytes;
+  if (buffer.write_pos <= kDataBytes) {
+    g_previous_boot_log.assign(buffer.data, buffer.write_pos);
+    return;
+  }
+
+  g_previous_boot_log.reserve(kDataBytes);
+  g_previous_boot_log.assign(&buffer.data[start], kDataBytes - start);
+  g_previous_boot_log.append(buffer.data, start);
+  size_t first_newline = g_previous_boot_log.find('\n');
+  if (first_newline != std::string::npos) {
+    g_previous_boot_log.erase(0, first_newline + 1);
+  }
+}
+
+}  // namespace
+
+void InitPersistentLog() {
+  if (g_initialized.exchange(true)) {
+    return;
+  }
+
+  PersistentLogBuffer* buffer = MapBuffer();
+  uint32_t boot_count = 0;
+  if (buffer->IsValid()) {
+    RecoverPreviousBoot(*buffer);
+    boot_count = buffer->boot_count + 1;
+  }
+
+  buffer->magic = kMagic;
+  buffer->write_pos = 0;
+  buffer->boot_count = boot_count;
+  buffer->Seal();
+  {
+    std::lock_guard<Mutex> lock(g_lock);
+    g_buffer = buffer;
+  }
+
+#ifndef FAKE_ESP_IDF
+  // Record why the previous boot ended. Most useful on watchdog and panic.
+  char reason[48];
+  int len = snprintf(reason, sizeof(reason), "--- boot %u, reset reason %d ---\n",
+                     boot_count, static_cast<int>(esp_reset_reason()));
+  g_previous_boot_log.append(reason, len);
+#endif
+}
+
+void AppendPersistentLog(std::string_view text) {
+  std::lock_guard<Mutex> lock(g_lock);
+  if (!g_buffer) {
+    return;
+  }
+
+  // Only the tail can survive anyway.
+  if (text.size() > kDataBytes) {
+    text.remove_prefix(text.size() - kDataBytes);
+  }
+
+  size_t offset = g_buffer->write_pos % kDataBytes;
+  size_t first = std::min(text.size(), kDataBytes - offset);
+  memcpy(&g_buffer->data[offset], text.data(), first);
+  memcpy(&g_buffer->data[0], text.data() + first, text.size() - first);
+  g_buffer->write_pos += text.size();
+
+  // Keep write_pos from wrapping the uint32_t. Any value past kDataBytes
+  // with the same remainder describes the same ring.
+  if (g_buffer->write_pos >= 2 * kDataBytes) {
+    g_buffer->write_pos -= kDataBytes;
+  }
+  g_buffer->Seal();
+}
+
+std::string_view GetPreviousBootLog() {
+  return g_previous_boot_log;
+}
+
+uint32_t GetPersistentLogBootCount() {
+  return g_buffer ? g_buffer->boot_count : 0;
+}
+
+}  // namespace esp_cxx
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <chrono>
 
 #include "esp_cxx/task.h"
 
@@ -102,6 +103,20 @@ void TaskRef::Wait() {
 #endif
 }
 
+bool TaskRef::Wait(int timeout_ms) {
+#ifndef FAKE_ESP_IDF
+  return xTaskNotifyWait(0x00, ULONG_MAX, NULL,
+                         timeout_ms / portTICK_PERIOD_MS) == pdTRUE;
+#else  // FAKE_ESP_IDF
+  std::unique_lock<std::mutex> lock(notification_lock_);
+  notification_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                            [this] { return is_notified_; });
+  bool notified = is_notified_;
+  is_notified_ = false;
+  return notified;
+#endif
+}
+
 void TaskRef::Delay(int delay_ms) {
 #ifndef FAKE_ESP_IDF
   vTaskDelay(delay_ms / portTICK_PERIOD_MS);
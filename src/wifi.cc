@@ -42,6 +42,11 @@ Wifi::Wifi() = default;
 
 Wifi::~Wifi() {
   Disconnect();
+#ifndef FAKE_ESP_IDF
+  if (reconnect_timer_) {
+    esp_timer_delete(reconnect_timer_);
+  }
+#endif  // FAKE_ESP_IDF
 }
 
 Wifi* Wifi::GetInstance() {
@@ -102,7 +107,21 @@ bool Wifi::ConnectToAP() {
 
 void Wifi::ReconnectToAP() {
 #ifndef FAKE_ESP_IDF
-  esp_wifi_connect();
+  if (reconnect_pending_.exchange(true)) {
+    return;
+  }
+
+  if (!reconnect_timer_) {
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = &ReconnectTimerThunk;
+    timer_args.arg = this;
+    timer_args.name = "wifi_reconnect";
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &reconnect_timer_));
+  }
+
+  int delay_ms = RetryBudget::ReserveShared(reconnect_backoff_.MsToNextTry());
+  ESP_LOGI(kEspCxxTag, "Reconnecting wifi in %d", delay_ms);
+  ESP_ERROR_CHECK(esp_timer_start_once(reconnect_timer_, delay_ms * 1000ULL));
 #endif
 }
 
@@ -140,12 +159,23 @@ bool Wifi::CreateSetupNetwork(const std::string& setup_ssid,
 
 void Wifi::Disconnect() {
 #ifndef FAKE_ESP_IDF
+  // A pending reconnect must not restart the connection afterwards.
+  if (reconnect_timer_) {
+    esp_timer_stop(reconnect_timer_);
+  }
+  reconnect_pending_ = false;
   esp_wifi_stop();
 #endif  // FAKE_ESP_IDF
 }
 
 #ifndef FAKE_ESP_IDF
 
+void Wifi::ReconnectTimerThunk(void* arg) {
+  Wifi* wifi = reinterpret_cast<Wifi*>(arg);
+  wifi->reconnect_pending_ = false;
+  esp_wifi_connect();
+}
+
 void Wifi::EventHandlerThunk(void* arg, esp_event_base_t event_base,
                              int32_t event_id, void* event_data) {
   Wifi* wifi = reinterpret_cast<Wifi*>(arg);
@@ -205,6 +235,7 @@ void Wifi::OnWifiEvent(esp_event_base_t event_base, int32_t event_id,
     ip_event_got_ip_t *got_ip =
         reinterpret_cast<ip_event_got_ip_t*>(event_data);
     ESP_LOGI(kEspCxxTag, "got ip:%s", ip4addr_ntoa(&got_ip->ip_info.ip));
+    reconnect_backoff_.Reset();
     if (on_ap_connect_) {
       on_ap_connect_(got_ip);
     }
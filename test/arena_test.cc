@@ -0,0 +1,72 @@
+#include "esp_cxx/arena.h"
+
+#include <cstdint>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using namespace esp_cxx;
+
+TEST(Arena, AllocatesAlignedFromBlocks) {
+  Arena arena(256);
+  char* a = static_cast<char*>(arena.Allocate(3, 1));
+  void* b = arena.Allocate(8, 8);
+  EXPECT_TRUE(arena.Contains(a));
+  EXPECT_TRUE(arena.Contains(b));
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(b) % 8);
+  EXPECT_EQ(11u, arena.bytes_used());
+
+  // Larger than a quarter block gets a dedicated block.
+  void* big = arena.Allocate(1000);
+  EXPECT_TRUE(arena.Contains(big));
+  int on_stack;
+  EXPECT_FALSE(arena.Contains(&on_stack));
+
+  arena.Reset();
+  EXPECT_EQ(0u, arena.bytes_used());
+  EXPECT_FALSE(arena.Contains(big));
+}
+
+TEST(Arena, ScopeSetsCurrent) {
+  Arena outer;
+  Arena inner;
+  EXPECT_EQ(nullptr, Arena::Current());
+  {
+    Arena::Scope outer_scope(&outer);
+    EXPECT_EQ(&outer, Arena::Current());
+    {
+      Arena::Scope inner_scope(&inner);
+      EXPECT_EQ(&inner, Arena::Current());
+      Arena::Scope null_scope(nullptr);
+      EXPECT_EQ(&inner, Arena::Current());
+    }
+    EXPECT_EQ(&outer, Arena::Current());
+  }
+  EXPECT_EQ(nullptr, Arena::Current());
+}
+
+TEST(Arena, BacksStlContainers) {
+  Arena arena;
+  using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+  ArenaString str{ArenaAllocator<char>(&arena)};
+  str.assign(100, 'x');
+  EXPECT_TRUE(arena.Contains(str.data()));
+}
+
+TEST(Arena, OwnsChecksEveryLiveArena) {
+  Arena first;
+  void* small = first.Allocate(16);
+  int on_stack = 0;
+  {
+    Arena second;
+    void* large = second.Allocate(1000);  // Dedicated block.
+    EXPECT_TRUE(Arena::Owns(small));
+    EXPECT_TRUE(Arena::Owns(large));
+    EXPECT_FALSE(Arena::Owns(&on_stack));
+  }
+
+  // Reset() keeps the first block.
+  first.Reset();
+  EXPECT_TRUE(Arena::Owns(small));
+}
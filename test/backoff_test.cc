@@ -0,0 +1,60 @@
+#include "esp_cxx/backoff.h"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using namespace esp_cxx;
+
+TEST(Backoff, CappedExponentialDoublesToCap) {
+  CappedExponentialBackoff<100, 1000, 0> backoff;
+  EXPECT_EQ(100, backoff.MsToNextTry());
+  EXPECT_EQ(200, backoff.MsToNextTry());
+  EXPECT_EQ(400, backoff.MsToNextTry());
+  EXPECT_EQ(800, backoff.MsToNextTry());
+  EXPECT_EQ(1000, backoff.MsToNextTry());
+  EXPECT_EQ(1000, backoff.MsToNextTry());
+  backoff.Reset();
+  EXPECT_EQ(100, backoff.MsToNextTry());
+}
+
+TEST(Backoff, JitterStaysInBounds) {
+  FullJitterBackoff<100, 5000> full;
+  DecorrelatedJitterBackoff<100, 5000> decorrelated;
+  BackoffCalculator<> compat;
+  for (int i = 0; i < 1000; ++i) {
+    int ms = full.MsToNextTry();
+    EXPECT_GE(ms, 0);
+    EXPECT_LE(ms, 5000);
+
+    ms = decorrelated.MsToNextTry();
+    EXPECT_GE(ms, 100);
+    EXPECT_LE(ms, 5000);
+
+    ms = compat.MsToNextTry();
+    EXPECT_GE(ms, 100);
+    EXPECT_LE(ms, 30*60*1000 + 1000);
+  }
+}
+
+TEST(Backoff, RetryBudgetSpacesOutBursts) {
+  RetryBudget budget(2, 1000);
+  EXPECT_EQ(0, budget.Reserve(0));
+  EXPECT_EQ(0, budget.Reserve(0));
+  // Bucket is empty. Next token arrives in a refill interval.
+  EXPECT_NEAR(1000, budget.Reserve(0), 5);
+  EXPECT_NEAR(2000, budget.Reserve(0), 5);
+  // A delay longer than the wait is left alone.
+  EXPECT_NEAR(5000, budget.Reserve(5000), 5);
+}
+
+TEST(Backoff, RetryBudgetFarRetryDoesNotBlockOthers) {
+  RetryBudget budget(4, 1000);
+  // One user backs off for a minute.
+  EXPECT_NEAR(60000, budget.Reserve(60000), 5);
+  // Another still gets its short retry from the remaining tokens.
+  EXPECT_NEAR(500, budget.Reserve(500), 5);
+  EXPECT_EQ(0, budget.Reserve(0));
+  EXPECT_EQ(0, budget.Reserve(0));
+  // Only now is the bucket empty.
+  EXPECT_NEAR(1000, budget.Reserve(0), 5);
+}
@@ -0,0 +1,70 @@
+#include "esp_cxx/deflate.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+using namespace esp_cxx;
+
+TEST(Deflate, RoundTrips) {
+  std::string json;
+  for (int i = 0; i < 20; ++i) {
+    json += "{\"id\":" + std::to_string(i) + ",\"name\":\"sensor\",\"ok\":true}";
+  }
+
+  for (std::string_view input : {std::string_view(), std::string_view("a"),
+                                 std::string_view(json)}) {
+    std::string compressed;
+    Deflate(input, kMaxDeflateWindowBits, &compressed);
+    // Ends with a sync flush, which permessage-deflate strips.
+    ASSERT_GE(compressed.size(), 4);
+    EXPECT_EQ(std::string("\x00\x00\xff\xff", 4),
+              compressed.substr(compressed.size() - 4));
+
+    std::string output;
+    ASSERT_TRUE(Inflate(compressed, input.size(), &output));
+    EXPECT_EQ(input, output);
+  }
+
+  std::string compressed;
+  Deflate(json, 8, &compressed);
+  EXPECT_LT(compressed.size(), json.size() / 4);
+}
+
+TEST(Deflate, InflatesDynamicHuffmanBlocks) {
+  // zlib, Z_HUFFMAN_ONLY, raw, sync flushed.
+  const std::string compressed(
+      "\x04\xc1\x89\x01\x80\x20\x0c\x00\xb1\x55\x6e\x0f\xa6\x11\xac\xa0"
+      "\x82\x85\x0a\x7e\xd3\x9b\xf4\x24\xb4\xb1\x86\x1d\x6f\x7a\x1f\x2c"
+      "\xfa\xb0\x8d\x52\x4f\xf4\x12\xa3\x27\x21\x4f\xdf\xcb\xac\xd1\xd1"
+      "\x93\xd0\xc6\x1a\x76\xbc\xe9\x7d\xb0\xe8\xc3\x36\x4a\x3d\xd1\x4b"
+      "\x8c\x9e\x84\x3c\x7d\x2f\xb3\x46\x47\x4f\x42\x1b\x6b\xd8\xf1\xa6"
+      "\xf7\xc1\xa2\x0f\xdb\x28\xf5\x44\x2f\x31\x7a\x12\xf2\xf4\xbd\xcc"
+      "\x1a\x1d\x3d\x09\x6d\xac\x61\xc7\x9b\xde\x07\x8b\x3e\x6c\xa3\xd4"
+      "\x13\xbd\xc4\xe8\x49\xc8\xd3\xf7\x32\x6b\x74\xfc\x00\x00\x00\xff"
+      "\xff",
+      129);
+  std::string expected;
+  for (int i = 0; i < 4; ++i) {
+    expected += "the quick brown fox jumps over the lazy dog; ";
+  }
+
+  std::string output = "prefix";
+  ASSERT_TRUE(Inflate(compressed, expected.size(), &output));
+  EXPECT_EQ("prefix" + expected, output);
+}
+
+TEST(Deflate, RejectsBadInput) {
+  std::string compressed;
+  Deflate(std::string(1000, 'x'), kMaxDeflateWindowBits, &compressed);
+
+  std::string output;
+  EXPECT_FALSE(Inflate(compressed, 999, &output));
+
+  output.clear();
+  EXPECT_FALSE(Inflate(compressed.substr(0, compressed.size() - 6), 1000, &output));
+
+  output.clear();
+  // Reserved block type.
+  EXPECT_FALSE(Inflate("\x07", 1000, &output));
+}
@@ -0,0 +1,20 @@
+#include "esp_cxx/event_manager.h"
+
+#include "gtest/gtest.h"
+
+using namespace esp_cxx;
+
+namespace {
+
+TEST(EventManager, RunAfterReportsFullQueue) {
+  QueueSetEventManager event_manager(20);
+  int scheduled = 0;
+  while (event_manager.RunDelayed([] {}, 1000)) {
+    ++scheduled;
+    ASSERT_LT(scheduled, 100);
+  }
+  EXPECT_GT(scheduled, 0);
+  EXPECT_FALSE(event_manager.Run([] {}));
+}
+
+}  // namespace
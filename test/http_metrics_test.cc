@@ -0,0 +1,43 @@
+#include "esp_cxx/httpd/http_metrics.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using namespace esp_cxx;
+using testing::HasSubstr;
+
+TEST(HttpMetrics, AssignsSlotsAndOverflowsToOther) {
+  HttpMetrics metrics;
+  int stats = metrics.AddRoute("/api/stats$");
+  EXPECT_EQ(1, stats);
+  EXPECT_EQ(stats, metrics.AddRoute("/api/stats$"));
+  for (int i = 2; i < HttpMetrics::kMaxRoutes; ++i) {
+    EXPECT_EQ(i, metrics.AddRoute("/r" + std::to_string(i)));
+  }
+  EXPECT_EQ(0, metrics.AddRoute("/one/too/many"));
+}
+
+TEST(HttpMetrics, PrometheusHistogramIsCumulative) {
+  HttpMetrics metrics;
+  int route = metrics.AddRoute("/api/stats$");
+  metrics.RecordRequest(route, 200, 100);
+  metrics.RecordRequest(route, 404, 50);
+  metrics.RecordBytesOut(route, 300);
+  metrics.RecordLatency(route, HttpMetrics::kHandler, 100);
+  metrics.RecordLatency(route, HttpMetrics::kHandler, 200);
+  metrics.RecordLatency(route, HttpMetrics::kHandler, 10 * 1000 * 1000);
+
+  std::string out;
+  metrics.WritePrometheus([&out](std::string_view data) { out.append(data.data(), data.size()); });
+
+  EXPECT_THAT(out, HasSubstr("espcxx_http_requests_total{route=\"/api/stats$\",code=\"2xx\"} 1\n"));
+  EXPECT_THAT(out, HasSubstr("espcxx_http_requests_total{route=\"/api/stats$\",code=\"4xx\"} 1\n"));
+  EXPECT_THAT(out, HasSubstr("espcxx_http_request_bytes_total{route=\"/api/stats$\"} 150\n"));
+  EXPECT_THAT(out, HasSubstr("espcxx_http_response_bytes_total{route=\"/api/stats$\"} 300\n"));
+  EXPECT_THAT(out, HasSubstr("espcxx_http_handler_seconds_bucket{route=\"/api/stats$\",le=\"0.000125\"} 1\n"));
+  EXPECT_THAT(out, HasSubstr("espcxx_http_handler_seconds_bucket{route=\"/api/stats$\",le=\"0.00025\"} 2\n"));
+  EXPECT_THAT(out, HasSubstr("espcxx_http_handler_seconds_bucket{route=\"/api/stats$\",le=\"+Inf\"} 3\n"));
+  EXPECT_THAT(out, HasSubstr("espcxx_http_handler_seconds_count{route=\"/api/stats$\"} 3\n"));
+}
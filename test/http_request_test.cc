@@ -0,0 +1,103 @@
+#include "esp_cxx/httpd/http_request.h"
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+using namespace esp_cxx;
+
+namespace {
+
+mg_str MgStr(const char* s) {
+  return {s, strlen(s)};
+}
+
+}  // namespace
+
+TEST(ClassifyHttpHeader, KnownHeaders) {
+  EXPECT_EQ(HttpHeader::kHost, ClassifyHttpHeader("Host"));
+  EXPECT_EQ(HttpHeader::kOrigin, ClassifyHttpHeader("Origin"));
+  EXPECT_EQ(HttpHeader::kUpgrade, ClassifyHttpHeader("Upgrade"));
+  EXPECT_EQ(HttpHeader::kConnection, ClassifyHttpHeader("Connection"));
+  EXPECT_EQ(HttpHeader::kContentType, ClassifyHttpHeader("Content-Type"));
+  EXPECT_EQ(HttpHeader::kContentLength, ClassifyHttpHeader("Content-Length"));
+  EXPECT_EQ(HttpHeader::kAcceptEncoding, ClassifyHttpHeader("Accept-Encoding"));
+  EXPECT_EQ(HttpHeader::kSecWebsocketExtensions,
+            ClassifyHttpHeader("Sec-WebSocket-Extensions"));
+}
+
+TEST(ClassifyHttpHeader, SameLengthHeaders) {
+  // 13 characters.
+  EXPECT_EQ(HttpHeader::kAuthorization, ClassifyHttpHeader("Authorization"));
+  EXPECT_EQ(HttpHeader::kIfNoneMatch, ClassifyHttpHeader("If-None-Match"));
+  EXPECT_EQ(HttpHeader::kNumHeaders, ClassifyHttpHeader("Cache-Control"));
+  EXPECT_EQ(HttpHeader::kNumHeaders, ClassifyHttpHeader("Accept-Ranges"));
+
+  // 17 characters.
+  EXPECT_EQ(HttpHeader::kSecWebsocketKey, ClassifyHttpHeader("Sec-WebSocket-Key"));
+  EXPECT_EQ(HttpHeader::kTransferEncoding, ClassifyHttpHeader("Transfer-Encoding"));
+  EXPECT_EQ(HttpHeader::kNumHeaders, ClassifyHttpHeader("If-Modified-Since"));
+  EXPECT_EQ(HttpHeader::kNumHeaders, ClassifyHttpHeader("Sec-WebSocket-Foo"));
+}
+
+TEST(ClassifyHttpHeader, IgnoresCase) {
+  EXPECT_EQ(HttpHeader::kHost, ClassifyHttpHeader("HOST"));
+  EXPECT_EQ(HttpHeader::kAuthorization, ClassifyHttpHeader("aUTHORIZATION"));
+  EXPECT_EQ(HttpHeader::kIfNoneMatch, ClassifyHttpHeader("if-none-match"));
+  EXPECT_EQ(HttpHeader::kSecWebsocketKey, ClassifyHttpHeader("sec-websocket-key"));
+  EXPECT_EQ(HttpHeader::kTransferEncoding, ClassifyHttpHeader("TRANSFER-ENCODING"));
+  EXPECT_EQ(HttpHeader::kNumHeaders, ClassifyHttpHeader(""));
+  EXPECT_EQ(HttpHeader::kNumHeaders, ClassifyHttpHeader("X-Host"));
+}
+
+TEST(HttpRequest, Method) {
+  struct {
+    const char* method;
+    HttpMethod expected;
+  } cases[] = {
+    {"GET", HttpMethod::kGet},
+    {"PUT", HttpMethod::kPut},
+    {"POST", HttpMethod::kPost},
+    {"HEAD", HttpMethod::kHead},
+    {"TRACE", HttpMethod::kTrace},
+    {"DELETE", HttpMethod::kDelete},
+    {"OPTIONS", HttpMethod::kOptions},
+    {"CONNECT", HttpMethod::kConnect},
+    // Methods are case-sensitive.
+    {"get", HttpMethod::kUnknown},
+    {"Post", HttpMethod::kUnknown},
+    {"PATCH", HttpMethod::kUnknown},
+    {"", HttpMethod::kUnknown},
+  };
+  for (const auto& test_case : cases) {
+    http_message message = {};
+    message.method = MgStr(test_case.method);
+    EXPECT_EQ(test_case.expected, HttpRequest(&message).method()) << test_case.method;
+  }
+}
+
+TEST(HttpRequest, GetHeaderUsesFirstOfEach) {
+  http_message message = {};
+  message.method = MgStr("GET");
+  const char* headers[][2] = {
+    {"if-none-match", "\"a\""},
+    {"Authorization", "Bearer x"},
+    {"If-None-Match", "\"b\""},
+    {"X-Other", "1"},
+  };
+  for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); ++i) {
+    message.header_names[i] = MgStr(headers[i][0]);
+    message.header_values[i] = MgStr(headers[i][1]);
+  }
+
+  HttpRequest request(&message);
+  EXPECT_EQ("\"a\"", request.GetHeader(HttpHeader::kIfNoneMatch));
+  EXPECT_EQ("Bearer x", request.GetHeader(HttpHeader::kAuthorization));
+  EXPECT_EQ("", request.GetHeader(HttpHeader::kHost));
+
+  // Copies carry the index.
+  HttpRequest copy = request;
+  EXPECT_EQ("Bearer x", copy.GetHeader(HttpHeader::kAuthorization));
+
+  EXPECT_EQ("", HttpRequest().GetHeader(HttpHeader::kHost));
+}
@@ -0,0 +1,229 @@
+#include "esp_cxx/httpd/http_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "esp_cxx/httpd/mongoose_event_manager.h"
+
+#include "gtest/gtest.h"
+
+using namespace esp_cxx;
+
+namespace {
+
+constexpr int kPort = 18941;
+constexpr char kListenAddress[] = "127.0.0.1:18941";
+
+// Body produced by StreamHandler(), set up by each test. Read on the
+// event loop thread.
+std::atomic<int> g_not_ready_reads;  // Reads that return 0 before any data.
+std::atomic<size_t> g_body_size;
+std::atomic<int> g_reader_result;  // Returned once the body is done.
+std::atomic<int> g_reads;
+
+void StreamHandler(HttpRequest request, HttpResponse response) {
+  response.Send(200, -1, HttpResponse::kContentTypePlain, {});
+  auto sent = std::make_shared<size_t>(0);
+  response.SendFrom([sent](char* buffer, size_t size) {
+    g_reads++;
+    if (g_not_ready_reads > 0) {
+      g_not_ready_reads--;
+      return 0;
+    }
+    if (*sent == g_body_size) {
+      return g_reader_result.load();
+    }
+    size_t len = std::min(size, g_body_size - *sent);
+    memset(buffer, 'a' + (*sent / size) % 26, len);
+    *sent += len;
+    return static_cast<int>(len);
+  });
+  // Returns with the body still streaming so the request is only finished
+  // once the reader is done.
+}
+
+void SmallHandler(HttpRequest request, HttpResponse response) {
+  response.Send(200, 2, HttpResponse::kContentTypePlain, "ok");
+}
+
+// Reads from |fd| until |response| ends with |terminator| or the
+// connection is closed.
+void ReadUntil(int fd, const char* terminator, std::string* response) {
+  size_t terminator_len = strlen(terminator);
+  char buffer[1024];
+  while (response->size() < terminator_len ||
+         response->compare(response->size() - terminator_len, terminator_len,
+                           terminator) != 0) {
+    ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+    if (len <= 0) {
+      return;
+    }
+    response->append(buffer, len);
+  }
+}
+
+// Removes chunked transfer coding from the body of |response|.
+std::string Dechunk(const std::string& response) {
+  std::string body;
+  size_t pos = response.find("\r\n\r\n");
+  if (pos == std::string::npos) {
+    return body;
+  }
+  pos += 4;
+  while (pos < response.size()) {
+    size_t line_end = response.find("\r\n", pos);
+    if (line_end == std::string::npos) {
+      break;
+    }
+    size_t chunk_size = strtoul(response.c_str() + pos, nullptr, 16);
+    if (chunk_size == 0) {
+      break;
+    }
+    body.append(response, line_end + 2, chunk_size);
+    pos = line_end + 2 + chunk_size + 2;
+  }
+  return body;
+}
+
+class HttpServerTest : public testing::Test {
+ protected:
+  // One server for the suite, looping on its own thread. Loop() cannot be
+  // restarted once it quits.
+  static void SetUpTestSuite() {
+    event_manager_ = new MongooseEventManager();
+    server_ = new HttpServer(event_manager_, "not found");
+    server_->RegisterEndpoint<&StreamHandler>("/stream");
+    server_->RegisterEndpoint<&SmallHandler>("/small");
+    server_->Listen(kListenAddress);
+    loop_thread_ = new std::thread([] { event_manager_->Loop(); });
+  }
+
+  static void TearDownTestSuite() {
+    event_manager_->Run([] { event_manager_->Quit(); });
+    loop_thread_->join();
+    delete loop_thread_;
+  }
+
+  void SetUp() override {
+    g_not_ready_reads = 0;
+    g_body_size = 0;
+    g_reader_result = HttpResponse::kEndOfBody;
+    g_reads = 0;
+
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    // Small receive buffer so the server's send buffer backs up.
+    int rcvbuf = 1024;
+    setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    // Nothing may hang the suite.
+    timeval timeout = {10, 0};
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(0, connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+        << strerror(errno);
+  }
+
+  void TearDown() override {
+    close(fd_);
+  }
+
+  void Send(std::string_view data) {
+    ASSERT_EQ(static_cast<ssize_t>(data.size()), send(fd_, data.data(), data.size(), 0));
+  }
+
+  static MongooseEventManager* event_manager_;
+  static HttpServer* server_;
+  static std::thread* loop_thread_;
+
+  int fd_ = -1;
+};
+
+MongooseEventManager* HttpServerTest::event_manager_ = nullptr;
+HttpServer* HttpServerTest::server_ = nullptr;
+std::thread* HttpServerTest::loop_thread_ = nullptr;
+
+TEST_F(HttpServerTest, StreamsBodyUnderFlowControl) {
+  // Several times kSendHighWater, so the body is produced from MG_EV_SEND
+  // as the socket drains.
+  g_body_size = 10 * HttpResponse::kSendHighWater + 123;
+
+  std::string response;
+  Send("GET /stream HTTP/1.1\r\n\r\n");
+  ReadUntil(fd_, "\r\n0\r\n\r\n", &response);
+
+  std::string body = Dechunk(response);
+  ASSERT_EQ(g_body_size, body.size());
+  EXPECT_EQ('a', body[0]);
+  EXPECT_EQ('b', body[512]);
+}
+
+TEST_F(HttpServerTest, RetriesReaderWithNothingReadyOnPoll) {
+  // Once the headers are out there is no socket activity while the reader
+  // has nothing, so only the retry timer brings it back.
+  g_not_ready_reads = 3;
+  g_body_size = 100;
+
+  std::string response;
+  Send("GET /stream HTTP/1.1\r\n\r\n");
+  ReadUntil(fd_, "\r\n0\r\n\r\n", &response);
+
+  EXPECT_EQ(std::string(100, 'a'), Dechunk(response));
+  // Three not ready, one with the body, one for the end.
+  EXPECT_EQ(5, g_reads);
+}
+
+TEST_F(HttpServerTest, FinishesDeferredRequestBeforeNextOne) {
+  g_not_ready_reads = 2;
+  g_body_size = 3 * HttpResponse::kSendHighWater;
+
+  std::string first;
+  std::string second;
+  // Pipelined behind the streaming response. The connection is closed
+  // once the stream finishes and the second request is not answered.
+  Send("GET /stream HTTP/1.1\r\n\r\n"
+       "GET /small HTTP/1.1\r\n\r\n");
+  ReadUntil(fd_, "\r\n0\r\n\r\n", &first);
+  ReadUntil(fd_, "\r\n\r\nok", &second);
+
+  EXPECT_EQ(g_body_size, Dechunk(first).size());
+  EXPECT_EQ("", second);
+}
+
+TEST_F(HttpServerTest, KeepsConnectionAfterDeferredFinish) {
+  g_body_size = 3 * HttpResponse::kSendHighWater;
+
+  std::string first;
+  std::string second;
+  Send("GET /stream HTTP/1.1\r\n\r\n");
+  ReadUntil(fd_, "\r\n0\r\n\r\n", &first);
+  Send("GET /small HTTP/1.1\r\n\r\n");
+  ReadUntil(fd_, "\r\n\r\nok", &second);
+
+  EXPECT_EQ(g_body_size, Dechunk(first).size());
+  EXPECT_EQ(0u, second.find("HTTP/1.1 200"));
+}
+
+TEST_F(HttpServerTest, ReaderErrorClosesWithoutLastChunk) {
+  g_body_size = 100;
+  g_reader_result = -5;
+
+  std::string response;
+  Send("GET /stream HTTP/1.1\r\n\r\n");
+  ReadUntil(fd_, "\r\n0\r\n\r\n", &response);  // Stops at the close.
+
+  EXPECT_EQ(std::string::npos, response.find("\r\n0\r\n\r\n"));
+}
+
+}  // namespace
@@ -0,0 +1,47 @@
+#include "esp_cxx/json_writer.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using namespace esp_cxx;
+
+TEST(JsonWriter, NestedContainers) {
+  std::string out;
+  {
+    JsonWriter json([&out](std::string_view data) { out.append(data.data(), data.size()); });
+    json.BeginObject();
+    json.Key("a").Int(-1);
+    json.Key("b").BeginArray().Uint(2).Bool(true).Null().BeginObject().EndObject().EndArray();
+    json.Key("c").Double(0.5);
+    json.Key("d").BeginArray().EndArray();
+    json.EndObject();
+  }
+  EXPECT_EQ(R"({"a":-1,"b":[2,true,null,{}],"c":0.5,"d":[]})", out);
+}
+
+TEST(JsonWriter, EscapesStrings) {
+  std::string out;
+  {
+    JsonWriter json([&out](std::string_view data) { out.append(data.data(), data.size()); });
+    json.String(std::string_view("q\"b\\n\n\x01\0", 8));
+  }
+  EXPECT_EQ(R"("q\"b\\n\n\u0001\u0000")", out);
+}
+
+TEST(JsonWriter, FlushesInBoundedPieces) {
+  std::string out;
+  size_t max_piece = 0;
+  std::string big(1000, 'x');
+  {
+    JsonWriter json([&](std::string_view data) {
+      max_piece = std::max(max_piece, data.size());
+      out.append(data.data(), data.size());
+    });
+    json.BeginArray().String(big).String(big).EndArray();
+    EXPECT_EQ(2 * big.size() + 7, json.bytes_written());
+  }
+  EXPECT_EQ("[\"" + big + "\",\"" + big + "\"]", out);
+  EXPECT_LE(max_piece, 256u);
+}
@@ -0,0 +1,111 @@
+#include "esp_cxx/log_ring.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+namespace esp_cxx {
+
+namespace {
+
+void Capture(LogRecord* record, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  CaptureLogRecord(record, 1234, format, args);
+  va_end(args);
+}
+
+std::string Format(const LogRecord& record) {
+  char buf[256];
+  size_t len = FormatLogRecord(record, buf, sizeof(buf));
+  return std::string(buf, std::min(len, sizeof(buf) - 1));
+}
+
+}  // namespace
+
+TEST(LogRing, FormatsLikePrintf) {
+  LogRecord record;
+  std::string transient = "gone soon";
+  Capture(&record, "int %d uint %u hex %08x long %ld ll %lld size %zu dbl %.2f str %s %% end",
+          -5, 7u, 0xbeef, -123456L, 1LL << 40, sizeof(record), 3.14159, transient.c_str());
+  transient = "overwritten";
+
+  char expected[256];
+  snprintf(expected, sizeof(expected),
+           "int %d uint %u hex %08x long %ld ll %lld size %zu dbl %.2f str %s %% end",
+           -5, 7u, 0xbeef, -123456L, 1LL << 40, sizeof(record), 3.14159, "gone soon");
+  EXPECT_EQ(expected, Format(record));
+  EXPECT_FALSE(record.truncated);
+}
+
+TEST(LogRing, StarWidthAndPrecision) {
+  LogRecord record;
+  const char not_terminated[] = {'a', 'b', 'c', 'd'};
+  Capture(&record, "[%*d] [%.*s] [%-*.*s]", 5, 42, 3, not_terminated, 6, 2, "xyz");
+  EXPECT_EQ("[   42] [abc] [xy    ]", Format(record));
+}
+
+TEST(LogRing, ParsesEspIdfPrefix) {
+  static constexpr char kTag[] = "mytag";
+  LogRecord record;
+  Capture(&record, "\033[0;33mW (%u) %s: hello %d\033[0m\n", 99u, kTag, 1);
+  EXPECT_EQ(2, record.level);  // ESP_LOG_WARN
+  EXPECT_EQ(kTag, record.tag);
+  EXPECT_EQ("\033[0;33mW (99) mytag: hello 1\033[0m\n", Format(record));
+}
+
+TEST(LogRing, TruncatesLongStrings) {
+  LogRecord record;
+  std::string huge(LogRecord::kArgBytes * 2, 'x');
+  Capture(&record, "%s %d", huge.c_str(), 5);
+  EXPECT_TRUE(record.truncated);
+  std::string formatted = Format(record);
+  EXPECT_THAT(formatted, ::testing::HasSubstr("<truncated>"));
+}
+
+TEST(LogRing, DropsWhenFull) {
+  LogRing<4> ring;
+  int pushed = 0;
+  for (int i = 0; i < 6; ++i) {
+    pushed += ring.Push([i](LogRecord* record) { record->timestamp = i; });
+  }
+  EXPECT_EQ(4, pushed);
+  EXPECT_EQ(2u, ring.TakeDropped());
+  EXPECT_EQ(0u, ring.TakeDropped());
+
+  uint32_t expected = 0;
+  while (ring.Pop([&](const LogRecord& record) {
+           EXPECT_EQ(expected++, record.timestamp);
+         })) {
+  }
+  EXPECT_EQ(4u, expected);
+  EXPECT_TRUE(ring.Push([](LogRecord* record) {}));
+}
+
+TEST(LogRing, PeekPendingLeavesRecordsQueued) {
+  LogRing<4> ring;
+  for (uint32_t i = 0; i < 6; ++i) {
+    ring.Push([i](LogRecord* record) { record->timestamp = i; });
+  }
+  ring.Pop([](const LogRecord& record) {});
+  ring.Push([](LogRecord* record) { record->timestamp = 10; });
+
+  std::vector<uint32_t> peeked;
+  ring.PeekPending([&](const LogRecord& record) { peeked.push_back(record.timestamp); });
+  EXPECT_THAT(peeked, ::testing::ElementsAre(1, 2, 3, 10));
+
+  uint32_t popped = 0;
+  while (ring.Pop([](const LogRecord& record) {})) {
+    popped++;
+  }
+  EXPECT_EQ(4u, popped);
+
+  peeked.clear();
+  ring.PeekPending([&](const LogRecord& record) { peeked.push_back(record.timestamp); });
+  EXPECT_TRUE(peeked.empty());
+}
+
+}  // namespace esp_cxx
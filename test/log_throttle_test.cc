@@ -0,0 +1,119 @@
+#include "esp_cxx/log_throttle.h"
+
+#include <cstdarg>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+namespace esp_cxx {
+
+namespace {
+
+LogRecord Capture(const char* format, ...) {
+  LogRecord record;
+  va_list args;
+  va_start(args, format);
+  CaptureLogRecord(&record, 1234, format, args);
+  va_end(args);
+  return record;
+}
+
+class Summaries {
+ public:
+  std::function<void(std::string_view)> callback() {
+    return [this](std::string_view summary) { lines_.emplace_back(summary); };
+  }
+
+  const std::vector<std::string>& lines() const { return lines_; }
+  void clear() { lines_.clear(); }
+
+ private:
+  std::vector<std::string> lines_;
+};
+
+}  // namespace
+
+TEST(LogThrottle, RateLimitsACallSite) {
+  LogThrottle throttle(3, 1, 100);
+  Summaries summaries;
+  static const char kFormat[] = "value %d\n";
+
+  int admitted = 0;
+  for (int i = 0; i < 10; ++i) {
+    admitted += throttle.Admit(Capture(kFormat, i), 0, summaries.callback());
+  }
+  EXPECT_EQ(3, admitted);
+  EXPECT_EQ(7u, throttle.stats().rate_limited);
+
+  // One token back after a second. The next admitted line is preceded by
+  // the count of what was dropped.
+  EXPECT_TRUE(throttle.Admit(Capture(kFormat, 100), 1000, summaries.callback()));
+  ASSERT_EQ(1u, summaries.lines().size());
+  EXPECT_THAT(summaries.lines()[0], testing::HasSubstr("7 lines suppressed"));
+}
+
+TEST(LogThrottle, CollidingSitesShareTokens) {
+  // Find two call sites that map to the same bucket.
+  static const char kFormats[64][8] = {};
+  const char* first = kFormats[0];
+  const char* second = nullptr;
+  for (size_t i = 1; i < 64 && !second; ++i) {
+    if (LogThrottle::BucketIndex(kFormats[i]) == LogThrottle::BucketIndex(first)) {
+      second = kFormats[i];
+    }
+  }
+  ASSERT_TRUE(second);
+
+  // Evicting each other must not hand out fresh bursts.
+  LogThrottle throttle(2, 1, 100);
+  Summaries summaries;
+  int admitted = 0;
+  for (int i = 0; i < 20; ++i) {
+    admitted += throttle.Admit(Capture(i % 2 ? second : first), 0, summaries.callback());
+  }
+  EXPECT_EQ(2, admitted);
+}
+
+TEST(LogThrottle, DeduplicatesAndFlushesRepeats) {
+  LogThrottle throttle;
+  Summaries summaries;
+  static const char kFormat[] = "stuck %d\n";
+
+  EXPECT_TRUE(throttle.Admit(Capture(kFormat, 1), 0, summaries.callback()));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_FALSE(throttle.Admit(Capture(kFormat, 1), 10, summaries.callback()));
+  }
+  EXPECT_EQ(4u, throttle.stats().deduplicated);
+  EXPECT_TRUE(summaries.lines().empty());
+
+  // Nothing else is logged. The count still comes out on a flush, but
+  // not more than once per interval.
+  throttle.Flush(LogThrottle::kSummaryIntervalMs, summaries.callback());
+  ASSERT_EQ(1u, summaries.lines().size());
+  EXPECT_THAT(summaries.lines()[0], testing::HasSubstr("repeated 4 times"));
+
+  EXPECT_FALSE(throttle.Admit(Capture(kFormat, 1), 2100, summaries.callback()));
+  throttle.Flush(2200, summaries.callback());
+  EXPECT_EQ(1u, summaries.lines().size());
+  throttle.Flush(2 * LogThrottle::kSummaryIntervalMs, summaries.callback());
+  ASSERT_EQ(2u, summaries.lines().size());
+  EXPECT_THAT(summaries.lines()[1], testing::HasSubstr("repeated 1 times"));
+}
+
+TEST(LogThrottle, FlushReportsSuppressedLines) {
+  LogThrottle throttle(1, 1, 100);
+  Summaries summaries;
+  static const char kFormat[] = "burst %d\n";
+
+  EXPECT_TRUE(throttle.Admit(Capture(kFormat, 1), 0, summaries.callback()));
+  EXPECT_FALSE(throttle.Admit(Capture(kFormat, 2), 0, summaries.callback()));
+  EXPECT_FALSE(throttle.Admit(Capture(kFormat, 3), 0, summaries.callback()));
+
+  throttle.Flush(LogThrottle::kSummaryIntervalMs, summaries.callback());
+  ASSERT_EQ(1u, summaries.lines().size());
+  EXPECT_THAT(summaries.lines()[0], testing::HasSubstr("2 lines suppressed"));
+}
+
+}  // namespace esp_cxx
@@ -0,0 +1,100 @@
+#include "esp_cxx/logging.h"
+
+#include <string>
+
+#include "esp_cxx/config_store.h"
+
+#include "gtest/gtest.h"
+
+namespace esp_cxx {
+
+namespace {
+
+// Levels are process wide and tags are never removed, so each test uses
+// its own tags and puts the default back when done.
+class LoggingTest : public testing::Test {
+ protected:
+  void TearDown() override {
+    SetLogLevel("*", ESP_LOG_VERBOSE);
+  }
+};
+
+}  // namespace
+
+TEST(ParseLogLevel, NamesAndDigits) {
+  EXPECT_EQ(ESP_LOG_NONE, ParseLogLevel("none"));
+  EXPECT_EQ(ESP_LOG_ERROR, ParseLogLevel("error"));
+  EXPECT_EQ(ESP_LOG_WARN, ParseLogLevel("warn"));
+  EXPECT_EQ(ESP_LOG_INFO, ParseLogLevel("info"));
+  EXPECT_EQ(ESP_LOG_DEBUG, ParseLogLevel("debug"));
+  EXPECT_EQ(ESP_LOG_VERBOSE, ParseLogLevel("verbose"));
+  EXPECT_EQ(ESP_LOG_NONE, ParseLogLevel("0"));
+  EXPECT_EQ(ESP_LOG_VERBOSE, ParseLogLevel("5"));
+}
+
+TEST(ParseLogLevel, RejectsOthers) {
+  EXPECT_FALSE(ParseLogLevel(""));
+  EXPECT_FALSE(ParseLogLevel("6"));
+  EXPECT_FALSE(ParseLogLevel("12"));
+  EXPECT_FALSE(ParseLogLevel("INFO"));
+  EXPECT_FALSE(ParseLogLevel("warning"));
+}
+
+TEST_F(LoggingTest, TagLevelOverridesDefault) {
+  SetLogLevel("*", ESP_LOG_WARN);
+  SetLogLevel("enabled_tag", ESP_LOG_DEBUG);
+
+  EXPECT_TRUE(IsLogEnabled("other_tag", ESP_LOG_WARN));
+  EXPECT_FALSE(IsLogEnabled("other_tag", ESP_LOG_INFO));
+  EXPECT_TRUE(IsLogEnabled("enabled_tag", ESP_LOG_DEBUG));
+  EXPECT_FALSE(IsLogEnabled("enabled_tag", ESP_LOG_VERBOSE));
+
+  // Matched by content, not pointer.
+  std::string tag = "enabled_tag";
+  EXPECT_TRUE(IsLogEnabled(tag.c_str(), ESP_LOG_DEBUG));
+}
+
+TEST_F(LoggingTest, QuieterTag) {
+  SetLogLevel("quiet_tag", ESP_LOG_ERROR);
+  EXPECT_EQ(ESP_LOG_ERROR, GetLogLevel("quiet_tag"));
+  EXPECT_FALSE(IsLogEnabled("quiet_tag", ESP_LOG_WARN));
+  EXPECT_TRUE(IsLogEnabled("other_tag", ESP_LOG_WARN));
+
+  SetLogLevel("quiet_tag", ESP_LOG_NONE);
+  EXPECT_FALSE(IsLogEnabled("quiet_tag", ESP_LOG_ERROR));
+}
+
+TEST_F(LoggingTest, TooLongTagKeepsDefault) {
+  SetLogLevel("*", ESP_LOG_INFO);
+  SetLogLevel("a_very_long_tag_name", ESP_LOG_VERBOSE);
+  EXPECT_EQ(ESP_LOG_INFO, GetLogLevel("a_very_long_tag_name"));
+  EXPECT_EQ(ESP_LOG_INFO, GetLogLevel("a_very_long_tag"));
+}
+
+TEST_F(LoggingTest, LoadLogLevels) {
+  ConfigStore config_store;
+  config_store.SetValue(kLogLevelConfigPrefix, "wifi", "debug");
+  config_store.SetValue(kLogLevelConfigPrefix, "*", "error");
+  config_store.SetValue(kLogLevelConfigPrefix, "bad_level", "loud");
+  config_store.SetValue("other", "http", "none");
+
+  LoadLogLevels(&config_store);
+
+  EXPECT_EQ(ESP_LOG_DEBUG, GetLogLevel("wifi"));
+  EXPECT_EQ(ESP_LOG_ERROR, GetLogLevel("bad_level"));
+  EXPECT_EQ(ESP_LOG_ERROR, GetLogLevel("http"));
+  EXPECT_EQ(ESP_LOG_ERROR, GetLogLevel("anything"));
+}
+
+// Runs last. It uses up what is left of the tag table.
+TEST_F(LoggingTest, FullTableKeepsDefault) {
+  SetLogLevel("*", ESP_LOG_INFO);
+  for (int i = 0; i < 20; ++i) {
+    SetLogLevel(("filler" + std::to_string(i)).c_str(), ESP_LOG_DEBUG);
+  }
+  EXPECT_EQ(ESP_LOG_DEBUG, GetLogLevel("filler0"));
+  EXPECT_EQ(ESP_LOG_INFO, GetLogLevel("filler19"));
+  EXPECT_FALSE(IsLogEnabled("filler19", ESP_LOG_DEBUG));
+}
+
+}  // namespace esp_cxx
@@ -0,0 +1,45 @@
+#include "esp_cxx/httpd/query_params.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using namespace esp_cxx;
+
+TEST(QueryParams, IteratesRawPieces) {
+  QueryParams params("a=1&&flag&b=x%20y&=empty");
+  std::vector<std::string> seen;
+  for (const auto& param : params) {
+    seen.push_back(std::string(param.key) + "|" + std::string(param.value));
+  }
+  EXPECT_THAT(seen, testing::ElementsAre("a|1", "flag|", "b|x%20y", "|empty"));
+  EXPECT_EQ(params.end(), QueryParams().begin());
+}
+
+TEST(QueryParams, GetDecodesOnlyWhenNeeded) {
+  std::string_view query = "id=42&name=J%C3%B6rg+K&bad=100%&msg%5B%5D=hi";
+  QueryParams params(query);
+  char buf[16];
+
+  auto id = params.Get("id", buf);
+  ASSERT_TRUE(id);
+  EXPECT_EQ("42", id.value());
+  // Undecoded values point into the input.
+  EXPECT_GE(id->data(), query.data());
+  EXPECT_LT(id->data(), query.data() + query.size());
+
+  auto name = params.Get("name", buf);
+  ASSERT_TRUE(name);
+  EXPECT_EQ("J\xc3\xb6rg K", name.value());
+  EXPECT_EQ(&buf[0], name->data());
+
+  EXPECT_EQ("100%", params.Get("bad", buf).value());
+  // Keys are compared decoded.
+  EXPECT_EQ("hi", params.Get("msg[]", buf).value());
+  EXPECT_FALSE(params.Get("missing", buf));
+
+  char tiny[3];
+  EXPECT_FALSE(params.Get("name", tiny));
+}
@@ -0,0 +1,53 @@
+#include "esp_cxx/httpd/route_table.h"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using namespace esp_cxx;
+
+namespace {
+using Table = RouteTable<int>;
+constexpr HttpMethodMask kGet = ToMask(HttpMethod::kGet);
+constexpr HttpMethodMask kPost = ToMask(HttpMethod::kPost);
+}  // namespace
+
+TEST(RouteTable, ExactRoutes) {
+  Table table;
+  table.Add("/$", kAnyHttpMethod, 1);
+  table.Add("/api/stats$", kGet, 2);
+  table.Add("/api/config$", kAnyHttpMethod, 3);
+
+  EXPECT_EQ(1, table.Find("/", HttpMethod::kGet).target);
+  EXPECT_EQ(2, table.Find("/api/stats", HttpMethod::kGet).target);
+  EXPECT_EQ(3, table.Find("/api/config", HttpMethod::kPost).target);
+  EXPECT_EQ(Table::Match::kNone, table.Find("/api/stats/x", HttpMethod::kGet).match);
+  EXPECT_EQ(Table::Match::kNone, table.Find("/api", HttpMethod::kGet).match);
+}
+
+TEST(RouteTable, LongestPrefixWins) {
+  Table table;
+  table.Add("/static", kGet, 1);
+  table.Add("/static/img", kGet, 2);
+  table.Add("/static/img/logo.png$", kGet, 3);
+
+  EXPECT_EQ(1, table.Find("/static/app.js", HttpMethod::kGet).target);
+  EXPECT_EQ(2, table.Find("/static/img/a.png", HttpMethod::kGet).target);
+  EXPECT_EQ(3, table.Find("/static/img/logo.png", HttpMethod::kGet).target);
+}
+
+TEST(RouteTable, MethodDispatch) {
+  Table table;
+  table.Add("/api/thing$", kGet, 1);
+  table.Add("/api/thing$", kPost, 2);
+
+  EXPECT_EQ(1, table.Find("/api/thing", HttpMethod::kGet).target);
+  EXPECT_EQ(2, table.Find("/api/thing", HttpMethod::kPost).target);
+
+  auto result = table.Find("/api/thing", HttpMethod::kDelete);
+  EXPECT_EQ(Table::Match::kWrongMethod, result.match);
+  EXPECT_EQ(kGet | kPost, result.allowed);
+
+  char allow[32];
+  FormatAllowedMethods(result.allowed, allow, sizeof(allow));
+  EXPECT_STREQ("GET, POST", allow);
+}
@@ -0,0 +1,194 @@
+#include "esp_cxx/httpd/websocket_broadcaster.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using namespace esp_cxx;
+using testing::ElementsAre;
+using testing::ElementsAreArray;
+
+namespace {
+
+void IgnoreEvent(mg_connection* nc, int event, void* event_data, void* user_data) {
+}
+
+size_t WriteGapNotice(uint32_t missed, char* buffer, size_t size) {
+  return snprintf(buffer, size, "missed %u", missed);
+}
+
+// Frames the broadcaster queued on |nc| up to now, as "<opcode>:<payload>".
+// Frames are small so the length fits in the first header bytes. The
+// connection is never polled so the bytes stay in the send buffer.
+std::vector<std::string> TakeFrames(mg_connection* nc) {
+  std::vector<std::string> frames;
+  std::string_view data(nc->send_mbuf.buf, nc->send_mbuf.len);
+  while (data.size() >= 2) {
+    int opcode = data[0] & 0x0f;
+    size_t len = data[1] & 0x7f;
+    // Mongoose masks the frames it writes itself (the gap notice) since
+    // |nc| has no listener and looks like a client connection.
+    bool masked = data[1] & 0x80;
+    size_t header_size = masked ? 6 : 2;
+    std::string payload(data.substr(header_size, len));
+    for (size_t i = 0; masked && i < payload.size(); ++i) {
+      payload[i] ^= data[2 + i % 4];
+    }
+    frames.push_back(std::to_string(opcode) + ":" + payload);
+    data.remove_prefix(header_size + len);
+  }
+  mbuf_remove(&nc->send_mbuf, nc->send_mbuf.len);
+  return frames;
+}
+
+class WebsocketBroadcasterTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    mg_mgr_init(&mgr_, nullptr);
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds_));
+    nc_ = mg_add_sock(&mgr_, fds_[0], &IgnoreEvent, nullptr);
+    broadcaster_.set_gap_notice(&WriteGapNotice);
+    broadcaster_.Subscribe(WebsocketSender(nc_));
+  }
+
+  void TearDown() override {
+    broadcaster_.Unsubscribe(WebsocketSender(nc_));
+    mg_mgr_free(&mgr_);  // Closes fds_[0].
+    close(fds_[1]);
+  }
+
+  // Fills the send buffer to the high water mark so published frames stay
+  // in the subscriber's queue.
+  void Stall() {
+    std::string filler(WebsocketBroadcaster::kSendHighWater, 'x');
+    mg_send(nc_, filler.data(), filler.size());
+  }
+
+  // Empties the send buffer, as if the socket took it all, and lets the
+  // broadcaster refill it.
+  std::vector<std::string> Drain() {
+    mbuf_remove(&nc_->send_mbuf, nc_->send_mbuf.len);
+    broadcaster_.OnWritable(WebsocketSender(nc_));
+    return TakeFrames(nc_);
+  }
+
+  // Publishes "m<first>" to "m<last>".
+  void PublishRange(int first, int last) {
+    for (int i = first; i <= last; ++i) {
+      EXPECT_TRUE(broadcaster_.Publish(WebsocketOpcode::kText, "m" + std::to_string(i)));
+    }
+  }
+
+  static std::vector<std::string> Texts(int first, int last) {
+    std::vector<std::string> texts;
+    for (int i = first; i <= last; ++i) {
+      texts.push_back("1:m" + std::to_string(i));
+    }
+    return texts;
+  }
+
+  mg_mgr mgr_;
+  int fds_[2];
+  mg_connection* nc_ = nullptr;
+  WebsocketBroadcaster broadcaster_;
+};
+
+TEST_F(WebsocketBroadcasterTest, SendsDirectlyWhenNotStalled) {
+  PublishRange(0, 2);
+  EXPECT_THAT(TakeFrames(nc_), ElementsAreArray(Texts(0, 2)));
+  EXPECT_EQ(3u, broadcaster_.stats().published);
+  EXPECT_EQ(0u, broadcaster_.stats().dropped);
+}
+
+TEST_F(WebsocketBroadcasterTest, DropOldest) {
+  broadcaster_.set_overflow_policy(WebsocketBroadcaster::OverflowPolicy::kDropOldest);
+  Stall();
+  PublishRange(0, WebsocketBroadcaster::kQueueSize + 2);
+
+  EXPECT_EQ(3u, broadcaster_.stats().dropped);
+  std::vector<std::string> expected = {"1:missed 3"};
+  for (const std::string& text : Texts(3, WebsocketBroadcaster::kQueueSize + 2)) {
+    expected.push_back(text);
+  }
+  EXPECT_THAT(Drain(), ElementsAreArray(expected));
+
+  // Reported once.
+  PublishRange(100, 100);
+  EXPECT_THAT(TakeFrames(nc_), ElementsAre("1:m100"));
+  EXPECT_EQ(3u, broadcaster_.stats().dropped);
+}
+
+TEST_F(WebsocketBroadcasterTest, DropNewest) {
+  broadcaster_.set_overflow_policy(WebsocketBroadcaster::OverflowPolicy::kDropNewest);
+  Stall();
+  PublishRange(0, WebsocketBroadcaster::kQueueSize + 1);
+
+  EXPECT_EQ(2u, broadcaster_.stats().dropped);
+  std::vector<std::string> expected = {"1:missed 2"};
+  for (const std::string& text : Texts(0, WebsocketBroadcaster::kQueueSize - 1)) {
+    expected.push_back(text);
+  }
+  EXPECT_THAT(Drain(), ElementsAreArray(expected));
+}
+
+TEST_F(WebsocketBroadcasterTest, GapNoticeSumsWeights) {
+  broadcaster_.set_overflow_policy(WebsocketBroadcaster::OverflowPolicy::kDropOldest);
+  Stall();
+  // The first two frames are dropped, weighing 3 and 4.
+  for (int i = 0; i < static_cast<int>(WebsocketBroadcaster::kQueueSize) + 2; ++i) {
+    EXPECT_TRUE(broadcaster_.Publish(WebsocketOpcode::kText, "m" + std::to_string(i), i + 3));
+  }
+
+  // Still counted in frames.
+  EXPECT_EQ(2u, broadcaster_.stats().dropped);
+  std::vector<std::string> frames = Drain();
+  ASSERT_EQ(WebsocketBroadcaster::kQueueSize + 1, frames.size());
+  EXPECT_EQ("1:missed 7", frames[0]);
+  EXPECT_EQ("1:m2", frames[1]);
+}
+
+TEST_F(WebsocketBroadcasterTest, Disconnect) {
+  broadcaster_.set_overflow_policy(WebsocketBroadcaster::OverflowPolicy::kDisconnect);
+  Stall();
+  PublishRange(0, WebsocketBroadcaster::kQueueSize - 1);
+  EXPECT_FALSE(nc_->flags & MG_F_CLOSE_IMMEDIATELY);
+
+  PublishRange(WebsocketBroadcaster::kQueueSize, WebsocketBroadcaster::kQueueSize + 1);
+  EXPECT_TRUE(nc_->flags & MG_F_CLOSE_IMMEDIATELY);
+  EXPECT_EQ(1u, broadcaster_.stats().disconnected);
+  // Closing, not falling behind.
+  EXPECT_EQ(0u, broadcaster_.stats().dropped);
+
+  // The queue was released and nothing more is queued.
+  EXPECT_THAT(Drain(), ElementsAre());
+}
+
+TEST_F(WebsocketBroadcasterTest, GapNoticeOnlyAheadOfDeliveredFrame) {
+  Stall();
+  PublishRange(0, WebsocketBroadcaster::kQueueSize);
+  EXPECT_EQ(1u, broadcaster_.stats().dropped);
+
+  // Still stalled. The notice waits for a frame to go with.
+  broadcaster_.OnWritable(WebsocketSender(nc_));
+  EXPECT_EQ(WebsocketBroadcaster::kSendHighWater, nc_->send_mbuf.len);
+
+  std::vector<std::string> frames = Drain();
+  ASSERT_EQ(WebsocketBroadcaster::kQueueSize + 1, frames.size());
+  EXPECT_EQ("1:missed 1", frames[0]);
+  EXPECT_EQ("1:m1", frames[1]);
+}
+
+TEST_F(WebsocketBroadcasterTest, NoGapNoticeUnlessSet) {
+  broadcaster_.set_gap_notice(nullptr);
+  Stall();
+  PublishRange(0, WebsocketBroadcaster::kQueueSize);
+  EXPECT_THAT(Drain(), ElementsAreArray(Texts(1, WebsocketBroadcaster::kQueueSize)));
+}
+
+}  // namespace